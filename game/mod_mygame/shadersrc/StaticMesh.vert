@@ -2,9 +2,15 @@
 
 layout ( binding = 0 ) uniform UniformBufferObject
 {
-	mat4 mvp;
+	mat4 viewProj;
 } ubo_mvp;
 
+// Pushed per draw
+layout ( push_constant ) uniform DrawConstants
+{
+	mat4 model;
+} drawConstants;
+
 /* Vertex Layout Order:
 	0: Position
 	1: Normal
@@ -23,7 +29,7 @@ layout ( location = 1 ) out vec4 fragColor;
 
 void main()
 {
-	gl_Position = ubo_mvp.mvp * vec4( inPosition, 1.0 );
+	gl_Position = ubo_mvp.viewProj * ( drawConstants.model * vec4( inPosition, 1.0 ) );
 	
 	fragColor = inColor;
 	fragTexCoord = inTexCoord;
@@ -2,11 +2,15 @@
 
 layout( binding = 0 ) uniform UniformBufferObject
 {
-	mat4 model;
-	mat4 view;
-	mat4 proj;
+	mat4 viewProj;
 } ubo_mvp;
 
+// Pushed per draw
+layout( push_constant ) uniform DrawConstants
+{
+	mat4 model;
+} drawConstants;
+
 /* Vertex Layout Order:
 	0: Position
 	1: Normal
@@ -23,8 +27,7 @@ layout ( location = 0 ) out vec4 fragColor;
 
 void main()
 {
-	mat4 mvp = ubo_mvp.proj * ubo_mvp.view * ubo_mvp.model; // Should calculate MVP matrix outside of shader, but meh
-	gl_Position = mvp * vec4( inPosition, 1.0 );
+	gl_Position = ubo_mvp.viewProj * ( drawConstants.model * vec4( inPosition, 1.0 ) );
 	
 	fragColor = inColor;
 }
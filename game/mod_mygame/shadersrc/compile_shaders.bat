@@ -1,7 +1,10 @@
 SET glslValidator=%VULKAN_SDK%\Bin\glslangValidator.exe
+SET spirvVal=%VULKAN_SDK%\Bin\spirv-val.exe
 
 %glslValidator% -V StaticMesh.vert -o ../shaders/StaticMesh.vert.spv
 %glslValidator% -V StaticMesh.frag -o ../shaders/StaticMesh.frag.spv
 
 %glslValidator% -V Wireframe.vert -o ../shaders/Wireframe.vert.spv
-%glslValidator% -V Wireframe.frag -o ../shaders/Wireframe.frag.spv
\ No newline at end of file
+%glslValidator% -V Wireframe.frag -o ../shaders/Wireframe.frag.spv
+
+for %%f in (..\shaders\*.spv) do %spirvVal% %%f
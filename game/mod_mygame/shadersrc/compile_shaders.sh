@@ -0,0 +1,16 @@
+#!/bin/sh
+set -e
+cd "$(dirname "$0")"
+
+glslValidator="${VULKAN_SDK:+$VULKAN_SDK/bin/}glslangValidator"
+spirvVal="${VULKAN_SDK:+$VULKAN_SDK/bin/}spirv-val"
+
+$glslValidator -V StaticMesh.vert -o ../shaders/StaticMesh.vert.spv
+$glslValidator -V StaticMesh.frag -o ../shaders/StaticMesh.frag.spv
+
+$glslValidator -V Wireframe.vert -o ../shaders/Wireframe.vert.spv
+$glslValidator -V Wireframe.frag -o ../shaders/Wireframe.frag.spv
+
+for spv in ../shaders/*.spv; do
+	$spirvVal "$spv"
+done
@@ -164,6 +164,8 @@ project "engine"
 	}
 	
 	files {
+		ENGINE_SOURCE_DIR .. "/bcencoder.cpp",
+		ENGINE_SOURCE_DIR .. "/bcencoder.hpp",
 		ENGINE_SOURCE_DIR .. "/clock.hpp",
 		ENGINE_SOURCE_DIR .. "/commandlinesystem.cpp",
 		ENGINE_SOURCE_DIR .. "/commandlinesystem.hpp",
@@ -175,16 +177,26 @@ project "engine"
 		ENGINE_SOURCE_DIR .. "/vfile.hpp",
 		ENGINE_SOURCE_DIR .. "/filesystem.cpp",
 		ENGINE_SOURCE_DIR .. "/filesystem.hpp",
+		ENGINE_SOURCE_DIR .. "/geometryarena.cpp",
+		ENGINE_SOURCE_DIR .. "/geometryarena.hpp",
+		ENGINE_SOURCE_DIR .. "/glbparser.cpp",
+		ENGINE_SOURCE_DIR .. "/glbparser.hpp",
 		ENGINE_SOURCE_DIR .. "/inputevent.hpp",
 		ENGINE_SOURCE_DIR .. "/inputsystem.cpp",
 		ENGINE_SOURCE_DIR .. "/inputsystem.hpp",
 		ENGINE_SOURCE_DIR .. "/main.cpp",
+		ENGINE_SOURCE_DIR .. "/mappedfile.cpp",
+		ENGINE_SOURCE_DIR .. "/mappedfile.hpp",
 		ENGINE_SOURCE_DIR .. "/material.cpp",
 		ENGINE_SOURCE_DIR .. "/material.hpp",
 		ENGINE_SOURCE_DIR .. "/materialsystem.cpp",
 		ENGINE_SOURCE_DIR .. "/materialsystem.hpp",
 		ENGINE_SOURCE_DIR .. "/mesh.cpp",
 		ENGINE_SOURCE_DIR .. "/mesh.hpp",
+		ENGINE_SOURCE_DIR .. "/meshlet.hpp",
+		ENGINE_SOURCE_DIR .. "/meshlod.hpp",
+		ENGINE_SOURCE_DIR .. "/meshoptimizer.cpp",
+		ENGINE_SOURCE_DIR .. "/meshoptimizer.hpp",
 		ENGINE_SOURCE_DIR .. "/meshsystem.cpp",
 		ENGINE_SOURCE_DIR .. "/meshsystem.hpp",
 		ENGINE_SOURCE_DIR .. "/model.cpp",
@@ -194,6 +206,12 @@ project "engine"
 		ENGINE_SOURCE_DIR .. "/modulesystem.cpp",
 		ENGINE_SOURCE_DIR .. "/modulesystem.hpp",
 		ENGINE_SOURCE_DIR .. "/mount.hpp",
+		ENGINE_SOURCE_DIR .. "/objparser.cpp",
+		ENGINE_SOURCE_DIR .. "/objparser.hpp",
+		ENGINE_SOURCE_DIR .. "/parsedmesh.hpp",
+		ENGINE_SOURCE_DIR .. "/pixelkernels.cpp",
+		ENGINE_SOURCE_DIR .. "/pixelkernels.hpp",
+		ENGINE_SOURCE_DIR .. "/renderlist.cpp",
 		ENGINE_SOURCE_DIR .. "/renderlist.hpp",
 		ENGINE_SOURCE_DIR .. "/renderview.hpp",
 		ENGINE_SOURCE_DIR .. "/resource.hpp",
@@ -201,6 +219,8 @@ project "engine"
 		ENGINE_SOURCE_DIR .. "/resourcepool.hpp",
 		ENGINE_SOURCE_DIR .. "/rendersystem.cpp",
 		ENGINE_SOURCE_DIR .. "/rendersystem.hpp",
+		ENGINE_SOURCE_DIR .. "/samplercache.cpp",
+		ENGINE_SOURCE_DIR .. "/samplercache.hpp",
 		ENGINE_SOURCE_DIR .. "/sdlwindow.cpp",
 		ENGINE_SOURCE_DIR .. "/sdlwindow.hpp",
 		ENGINE_SOURCE_DIR .. "/sdlwrapper.cpp",
@@ -210,17 +230,24 @@ project "engine"
 		ENGINE_SOURCE_DIR .. "/shadersystem.cpp",
 		ENGINE_SOURCE_DIR .. "/shadersystem.hpp",
 		ENGINE_SOURCE_DIR .. "/state.hpp",
+		ENGINE_SOURCE_DIR .. "/stb_decode.hpp",
 		ENGINE_SOURCE_DIR .. "/stb_filesystem.cpp",
 		ENGINE_SOURCE_DIR .. "/stb_filesystem.hpp",
 		ENGINE_SOURCE_DIR .. "/stb_implementation.cpp",
 		ENGINE_SOURCE_DIR .. "/texture.cpp",
 		ENGINE_SOURCE_DIR .. "/texture.hpp",
+		ENGINE_SOURCE_DIR .. "/texturecooker.cpp",
+		ENGINE_SOURCE_DIR .. "/texturecooker.hpp",
+		ENGINE_SOURCE_DIR .. "/texturestreamer.cpp",
+		ENGINE_SOURCE_DIR .. "/texturestreamer.hpp",
 		ENGINE_SOURCE_DIR .. "/texturesystem.cpp",
 		ENGINE_SOURCE_DIR .. "/texturesystem.hpp",
 		ENGINE_SOURCE_DIR .. "/thread.cpp",
 		ENGINE_SOURCE_DIR .. "/thread.hpp",
-		ENGINE_SOURCE_DIR .. "/ubo.cpp",
-		ENGINE_SOURCE_DIR .. "/ubo.hpp",
+		ENGINE_SOURCE_DIR .. "/uniformallocator.cpp",
+		ENGINE_SOURCE_DIR .. "/uniformallocator.hpp",
+		ENGINE_SOURCE_DIR .. "/uploadmanager.cpp",
+		ENGINE_SOURCE_DIR .. "/uploadmanager.hpp",
 		ENGINE_SOURCE_DIR .. "/vertex.cpp",
 		ENGINE_SOURCE_DIR .. "/vertex.hpp",
 		ENGINE_SOURCE_DIR .. "/vpk.cpp",
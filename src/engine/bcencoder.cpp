@@ -0,0 +1,652 @@
+#include "bcencoder.hpp"
+#include "thread.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	// Texels of one block as floats in 0..255
+	using BlockTexels = float[ 16 ][ 4 ];
+
+	// BC7 4 bit index weights out of 64
+	constexpr int Bc7Weights[ 16 ] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// BC1 index to how far along from c0 to c1 it sits
+	constexpr float Bc1Weights[ 4 ] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+	constexpr int RefineIterations = 2;
+
+	void LoadBlock( const unsigned char *rgba, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, BlockTexels texels )
+	{
+		for ( uint32_t y = 0; y < 4; ++y )
+		{
+			const uint32_t sy = std::min( blockY * 4 + y, height - 1 );
+
+			for ( uint32_t x = 0; x < 4; ++x )
+			{
+				const uint32_t sx = std::min( blockX * 4 + x, width - 1 );
+				const unsigned char *texel = rgba + ( size_t( sy ) * width + sx ) * 4;
+
+				for ( int c = 0; c < 4; ++c )
+					texels[ y * 4 + x ][ c ] = texel[ c ];
+			}
+		}
+	}
+
+	// Picks two endpoints for the first 'channels' channels that the block's texels lie between
+	void FitEndpoints( const BlockTexels texels, int channels, BcEncoder::Quality quality, float e0[ 4 ], float e1[ 4 ] )
+	{
+		float mean[ 4 ] = {};
+		float minimum[ 4 ] = { 255.0f, 255.0f, 255.0f, 255.0f };
+		float maximum[ 4 ] = {};
+
+		for ( int i = 0; i < 16; ++i )
+		{
+			for ( int c = 0; c < channels; ++c )
+			{
+				mean[ c ] += texels[ i ][ c ];
+				minimum[ c ] = std::min( minimum[ c ], texels[ i ][ c ] );
+				maximum[ c ] = std::max( maximum[ c ], texels[ i ][ c ] );
+			}
+		}
+
+		for ( int c = 0; c < channels; ++c )
+			mean[ c ] /= 16.0f;
+
+		float covariance[ 4 ][ 4 ] = {};
+
+		for ( int i = 0; i < 16; ++i )
+		{
+			for ( int a = 0; a < channels; ++a )
+			{
+				for ( int b = a; b < channels; ++b )
+					covariance[ a ][ b ] += ( texels[ i ][ a ] - mean[ a ] ) * ( texels[ i ][ b ] - mean[ b ] );
+			}
+		}
+
+		for ( int a = 0; a < channels; ++a )
+		{
+			for ( int b = 0; b < a; ++b )
+				covariance[ a ][ b ] = covariance[ b ][ a ];
+		}
+
+		if ( quality == BcEncoder::Quality::Fast )
+		{
+			// Box corners, flipping channels that run against the widest one so we take the right diagonal
+			int widest = 0;
+			for ( int c = 1; c < channels; ++c )
+			{
+				if ( maximum[ c ] - minimum[ c ] > maximum[ widest ] - minimum[ widest ] )
+					widest = c;
+			}
+
+			for ( int c = 0; c < channels; ++c )
+			{
+				const float inset = ( maximum[ c ] - minimum[ c ] ) / 16.0f;
+				const bool flip = covariance[ widest ][ c ] < 0.0f;
+
+				e0[ c ] = ( flip ? minimum[ c ] + inset : maximum[ c ] - inset );
+				e1[ c ] = ( flip ? maximum[ c ] - inset : minimum[ c ] + inset );
+			}
+
+			return;
+		}
+
+		// Power iteration for the principal axis, starting from the box diagonal
+		float axis[ 4 ] = {};
+		for ( int c = 0; c < channels; ++c )
+			axis[ c ] = maximum[ c ] - minimum[ c ] + 1.0f;
+
+		for ( int iteration = 0; iteration < 8; ++iteration )
+		{
+			float next[ 4 ] = {};
+			float largest = 0.0f;
+
+			for ( int a = 0; a < channels; ++a )
+			{
+				for ( int b = 0; b < channels; ++b )
+					next[ a ] += covariance[ a ][ b ] * axis[ b ];
+
+				largest = std::max( largest, std::abs( next[ a ] ) );
+			}
+
+			if ( largest < 1e-6f ) {
+				break;
+			}
+
+			for ( int c = 0; c < channels; ++c )
+				axis[ c ] = next[ c ] / largest;
+		}
+
+		float length = 0.0f;
+		for ( int c = 0; c < channels; ++c )
+			length += axis[ c ] * axis[ c ];
+
+		length = std::sqrt( length );
+
+		if ( length < 1e-6f )
+		{
+			for ( int c = 0; c < channels; ++c )
+				e0[ c ] = e1[ c ] = mean[ c ];
+
+			return;
+		}
+
+		for ( int c = 0; c < channels; ++c )
+			axis[ c ] /= length;
+
+		float minT = std::numeric_limits< float >::max();
+		float maxT = std::numeric_limits< float >::lowest();
+
+		for ( int i = 0; i < 16; ++i )
+		{
+			float t = 0.0f;
+			for ( int c = 0; c < channels; ++c )
+				t += ( texels[ i ][ c ] - mean[ c ] ) * axis[ c ];
+
+			minT = std::min( minT, t );
+			maxT = std::max( maxT, t );
+		}
+
+		// Pull the ends in a little, the interpolated colors cover the middle better than the extremes lose
+		const float inset = ( maxT - minT ) / 16.0f;
+		minT += inset;
+		maxT -= inset;
+
+		for ( int c = 0; c < channels; ++c )
+		{
+			e0[ c ] = std::clamp( mean[ c ] + axis[ c ] * maxT, 0.0f, 255.0f );
+			e1[ c ] = std::clamp( mean[ c ] + axis[ c ] * minT, 0.0f, 255.0f );
+		}
+	}
+
+	// Least squares endpoints for texels that sit 'weights[ i ]' of the way from e0 to e1, false if it's singular
+	bool SolveEndpoints( const BlockTexels texels, int channels, const float weights[ 16 ], float e0[ 4 ], float e1[ 4 ] )
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float x0[ 4 ] = {}, x1[ 4 ] = {};
+
+		for ( int i = 0; i < 16; ++i )
+		{
+			const float t = weights[ i ];
+			const float s = 1.0f - t;
+
+			aa += s * s;
+			ab += s * t;
+			bb += t * t;
+
+			for ( int c = 0; c < channels; ++c )
+			{
+				x0[ c ] += s * texels[ i ][ c ];
+				x1[ c ] += t * texels[ i ][ c ];
+			}
+		}
+
+		const float det = aa * bb - ab * ab;
+
+		if ( std::abs( det ) < 1e-6f ) {
+			return false;
+		}
+
+		for ( int c = 0; c < channels; ++c )
+		{
+			e0[ c ] = std::clamp( ( bb * x0[ c ] - ab * x1[ c ] ) / det, 0.0f, 255.0f );
+			e1[ c ] = std::clamp( ( aa * x1[ c ] - ab * x0[ c ] ) / det, 0.0f, 255.0f );
+		}
+
+		return true;
+	}
+
+	void Write16( unsigned char *dst, uint16_t value )
+	{
+		dst[ 0 ] = static_cast< unsigned char >( value );
+		dst[ 1 ] = static_cast< unsigned char >( value >> 8 );
+	}
+
+	void Write64( unsigned char *dst, uint64_t value, int bytes )
+	{
+		for ( int i = 0; i < bytes; ++i )
+			dst[ i ] = static_cast< unsigned char >( value >> ( i * 8 ) );
+	}
+
+	uint16_t To565( const float color[ 4 ] )
+	{
+		const int r = std::clamp( static_cast< int >( color[ 0 ] * 31.0f / 255.0f + 0.5f ), 0, 31 );
+		const int g = std::clamp( static_cast< int >( color[ 1 ] * 63.0f / 255.0f + 0.5f ), 0, 63 );
+		const int b = std::clamp( static_cast< int >( color[ 2 ] * 31.0f / 255.0f + 0.5f ), 0, 31 );
+
+		return static_cast< uint16_t >( ( r << 11 ) | ( g << 5 ) | b );
+	}
+
+	void From565( uint16_t packed, float color[ 3 ] )
+	{
+		const int r = ( packed >> 11 ) & 31;
+		const int g = ( packed >> 5 ) & 63;
+		const int b = packed & 31;
+
+		color[ 0 ] = static_cast< float >( ( r << 3 ) | ( r >> 2 ) );
+		color[ 1 ] = static_cast< float >( ( g << 2 ) | ( g >> 4 ) );
+		color[ 2 ] = static_cast< float >( ( b << 3 ) | ( b >> 2 ) );
+	}
+
+	// Four color mode indices for c0 > c1, returns the squared error
+	float SelectColorIndices( const BlockTexels texels, uint16_t c0, uint16_t c1, uint8_t indices[ 16 ] )
+	{
+		float palette[ 4 ][ 3 ];
+		From565( c0, palette[ 0 ] );
+		From565( c1, palette[ 1 ] );
+
+		for ( int c = 0; c < 3; ++c )
+		{
+			palette[ 2 ][ c ] = ( 2.0f * palette[ 0 ][ c ] + palette[ 1 ][ c ] ) / 3.0f;
+			palette[ 3 ][ c ] = ( palette[ 0 ][ c ] + 2.0f * palette[ 1 ][ c ] ) / 3.0f;
+		}
+
+		float total = 0.0f;
+
+		for ( int i = 0; i < 16; ++i )
+		{
+			float best = std::numeric_limits< float >::max();
+
+			for ( uint8_t p = 0; p < 4; ++p )
+			{
+				float error = 0.0f;
+				for ( int c = 0; c < 3; ++c )
+				{
+					const float d = texels[ i ][ c ] - palette[ p ][ c ];
+					error += d * d;
+				}
+
+				if ( error < best ) {
+					best = error;
+					indices[ i ] = p;
+				}
+			}
+
+			total += best;
+		}
+
+		return total;
+	}
+
+	void EncodeColorBlock( const BlockTexels texels, BcEncoder::Quality quality, unsigned char *dst )
+	{
+		float e0[ 4 ], e1[ 4 ];
+		FitEndpoints( texels, 3, quality, e0, e1 );
+
+		uint16_t c0 = To565( e0 );
+		uint16_t c1 = To565( e1 );
+
+		// Four color mode needs c0 > c1, BC3 always decodes as four colors anyway
+		if ( c0 < c1 )
+			std::swap( c0, c1 );
+
+		uint8_t indices[ 16 ] = {};
+		float error = ( c0 == c1 ) ? 0.0f : SelectColorIndices( texels, c0, c1, indices );
+
+		if ( quality == BcEncoder::Quality::High && c0 != c1 )
+		{
+			for ( int iteration = 0; iteration < RefineIterations; ++iteration )
+			{
+				float weights[ 16 ];
+				for ( int i = 0; i < 16; ++i )
+					weights[ i ] = Bc1Weights[ indices[ i ] ];
+
+				if ( !SolveEndpoints( texels, 3, weights, e0, e1 ) )
+					break;
+
+				uint16_t r0 = To565( e0 );
+				uint16_t r1 = To565( e1 );
+
+				if ( r0 < r1 )
+					std::swap( r0, r1 );
+
+				if ( r0 == r1 )
+					break;
+
+				uint8_t refined[ 16 ];
+				const float refinedError = SelectColorIndices( texels, r0, r1, refined );
+
+				if ( refinedError >= error )
+					break;
+
+				c0 = r0;
+				c1 = r1;
+				error = refinedError;
+				std::copy( refined, refined + 16, indices );
+			}
+		}
+
+		uint32_t packed = 0;
+		if ( c0 != c1 )
+		{
+			for ( int i = 0; i < 16; ++i )
+				packed |= uint32_t( indices[ i ] ) << ( i * 2 );
+		}
+
+		Write16( dst, c0 );
+		Write16( dst + 2, c1 );
+		Write64( dst + 4, packed, 4 );
+	}
+
+	// Builds a BC4 palette and picks the closest entry for every texel, returns the squared error
+	int SelectChannelIndices( const int values[ 16 ], int a0, int a1, uint8_t indices[ 16 ] )
+	{
+		int palette[ 8 ] = { a0, a1 };
+
+		if ( a0 > a1 )
+		{
+			for ( int p = 1; p < 7; ++p )
+				palette[ p + 1 ] = ( ( 7 - p ) * a0 + p * a1 + 3 ) / 7;
+		}
+		else
+		{
+			for ( int p = 1; p < 5; ++p )
+				palette[ p + 1 ] = ( ( 5 - p ) * a0 + p * a1 + 2 ) / 5;
+
+			palette[ 6 ] = 0;
+			palette[ 7 ] = 255;
+		}
+
+		int total = 0;
+
+		for ( int i = 0; i < 16; ++i )
+		{
+			int best = std::numeric_limits< int >::max();
+
+			for ( uint8_t p = 0; p < 8; ++p )
+			{
+				const int d = values[ i ] - palette[ p ];
+
+				if ( d * d < best ) {
+					best = d * d;
+					indices[ i ] = p;
+				}
+			}
+
+			total += best;
+		}
+
+		return total;
+	}
+
+	void EncodeChannelBlock( const BlockTexels texels, int channel, BcEncoder::Quality quality, unsigned char *dst )
+	{
+		int values[ 16 ];
+		int minimum = 255, maximum = 0;
+		int innerMin = 255, innerMax = 0;
+		bool hasExtremes = false;
+
+		for ( int i = 0; i < 16; ++i )
+		{
+			values[ i ] = static_cast< int >( texels[ i ][ channel ] );
+			minimum = std::min( minimum, values[ i ] );
+			maximum = std::max( maximum, values[ i ] );
+
+			if ( values[ i ] == 0 || values[ i ] == 255 ) {
+				hasExtremes = true;
+			}
+			else {
+				innerMin = std::min( innerMin, values[ i ] );
+				innerMax = std::max( innerMax, values[ i ] );
+			}
+		}
+
+		int a0 = maximum;
+		int a1 = minimum;
+		uint8_t indices[ 16 ] = {};
+		int error = ( a0 == a1 ) ? 0 : SelectChannelIndices( values, a0, a1, indices );
+
+		// Six value mode has exact 0 and 255, which helps blocks with a few fully clear or solid texels
+		if ( quality != BcEncoder::Quality::Fast && hasExtremes && error > 0 && innerMin <= innerMax )
+		{
+			uint8_t sixIndices[ 16 ];
+			const int sixError = SelectChannelIndices( values, innerMin, innerMax, sixIndices );
+
+			if ( sixError < error )
+			{
+				a0 = innerMin;
+				a1 = innerMax;
+				error = sixError;
+				std::copy( sixIndices, sixIndices + 16, indices );
+			}
+		}
+
+		uint64_t packed = 0;
+		for ( int i = 0; i < 16; ++i )
+			packed |= uint64_t( indices[ i ] ) << ( i * 3 );
+
+		dst[ 0 ] = static_cast< unsigned char >( a0 );
+		dst[ 1 ] = static_cast< unsigned char >( a1 );
+		Write64( dst + 2, packed, 6 );
+	}
+
+	struct Bc7Endpoint
+	{
+		int quantized[ 4 ] = {}; // 7 bits
+		int pBit = 0;
+		int value[ 4 ] = {};     // Unquantized, ( quantized << 1 ) | pBit
+	};
+
+	// Mode 6 endpoints share one p-bit across all four channels, take whichever rounds closer overall
+	Bc7Endpoint QuantizeBc7Endpoint( const float color[ 4 ] )
+	{
+		Bc7Endpoint best;
+		float bestError = std::numeric_limits< float >::max();
+
+		for ( int pBit = 0; pBit < 2; ++pBit )
+		{
+			Bc7Endpoint endpoint;
+			endpoint.pBit = pBit;
+			float error = 0.0f;
+
+			for ( int c = 0; c < 4; ++c )
+			{
+				endpoint.quantized[ c ] = std::clamp( static_cast< int >( ( color[ c ] - pBit ) / 2.0f + 0.5f ), 0, 127 );
+				endpoint.value[ c ] = ( endpoint.quantized[ c ] << 1 ) | pBit;
+
+				const float d = color[ c ] - endpoint.value[ c ];
+				error += d * d;
+			}
+
+			if ( error < bestError ) {
+				bestError = error;
+				best = endpoint;
+			}
+		}
+
+		return best;
+	}
+
+	float SelectBc7Indices( const BlockTexels texels, const Bc7Endpoint &e0, const Bc7Endpoint &e1, uint8_t indices[ 16 ] )
+	{
+		float palette[ 16 ][ 4 ];
+
+		for ( int p = 0; p < 16; ++p )
+		{
+			for ( int c = 0; c < 4; ++c )
+				palette[ p ][ c ] = static_cast< float >( ( ( 64 - Bc7Weights[ p ] ) * e0.value[ c ] + Bc7Weights[ p ] * e1.value[ c ] + 32 ) >> 6 );
+		}
+
+		float total = 0.0f;
+
+		for ( int i = 0; i < 16; ++i )
+		{
+			float best = std::numeric_limits< float >::max();
+
+			for ( uint8_t p = 0; p < 16; ++p )
+			{
+				float error = 0.0f;
+				for ( int c = 0; c < 4; ++c )
+				{
+					const float d = texels[ i ][ c ] - palette[ p ][ c ];
+					error += d * d;
+				}
+
+				if ( error < best ) {
+					best = error;
+					indices[ i ] = p;
+				}
+			}
+
+			total += best;
+		}
+
+		return total;
+	}
+
+	struct BitWriter
+	{
+		uint64_t bits[ 2 ] = {};
+		int position = 0;
+
+		void Write( uint32_t value, int count )
+		{
+			for ( int i = 0; i < count; ++i, ++position )
+				bits[ position >> 6 ] |= uint64_t( ( value >> i ) & 1 ) << ( position & 63 );
+		}
+	};
+
+	void EncodeBc7Block( const BlockTexels texels, BcEncoder::Quality quality, unsigned char *dst )
+	{
+		float f0[ 4 ], f1[ 4 ];
+		FitEndpoints( texels, 4, quality, f0, f1 );
+
+		Bc7Endpoint e0 = QuantizeBc7Endpoint( f0 );
+		Bc7Endpoint e1 = QuantizeBc7Endpoint( f1 );
+
+		uint8_t indices[ 16 ];
+		float error = SelectBc7Indices( texels, e0, e1, indices );
+
+		if ( quality == BcEncoder::Quality::High )
+		{
+			for ( int iteration = 0; iteration < RefineIterations && error > 0.0f; ++iteration )
+			{
+				float weights[ 16 ];
+				for ( int i = 0; i < 16; ++i )
+					weights[ i ] = Bc7Weights[ indices[ i ] ] / 64.0f;
+
+				if ( !SolveEndpoints( texels, 4, weights, f0, f1 ) )
+					break;
+
+				const Bc7Endpoint r0 = QuantizeBc7Endpoint( f0 );
+				const Bc7Endpoint r1 = QuantizeBc7Endpoint( f1 );
+
+				uint8_t refined[ 16 ];
+				const float refinedError = SelectBc7Indices( texels, r0, r1, refined );
+
+				if ( refinedError >= error )
+					break;
+
+				e0 = r0;
+				e1 = r1;
+				error = refinedError;
+				std::copy( refined, refined + 16, indices );
+			}
+		}
+
+		// The first index is stored with its top bit implied zero, swap the endpoints around if it's set
+		if ( indices[ 0 ] & 8 )
+		{
+			std::swap( e0, e1 );
+			for ( uint8_t &index : indices )
+				index = 15 - index;
+		}
+
+		BitWriter writer;
+		writer.Write( 1 << 6, 7 );
+
+		for ( int c = 0; c < 4; ++c )
+		{
+			writer.Write( e0.quantized[ c ], 7 );
+			writer.Write( e1.quantized[ c ], 7 );
+		}
+
+		writer.Write( e0.pBit, 1 );
+		writer.Write( e1.pBit, 1 );
+
+		writer.Write( indices[ 0 ], 3 );
+		for ( int i = 1; i < 16; ++i )
+			writer.Write( indices[ i ], 4 );
+
+		Write64( dst, writer.bits[ 0 ], 8 );
+		Write64( dst + 8, writer.bits[ 1 ], 8 );
+	}
+}
+
+VkFormat BcEncoder::GetVkFormat( Format format )
+{
+	switch ( format )
+	{
+	case Format::BC1:
+		return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	case Format::BC3:
+		return VK_FORMAT_BC3_UNORM_BLOCK;
+	case Format::BC4:
+		return VK_FORMAT_BC4_UNORM_BLOCK;
+	case Format::BC5:
+		return VK_FORMAT_BC5_UNORM_BLOCK;
+	case Format::BC7:
+		return VK_FORMAT_BC7_UNORM_BLOCK;
+	}
+
+	return VK_FORMAT_UNDEFINED;
+}
+
+size_t BcEncoder::GetBlockSize( Format format )
+{
+	return ( format == Format::BC1 || format == Format::BC4 ) ? 8 : 16;
+}
+
+size_t BcEncoder::GetImageSize( Format format, uint32_t width, uint32_t height )
+{
+	return size_t( ( width + 3 ) / 4 ) * size_t( ( height + 3 ) / 4 ) * GetBlockSize( format );
+}
+
+void BcEncoder::EncodeBlockRow( const unsigned char *rgba, uint32_t width, uint32_t height, uint32_t blockRow, Format format, Quality quality, unsigned char *dst )
+{
+	const uint32_t blocksX = ( width + 3 ) / 4;
+	const size_t blockSize = GetBlockSize( format );
+
+	BlockTexels texels;
+
+	for ( uint32_t blockX = 0; blockX < blocksX; ++blockX, dst += blockSize )
+	{
+		LoadBlock( rgba, width, height, blockX, blockRow, texels );
+
+		switch ( format )
+		{
+		case Format::BC1:
+			EncodeColorBlock( texels, quality, dst );
+			break;
+		case Format::BC3:
+			EncodeChannelBlock( texels, 3, quality, dst );
+			EncodeColorBlock( texels, quality, dst + 8 );
+			break;
+		case Format::BC4:
+			EncodeChannelBlock( texels, 0, quality, dst );
+			break;
+		case Format::BC5:
+			EncodeChannelBlock( texels, 0, quality, dst );
+			EncodeChannelBlock( texels, 1, quality, dst + 8 );
+			break;
+		case Format::BC7:
+			EncodeBc7Block( texels, quality, dst );
+			break;
+		}
+	}
+}
+
+void BcEncoder::EncodeImage( const unsigned char *rgba, uint32_t width, uint32_t height, Format format, Quality quality, unsigned char *dst )
+{
+	const uint32_t blocksY = ( height + 3 ) / 4;
+	const size_t rowSize = size_t( ( width + 3 ) / 4 ) * GetBlockSize( format );
+	const size_t threadCount = std::max< size_t >( std::thread::hardware_concurrency(), 1 );
+
+	Thread::ParallelFor( blocksY, threadCount, [ & ]( size_t blockRow )
+	{
+		EncodeBlockRow( rgba, width, height, static_cast< uint32_t >( blockRow ), format, quality, dst + blockRow * rowSize );
+	} );
+}
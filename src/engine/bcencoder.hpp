@@ -0,0 +1,42 @@
+#ifndef BCENCODER_HPP
+#define BCENCODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+// CPU block compression for cooked textures. Every format works on 4x4 blocks of RGBA8 input, blocks that hang
+// over the edge of the image repeat the last row and column
+namespace BcEncoder
+{
+	enum class Format
+	{
+		BC1, // Opaque color, 8 bytes per block
+		BC3, // Color plus a BC4 alpha block, 16 bytes per block
+		BC4, // Red only, 8 bytes per block, single channel masks
+		BC5, // Two BC4 blocks for red and green, normal maps
+		BC7  // Mode 6 only, RGBA with 7 bit endpoints and 4 bit indices, 16 bytes per block
+	};
+
+	enum class Quality
+	{
+		Fast,   // Bounding box endpoints
+		Normal, // Principal axis endpoints
+		High    // Principal axis plus least squares refinement of the endpoints
+	};
+
+	VkFormat GetVkFormat( Format format );
+	size_t GetBlockSize( Format format );
+
+	// Bytes needed for a whole image
+	size_t GetImageSize( Format format, uint32_t width, uint32_t height );
+
+	// Encodes one row of blocks, 'dst' points at the start of that row's blocks
+	void EncodeBlockRow( const unsigned char *rgba, uint32_t width, uint32_t height, uint32_t blockRow, Format format, Quality quality, unsigned char *dst );
+
+	// Encodes a whole image, spread over block rows on every core
+	void EncodeImage( const unsigned char *rgba, uint32_t width, uint32_t height, Format format, Quality quality, unsigned char *dst );
+}
+
+#endif // BCENCODER_HPP
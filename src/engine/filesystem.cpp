@@ -2,6 +2,7 @@
 #include "engine.hpp"
 #include "log.hpp"
 #include "vpk.hpp"
+#include "mappedfile.hpp"
 
 #include <fstream>
 
@@ -69,6 +70,43 @@ bool FileSystem::ReadToBuffer( const std::filesystem::path &relpath, const std::
 	return false;
 }
 
+bool FileSystem::MapFile( const std::filesystem::path &relpath, const std::string &pathid, MappedFile &mappedFile )
+{
+	FindResult findResult = FindFile( relpath, pathid );
+
+	if ( findResult )
+	{
+		if ( findResult.mountFindResult )
+		{
+			std::vector< char > buffer;
+			if ( !findResult.searchPath->mount->ReadToBuffer( buffer, findResult.mountFindResult.index ) )
+				return false;
+
+			mappedFile.Assign( std::move( buffer ) );
+			return true;
+		}
+		else
+		{
+			const std::filesystem::path abspath = findResult.searchPath->abspath / relpath;
+
+			if ( mappedFile.Map( abspath ) )
+				return true;
+
+			// Mapping isn't available everywhere, reading it in works wherever ReadToBuffer does
+			Log::PrintlnWarn( "[FileSystem]Failed to map {}, reading it instead", abspath.string() );
+
+			std::vector< char > buffer;
+			if ( !ReadToBuffer( relpath, pathid, buffer ) )
+				return false;
+
+			mappedFile.Assign( std::move( buffer ) );
+			return true;
+		}
+	}
+
+	return false;
+}
+
 bool FileSystem::Exists( const std::filesystem::path &relpath ) const
 {
 	return ( bool )FindFile( relpath, "" );
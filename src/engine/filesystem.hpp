@@ -14,6 +14,7 @@
 #include <limits>
 
 class Mount;
+class MappedFile;
 
 struct MountFileHandle
 {
@@ -67,6 +68,9 @@ public:
 
 	// Reads the entire contents of a file to a buffer, returns false on failure and 'buffer' will be emptied
 	bool ReadToBuffer( const std::filesystem::path &relpath, const std::string &pathid, std::vector< char > &buffer );
+
+	// Maps a file into memory, files inside mounts are read into 'mappedFile' instead, returns false on failure
+	bool MapFile( const std::filesystem::path &relpath, const std::string &pathid, MappedFile &mappedFile );
 	
 	// Cheks if a file exists in our filesystem given a relative path
 	bool Exists( const std::filesystem::path &relpath ) const;
@@ -0,0 +1,352 @@
+#include "geometryarena.hpp"
+#include "vulkansystem.hpp"
+#include "uploadmanager.hpp"
+#include "engine.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <limits>
+
+// Frames between compactions, each one moves at most one block
+static constexpr uint64_t CompactInterval = 60;
+
+// A replaced buffer can still be read by every frame in flight
+static constexpr uint64_t RetireFrames = MAX_FRAMES_IN_FLIGHT + 1;
+
+GeometryArena::GeometryArena( Engine *engine, VulkanSystem *vulkanSystem ) :
+	engine( engine ),
+	vulkanSystem( vulkanSystem )
+{
+}
+
+GeometryArena::~GeometryArena()
+{
+	// Frames in flight may still read the replaced buffers
+	if ( !retiredBuffers.empty() )
+		vulkanSystem->WaitIdle();
+
+	ReleaseRetired( true );
+
+	for ( auto pools : { &vertexPools, &indexPools } )
+	{
+		for ( auto &pool : *pools )
+		{
+			for ( auto &block : pool.second.blocks )
+				DestroyBlock( *block );
+		}
+
+		pools->clear();
+	}
+}
+
+GeometryArena::Allocation *GeometryArena::AllocateVertices( uint32_t stride, VkDeviceSize count )
+{
+	Pool &pool = vertexPools[ stride ];
+
+	if ( pool.elementSize == 0 ) {
+		pool.elementSize = stride;
+		pool.blockSize = VertexBlockSize;
+		pool.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	}
+
+	return Allocate( pool, count );
+}
+
+GeometryArena::Allocation *GeometryArena::AllocateIndices( VkIndexType indexType, VkDeviceSize count )
+{
+	const uint32_t indexSize = ( indexType == VK_INDEX_TYPE_UINT16 ) ? sizeof( uint16_t ) : sizeof( uint32_t );
+	Pool &pool = indexPools[ indexSize ];
+
+	if ( pool.elementSize == 0 ) {
+		pool.elementSize = indexSize;
+		pool.blockSize = IndexBlockSize;
+		pool.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	}
+
+	return Allocate( pool, count );
+}
+
+GeometryArena::Allocation *GeometryArena::Allocate( Pool &pool, VkDeviceSize count )
+{
+	if ( count == 0 ) {
+		return nullptr;
+	}
+
+	auto allocateFrom = [ count ]( Block &block ) -> Allocation*
+	{
+		// First fit, blocks are big and meshes get freed together with their model so this stays tidy enough
+		for ( auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it )
+		{
+			if ( it->second < count )
+				continue;
+
+			const VkDeviceSize first = it->first;
+			const VkDeviceSize remaining = it->second - count;
+
+			block.freeRanges.erase( it );
+
+			if ( remaining > 0 )
+				block.freeRanges.emplace( first + count, remaining );
+
+			auto allocation = make_unique< Allocation >();
+			allocation->buffer = block.buffer;
+			allocation->first = first;
+			allocation->count = count;
+			allocation->elementSize = block.pool->elementSize;
+			allocation->block = &block;
+
+			block.used += count;
+			return block.allocations.emplace( first, std::move( allocation ) ).first->second.get();
+		}
+
+		return nullptr;
+	};
+
+	for ( auto &block : pool.blocks )
+	{
+		if ( block->capacity - block->used < count )
+			continue;
+
+		if ( Allocation *allocation = allocateFrom( *block ) )
+			return allocation;
+	}
+
+	// Meshes bigger than a block get a block of their own
+	return allocateFrom( CreateBlock( pool, std::max( pool.blockSize / pool.elementSize, count ) ) );
+}
+
+void GeometryArena::Free( Allocation *allocation )
+{
+	if ( !allocation ) {
+		return;
+	}
+
+	Block &block = *allocation->block;
+	Pool &pool = *block.pool;
+	VkDeviceSize first = allocation->first;
+	VkDeviceSize count = allocation->count;
+
+	block.allocations.erase( first );
+	block.used -= count;
+
+	// Merge with the free ranges on either side
+	auto next = block.freeRanges.lower_bound( first );
+
+	if ( next != block.freeRanges.end() && first + count == next->first ) {
+		count += next->second;
+		next = block.freeRanges.erase( next );
+	}
+
+	if ( next != block.freeRanges.begin() )
+	{
+		auto prev = std::prev( next );
+
+		if ( prev->first + prev->second == first ) {
+			first = prev->first;
+			count += prev->second;
+			block.freeRanges.erase( prev );
+		}
+	}
+
+	block.freeRanges.emplace( first, count );
+
+	// Keep one block per pool around so loading the next model doesn't have to recreate it
+	if ( block.used == 0 && pool.blocks.size() > 1 )
+	{
+		DestroyBlock( block );
+
+		pool.blocks.erase( std::find_if( pool.blocks.begin(), pool.blocks.end(), [ &block ]( const unique_ptr< Block > &b ) { return b.get() == &block; } ) );
+	}
+}
+
+bool GeometryArena::Compact()
+{
+	++frame;
+	ReleaseRetired( false );
+
+	if ( frame < lastCompactFrame + CompactInterval ) {
+		return false;
+	}
+
+	Block *fragmented = nullptr;
+	VkDeviceSize mostWasted = 0;
+
+	for ( auto pools : { &vertexPools, &indexPools } )
+	{
+		for ( auto &pool : *pools )
+		{
+			for ( auto &block : pool.second.blocks )
+			{
+				const VkDeviceSize wasted = ( block->capacity - block->used ) * pool.second.elementSize;
+
+				if ( IsFragmented( *block ) && wasted > mostWasted ) {
+					fragmented = block.get();
+					mostWasted = wasted;
+				}
+			}
+		}
+	}
+
+	if ( !fragmented ) {
+		return false;
+	}
+
+	// The copy has to see every upload into the block, try again next frame if some haven't landed yet
+	if ( !vulkanSystem->uploadManager->IsComplete( vulkanSystem->uploadManager->Flush() ) ) {
+		return false;
+	}
+
+	CompactBlock( *fragmented );
+
+	lastCompactFrame = frame;
+	++generation;
+
+	return true;
+}
+
+GeometryArena::Block &GeometryArena::CreateBlock( Pool &pool, VkDeviceSize capacity )
+{
+	auto block = make_unique< Block >();
+	block->pool = &pool;
+	block->capacity = capacity;
+	block->freeRanges.emplace( 0, capacity );
+
+	vulkanSystem->VmaCreateBuffer( capacity * pool.elementSize, pool.usage, VMA_MEMORY_USAGE_GPU_ONLY, block->buffer, block->allocation );
+
+	pool.blocks.push_back( std::move( block ) );
+
+	return *pool.blocks.back();
+}
+
+void GeometryArena::DestroyBlock( Block &block )
+{
+	if ( block.buffer != VK_NULL_HANDLE ) {
+		vulkanSystem->VmaDestroyBuffer( block.buffer, block.allocation );
+		block.buffer = VK_NULL_HANDLE;
+		block.allocation = VK_NULL_HANDLE;
+	}
+}
+
+bool GeometryArena::IsFragmented( const Block &block ) const
+{
+	if ( block.freeRanges.size() < 2 ) {
+		return false;
+	}
+
+	VkDeviceSize largest = 0;
+
+	for ( const auto &range : block.freeRanges )
+		largest = std::max( largest, range.second );
+
+	// Worth moving things around once a quarter of the block is free but stuck outside the biggest hole
+	return ( block.capacity - block.used - largest ) > block.capacity / 4;
+}
+
+void GeometryArena::CompactBlock( Block &block )
+{
+	const VkDeviceSize elementSize = block.pool->elementSize;
+
+	// Copy into a fresh buffer instead of sliding ranges down in place, vkCmdCopyBuffer doesn't allow overlap
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VmaAllocation allocation = VK_NULL_HANDLE;
+	vulkanSystem->VmaCreateBuffer( block.capacity * elementSize, block.pool->usage, VMA_MEMORY_USAGE_GPU_ONLY, buffer, allocation );
+
+	std::vector< VkBufferCopy > regions;
+	regions.reserve( block.allocations.size() );
+
+	std::map< VkDeviceSize, unique_ptr< Allocation > > packed;
+	VkDeviceSize next = 0;
+
+	for ( auto &entry : block.allocations )
+	{
+		Allocation &alloc = *entry.second;
+
+		regions.push_back( VkBufferCopy { alloc.first * elementSize, next * elementSize, alloc.count * elementSize } );
+
+		alloc.buffer = buffer;
+		alloc.first = next;
+		next += alloc.count;
+
+		packed.emplace( alloc.first, std::move( entry.second ) );
+	}
+
+	RetiredBuffer retired;
+	retired.buffer = block.buffer;
+	retired.allocation = block.allocation;
+	retired.frame = frame;
+
+	// Frames in flight only read the old buffer, so the copy doesn't have to wait for them. Submitted without
+	// waiting, the barrier makes the copy visible to every later submission on the graphics queue
+	if ( !regions.empty() )
+	{
+		retired.commandBuffer = vulkanSystem->BeginSingleTimeCommands();
+		vkCmdCopyBuffer( retired.commandBuffer, block.buffer, buffer, static_cast< uint32_t >( regions.size() ), regions.data() );
+
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+		vkCmdPipelineBarrier( retired.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr );
+
+		if ( vkEndCommandBuffer( retired.commandBuffer ) != VK_SUCCESS ) {
+			engine->Error( "[Vulkan]Failed to record geometry compaction" );
+		}
+
+		VkFenceCreateInfo fenceInfo = {};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		if ( vkCreateFence( vulkanSystem->device, &fenceInfo, nullptr, &retired.fence ) != VK_SUCCESS ) {
+			engine->Error( "[Vulkan]Failed to create geometry compaction fence" );
+		}
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &retired.commandBuffer;
+
+		std::lock_guard< std::mutex > lock( vulkanSystem->graphicsQueueMutex );
+
+		if ( vkQueueSubmit( vulkanSystem->graphicsQueue, 1, &submitInfo, retired.fence ) != VK_SUCCESS ) {
+			engine->Error( "[Vulkan]Failed to submit geometry compaction" );
+		}
+	}
+
+	Log::Println( "[Vulkan]Compacted geometry block: {} free ranges, {} KB free", block.freeRanges.size(), ( ( block.capacity - block.used ) * elementSize ) >> 10 );
+
+	retiredBuffers.push_back( retired );
+
+	block.buffer = buffer;
+	block.allocation = allocation;
+	block.allocations = std::move( packed );
+	block.freeRanges.clear();
+
+	if ( next < block.capacity )
+		block.freeRanges.emplace( next, block.capacity - next );
+}
+
+void GeometryArena::ReleaseRetired( bool wait )
+{
+	while ( !retiredBuffers.empty() )
+	{
+		RetiredBuffer &retired = retiredBuffers.front();
+
+		if ( !wait && retired.frame + RetireFrames > frame ) {
+			break;
+		}
+
+		if ( retired.fence != VK_NULL_HANDLE )
+		{
+			if ( wait )
+				vkWaitForFences( vulkanSystem->device, 1, &retired.fence, VK_TRUE, std::numeric_limits< uint64_t >::max() );
+			else if ( vkGetFenceStatus( vulkanSystem->device, retired.fence ) != VK_SUCCESS )
+				break;
+
+			vkDestroyFence( vulkanSystem->device, retired.fence, nullptr );
+			vkFreeCommandBuffers( vulkanSystem->device, vulkanSystem->commandPool, 1, &retired.commandBuffer );
+		}
+
+		vulkanSystem->VmaDestroyBuffer( retired.buffer, retired.allocation );
+		retiredBuffers.pop_front();
+	}
+}
@@ -0,0 +1,112 @@
+#ifndef GEOMETRYARENA_HPP
+#define GEOMETRYARENA_HPP
+
+#include "memory.hpp"
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+class Engine;
+class VulkanSystem;
+
+// Shared vertex and index buffers that meshes get ranges of, so draws of the same vertex stride can share
+// bindings and address their data with firstIndex and vertexOffset instead of owning a buffer each.
+// Vertex pools are keyed by stride, a range only ever holds vertices of one layout so layouts of the same
+// stride can share a buffer. Index pools are keyed by index size
+class GeometryArena
+{
+	struct Pool;
+	struct Block;
+
+public:
+	static constexpr VkDeviceSize VertexBlockSize = 32ull << 20;
+	static constexpr VkDeviceSize IndexBlockSize = 16ull << 20;
+
+	struct Allocation
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize first = 0; // In elements, this is vertexOffset or firstIndex when drawing
+		VkDeviceSize count = 0;
+		VkDeviceSize elementSize = 0;
+
+		VkDeviceSize GetByteOffset() const { return first * elementSize; }
+		VkDeviceSize GetByteSize() const { return count * elementSize; }
+
+	private:
+		friend class GeometryArena;
+		Block *block = nullptr;
+	};
+
+	GeometryArena( Engine *engine, VulkanSystem *vulkanSystem );
+	~GeometryArena();
+
+	// Ranges are moved by Compact, the pointers stay valid until they're freed
+	Allocation *AllocateVertices( uint32_t stride, VkDeviceSize count );
+	Allocation *AllocateIndices( VkIndexType indexType, VkDeviceSize count );
+	void Free( Allocation *allocation );
+
+	// Called once a frame. Every CompactInterval frames repacks the most fragmented block into a new buffer, the old
+	// one is destroyed once no frame in flight can read it. Returns true if anything moved, command buffers recorded
+	// before then are stale
+	bool Compact();
+
+	// Bumped every time Compact moves something
+	uint64_t GetGeneration() const { return generation; }
+
+private:
+	struct Block
+	{
+		Pool *pool = nullptr;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		VkDeviceSize capacity = 0; // In elements
+		VkDeviceSize used = 0;
+
+		std::map< VkDeviceSize, VkDeviceSize > freeRanges; // first -> count, neighbours are always merged
+		std::map< VkDeviceSize, unique_ptr< Allocation > > allocations; // first -> allocation
+	};
+
+	struct Pool
+	{
+		VkDeviceSize elementSize = 0;
+		VkDeviceSize blockSize = 0; // In bytes
+		VkBufferUsageFlags usage = 0;
+		std::vector< unique_ptr< Block > > blocks;
+	};
+
+	Allocation *Allocate( Pool &pool, VkDeviceSize count );
+	Block &CreateBlock( Pool &pool, VkDeviceSize capacity );
+	void DestroyBlock( Block &block );
+	bool IsFragmented( const Block &block ) const;
+	void CompactBlock( Block &block );
+
+	// A buffer replaced by CompactBlock and the copy out of it
+	struct RetiredBuffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		uint64_t frame = 0;
+	};
+
+	void ReleaseRetired( bool wait );
+
+	Engine *engine = nullptr;
+	VulkanSystem *vulkanSystem = nullptr;
+
+	std::deque< RetiredBuffer > retiredBuffers;
+	uint64_t frame = 0;
+	uint64_t lastCompactFrame = 0;
+
+	std::map< uint32_t, Pool > vertexPools;
+	std::map< uint32_t, Pool > indexPools;
+
+	uint64_t generation = 0;
+};
+
+#endif // GEOMETRYARENA_HPP
@@ -0,0 +1,586 @@
+#include "glbparser.hpp"
+#include "meshoptimizer.hpp"
+
+#include "nlohmann/json.hpp"
+#include "fmt/format.h"
+#include "glm/gtc/matrix_inverse.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+#include <cstring>
+
+namespace
+{
+	using json = nlohmann::json;
+
+	constexpr uint32_t GlbMagic = 0x46546C67; // "glTF"
+	constexpr uint32_t GlbVersion = 2;
+	constexpr uint32_t ChunkTypeJSON = 0x4E4F534A;
+	constexpr uint32_t ChunkTypeBIN = 0x004E4942;
+
+	constexpr uint32_t PrimitiveModeTriangles = 4;
+	constexpr size_t MaxNodeDepth = 64;
+
+	enum ComponentType : uint32_t
+	{
+		Byte = 5120,
+		UnsignedByte = 5121,
+		Short = 5122,
+		UnsignedShort = 5123,
+		UnsignedInt = 5125,
+		Float = 5126
+	};
+
+	size_t GetComponentSize( uint32_t componentType )
+	{
+		switch ( componentType )
+		{
+			case Byte:
+			case UnsignedByte:
+				return 1;
+			case Short:
+			case UnsignedShort:
+				return 2;
+			case UnsignedInt:
+			case Float:
+				return 4;
+			default:
+				return 0;
+		}
+	}
+
+	size_t GetComponentCount( const std::string &type )
+	{
+		if ( type == "SCALAR" ) return 1;
+		if ( type == "VEC2" ) return 2;
+		if ( type == "VEC3" ) return 3;
+		if ( type == "VEC4" ) return 4;
+
+		return 0;
+	}
+
+	// Where an accessor's elements live inside the BIN chunk
+	struct Accessor
+	{
+		const uint8_t *data = nullptr;
+		size_t count = 0;
+		size_t stride = 0;
+		size_t components = 0;
+		uint32_t componentType = 0;
+		bool normalized = false;
+	};
+
+	struct Document
+	{
+		const json &gltf;
+		const uint8_t *bin;
+		size_t binSize;
+		GlbParser::Stats &stats;
+		std::string &error;
+	};
+
+	bool GetAccessor( const Document &document, size_t index, Accessor &accessor )
+	{
+		const json &accessors = document.gltf.at( "accessors" );
+
+		if ( index >= accessors.size() )
+		{
+			document.error = fmt::format( "accessor {} doesn't exist", index );
+			return false;
+		}
+
+		const json &desc = accessors[ index ];
+
+		if ( desc.contains( "sparse" ) || !desc.contains( "bufferView" ) )
+		{
+			document.error = fmt::format( "accessor {} is sparse or has no buffer view", index );
+			return false;
+		}
+
+		const json &bufferView = document.gltf.at( "bufferViews" ).at( desc.at( "bufferView" ).get< size_t >() );
+
+		if ( bufferView.value( "buffer", size_t( 0 ) ) != 0 )
+		{
+			document.error = "only the GLB's own BIN chunk is supported as a buffer";
+			return false;
+		}
+
+		accessor.componentType = desc.at( "componentType" ).get< uint32_t >();
+		accessor.components = GetComponentCount( desc.at( "type" ).get< std::string >() );
+		accessor.count = desc.at( "count" ).get< size_t >();
+		accessor.normalized = desc.value( "normalized", false );
+
+		const size_t elementSize = GetComponentSize( accessor.componentType ) * accessor.components;
+		if ( elementSize == 0 )
+		{
+			document.error = fmt::format( "accessor {} has an unsupported type", index );
+			return false;
+		}
+
+		accessor.stride = bufferView.value( "byteStride", size_t( 0 ) );
+		if ( accessor.stride == 0 )
+			accessor.stride = elementSize;
+
+		const size_t viewOffset = bufferView.value( "byteOffset", size_t( 0 ) );
+		const size_t viewLength = bufferView.at( "byteLength" ).get< size_t >();
+		const size_t offset = desc.value( "byteOffset", size_t( 0 ) );
+
+		if ( viewOffset + viewLength > document.binSize || ( accessor.count > 0 && offset + accessor.stride * ( accessor.count - 1 ) + elementSize > viewLength ) )
+		{
+			document.error = fmt::format( "accessor {} is out of bounds", index );
+			return false;
+		}
+
+		accessor.data = document.bin + viewOffset + offset;
+		return true;
+	}
+
+	float ReadComponent( const uint8_t *data, uint32_t componentType, bool normalized )
+	{
+		switch ( componentType )
+		{
+			case Float:
+			{
+				float value;
+				std::memcpy( &value, data, sizeof( value ) );
+				return value;
+			}
+			case UnsignedByte:
+				return normalized ? data[ 0 ] / 255.0f : data[ 0 ];
+			case Byte:
+			{
+				const int8_t value = static_cast< int8_t >( data[ 0 ] );
+				return normalized ? std::max( value / 127.0f, -1.0f ) : value;
+			}
+			case UnsignedShort:
+			{
+				uint16_t value;
+				std::memcpy( &value, data, sizeof( value ) );
+				return normalized ? value / 65535.0f : value;
+			}
+			case Short:
+			{
+				int16_t value;
+				std::memcpy( &value, data, sizeof( value ) );
+				return normalized ? std::max( value / 32767.0f, -1.0f ) : value;
+			}
+			case UnsignedInt:
+			{
+				uint32_t value;
+				std::memcpy( &value, data, sizeof( value ) );
+				return static_cast< float >( value );
+			}
+			default:
+				return 0.0f;
+		}
+	}
+
+	// Calls func( i, value ) for every element, float data is copied out of the mapped
+	// chunk as is and anything else (quantized or normalized) gets converted per component
+	template < int N, typename Func >
+	void ForEachElement( const Document &document, const Accessor &accessor, Func &&func )
+	{
+		if ( accessor.componentType == Float && accessor.components >= N )
+		{
+			++document.stats.directCopies;
+
+			for ( size_t i = 0; i < accessor.count; ++i )
+			{
+				glm::vec< N, float > value;
+				std::memcpy( glm::value_ptr( value ), accessor.data + i * accessor.stride, sizeof( float ) * N );
+				func( i, value );
+			}
+		}
+		else
+		{
+			++document.stats.convertedCopies;
+
+			const size_t componentSize = GetComponentSize( accessor.componentType );
+			const size_t components = std::min< size_t >( accessor.components, N );
+
+			for ( size_t i = 0; i < accessor.count; ++i )
+			{
+				glm::vec< N, float > value( 0.0f );
+				const uint8_t *element = accessor.data + i * accessor.stride;
+
+				for ( size_t c = 0; c < components; ++c )
+					value[ static_cast< int >( c ) ] = ReadComponent( element + c * componentSize, accessor.componentType, accessor.normalized );
+
+				func( i, value );
+			}
+		}
+	}
+
+	glm::mat4 GetLocalTransform( const json &node )
+	{
+		if ( auto matrix = node.find( "matrix" ); matrix != node.end() )
+		{
+			const std::vector< float > values = matrix->get< std::vector< float > >();
+			return ( values.size() == 16 ) ? glm::make_mat4( values.data() ) : glm::mat4( 1.0f );
+		}
+
+		glm::mat4 transform( 1.0f );
+
+		if ( auto translation = node.find( "translation" ); translation != node.end() )
+			transform[ 3 ] = glm::vec4( ( *translation )[ 0 ].get< float >(), ( *translation )[ 1 ].get< float >(), ( *translation )[ 2 ].get< float >(), 1.0f );
+
+		if ( auto rotation = node.find( "rotation" ); rotation != node.end() )
+		{
+			// glTF stores x, y, z, w
+			const glm::quat q( ( *rotation )[ 3 ].get< float >(), ( *rotation )[ 0 ].get< float >(), ( *rotation )[ 1 ].get< float >(), ( *rotation )[ 2 ].get< float >() );
+			transform = transform * glm::mat4_cast( q );
+		}
+
+		if ( auto scale = node.find( "scale" ); scale != node.end() )
+			transform = glm::scale( transform, glm::vec3( ( *scale )[ 0 ].get< float >(), ( *scale )[ 1 ].get< float >(), ( *scale )[ 2 ].get< float >() ) );
+
+		return transform;
+	}
+
+	bool AddPrimitive( const Document &document, const json &primitive, const glm::mat4 &transform, std::vector< ParsedMesh > &meshes )
+	{
+		if ( primitive.value( "mode", PrimitiveModeTriangles ) != PrimitiveModeTriangles )
+			return true;
+
+		const json &attributes = primitive.at( "attributes" );
+		if ( !attributes.contains( "POSITION" ) )
+			return true;
+
+		ParsedMesh mesh;
+
+		// Assimp names material-less primitives DefaultMaterial, keep doing the same
+		mesh.material = "DefaultMaterial";
+		if ( auto material = primitive.find( "material" ); material != primitive.end() )
+			mesh.material = document.gltf.at( "materials" ).at( material->get< size_t >() ).value( "name", std::string() );
+
+		const glm::mat3 normalTransform = glm::inverseTranspose( glm::mat3( transform ) );
+		const bool flipWinding = glm::determinant( glm::mat3( transform ) ) < 0.0f;
+
+		// Engine space is glTF's +y up space rotated half a turn about x, the same flips our Assimp import does
+		Accessor accessor;
+		if ( !GetAccessor( document, attributes.at( "POSITION" ).get< size_t >(), accessor ) )
+			return false;
+
+		mesh.attributes.resize( accessor.count );
+
+		ForEachElement< 3 >( document, accessor, [ & ]( size_t i, const glm::vec3 &value )
+		{
+			const glm::vec3 position = transform * glm::vec4( value, 1.0f );
+			mesh.attributes[ i ].position = { position.x, -position.y, -position.z };
+		} );
+
+		auto getAttribute = [ & ]( const char *name, Accessor &attributeAccessor )
+		{
+			auto it = attributes.find( name );
+			if ( it == attributes.end() )
+				return false;
+
+			if ( !GetAccessor( document, it->get< size_t >(), attributeAccessor ) )
+				return false;
+
+			if ( attributeAccessor.count != mesh.attributes.size() )
+			{
+				document.error = fmt::format( "{} has a different vertex count than POSITION", name );
+				return false;
+			}
+
+			return true;
+		};
+
+		const bool hasNormals = getAttribute( "NORMAL", accessor );
+		if ( hasNormals )
+		{
+			ForEachElement< 3 >( document, accessor, [ & ]( size_t i, const glm::vec3 &value )
+			{
+				const glm::vec3 normal = glm::normalize( normalTransform * value );
+				mesh.attributes[ i ].normal = { normal.x, normal.y, -normal.z };
+			} );
+		}
+
+		const bool hasUVs = getAttribute( "TEXCOORD_0", accessor );
+		if ( hasUVs )
+		{
+			// glTF's v runs top down, Assimp flips it to 1 - v and we negate that on import
+			ForEachElement< 2 >( document, accessor, [ & ]( size_t i, const glm::vec2 &value )
+			{
+				mesh.attributes[ i ].uv = { value.x, value.y - 1.0f };
+			} );
+		}
+
+		if ( getAttribute( "COLOR_0", accessor ) )
+		{
+			if ( accessor.components == 3 )
+				ForEachElement< 3 >( document, accessor, [ & ]( size_t i, const glm::vec3 &value ) { mesh.attributes[ i ].color = glm::vec4( value, 1.0f ); } );
+			else
+				ForEachElement< 4 >( document, accessor, [ & ]( size_t i, const glm::vec4 &value ) { mesh.attributes[ i ].color = value; } );
+		}
+
+		const bool hasTangents = hasNormals && getAttribute( "TANGENT", accessor );
+		if ( hasTangents )
+		{
+			ForEachElement< 4 >( document, accessor, [ & ]( size_t i, const glm::vec4 &value )
+			{
+				VertexAttributes &attrib = mesh.attributes[ i ];
+
+				const glm::vec3 normal = { attrib.normal.x, attrib.normal.y, -attrib.normal.z };
+				const glm::vec3 tangent = glm::normalize( glm::mat3( transform ) * glm::vec3( value ) );
+				const glm::vec3 bitangent = glm::cross( normal, tangent ) * ( ( value.w < 0.0f ) ? -1.0f : 1.0f );
+
+				attrib.tangent = { tangent.x, -tangent.y, -tangent.z };
+				attrib.bitangent = { -bitangent.x, bitangent.y, bitangent.z };
+			} );
+		}
+
+		if ( !document.error.empty() )
+			return false;
+
+		if ( auto indices = primitive.find( "indices" ); indices != primitive.end() )
+		{
+			if ( !GetAccessor( document, indices->get< size_t >(), accessor ) )
+				return false;
+
+			if ( accessor.components != 1 || ( accessor.componentType != UnsignedByte && accessor.componentType != UnsignedShort && accessor.componentType != UnsignedInt ) )
+			{
+				document.error = "indices must be unsigned scalars";
+				return false;
+			}
+
+			mesh.indices.resize( accessor.count );
+
+			for ( size_t i = 0; i < accessor.count; ++i )
+			{
+				const uint8_t *element = accessor.data + i * accessor.stride;
+
+				if ( accessor.componentType == UnsignedByte )
+				{
+					mesh.indices[ i ] = element[ 0 ];
+				}
+				else if ( accessor.componentType == UnsignedShort )
+				{
+					uint16_t index;
+					std::memcpy( &index, element, sizeof( index ) );
+					mesh.indices[ i ] = index;
+				}
+				else
+				{
+					std::memcpy( &mesh.indices[ i ], element, sizeof( uint32_t ) );
+				}
+
+				if ( mesh.indices[ i ] >= mesh.attributes.size() )
+				{
+					document.error = "index out of range";
+					return false;
+				}
+			}
+		}
+		else
+		{
+			mesh.indices.resize( mesh.attributes.size() );
+			for ( size_t i = 0; i < mesh.indices.size(); ++i )
+				mesh.indices[ i ] = static_cast< uint32_t >( i );
+		}
+
+		mesh.indices.resize( mesh.indices.size() - mesh.indices.size() % 3 );
+
+		if ( flipWinding )
+		{
+			for ( size_t i = 0; i < mesh.indices.size(); i += 3 )
+				std::swap( mesh.indices[ i + 1 ], mesh.indices[ i + 2 ] );
+		}
+
+		// Without normals the spec asks for flat shading, which needs every triangle to have its own vertices
+		if ( !hasNormals )
+		{
+			std::vector< VertexAttributes > flatAttributes( mesh.indices.size() );
+
+			for ( size_t i = 0; i < mesh.indices.size(); i += 3 )
+			{
+				for ( size_t k = 0; k < 3; ++k )
+					flatAttributes[ i + k ] = mesh.attributes[ mesh.indices[ i + k ] ];
+
+				const glm::vec3 cross = glm::cross( flatAttributes[ i + 1 ].position - flatAttributes[ i ].position, flatAttributes[ i + 2 ].position - flatAttributes[ i ].position );
+				const float length = glm::length( cross );
+				const glm::vec3 normal = ( length > 0.0f ) ? cross / length : cross;
+
+				for ( size_t k = 0; k < 3; ++k )
+				{
+					flatAttributes[ i + k ].normal = { normal.x, -normal.y, normal.z };
+					mesh.indices[ i + k ] = static_cast< uint32_t >( i + k );
+				}
+			}
+
+			mesh.attributes = std::move( flatAttributes );
+		}
+
+		if ( hasUVs && !hasTangents )
+			MeshOptimizer::ComputeTangents( mesh.attributes, mesh.indices );
+
+		meshes.push_back( std::move( mesh ) );
+		return true;
+	}
+
+	bool AddNode( const Document &document, size_t nodeIndex, const glm::mat4 &parentTransform, size_t depth, std::vector< ParsedMesh > &meshes )
+	{
+		const json &nodes = document.gltf.at( "nodes" );
+
+		if ( nodeIndex >= nodes.size() || depth > MaxNodeDepth )
+		{
+			document.error = fmt::format( "node {} doesn't exist or the hierarchy is cyclic", nodeIndex );
+			return false;
+		}
+
+		const json &node = nodes[ nodeIndex ];
+		const glm::mat4 transform = parentTransform * GetLocalTransform( node );
+
+		if ( auto mesh = node.find( "mesh" ); mesh != node.end() )
+		{
+			++document.stats.instances;
+
+			for ( const json &primitive : document.gltf.at( "meshes" ).at( mesh->get< size_t >() ).at( "primitives" ) )
+			{
+				++document.stats.primitives;
+
+				if ( !AddPrimitive( document, primitive, transform, meshes ) )
+					return false;
+			}
+		}
+
+		if ( auto children = node.find( "children" ); children != node.end() )
+		{
+			for ( const json &child : *children )
+			{
+				if ( !AddNode( document, child.get< size_t >(), transform, depth + 1, meshes ) )
+					return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+bool GlbParser::Parse( const char *data, size_t size, std::vector< ParsedMesh > &meshes, std::string &error, Stats *stats )
+{
+	meshes.clear();
+
+	const uint8_t *bytes = reinterpret_cast< const uint8_t* >( data );
+
+	auto readU32 = [ bytes ]( size_t offset )
+	{
+		uint32_t value;
+		std::memcpy( &value, bytes + offset, sizeof( value ) );
+		return value;
+	};
+
+	if ( size < 20 || readU32( 0 ) != GlbMagic || readU32( 4 ) != GlbVersion || readU32( 8 ) > size )
+	{
+		error = "not a glTF 2.0 binary";
+		return false;
+	}
+
+	const size_t fileLength = readU32( 8 );
+	const size_t jsonLength = readU32( 12 );
+
+	if ( readU32( 16 ) != ChunkTypeJSON || 20 + jsonLength > fileLength )
+	{
+		error = "missing JSON chunk";
+		return false;
+	}
+
+	const uint8_t *bin = nullptr;
+	size_t binSize = 0;
+
+	const size_t binHeader = 20 + jsonLength;
+	if ( binHeader + 8 <= fileLength && readU32( binHeader + 4 ) == ChunkTypeBIN )
+	{
+		binSize = readU32( binHeader );
+		bin = bytes + binHeader + 8;
+
+		if ( binHeader + 8 + binSize > fileLength )
+		{
+			error = "BIN chunk is truncated";
+			return false;
+		}
+	}
+
+	Stats localStats;
+	if ( !stats )
+		stats = &localStats;
+
+	*stats = {};
+
+	try
+	{
+		const json gltf = json::parse( data + 20, data + 20 + jsonLength );
+
+		if ( auto required = gltf.find( "extensionsRequired" ); required != gltf.end() )
+		{
+			for ( const json &extension : *required )
+			{
+				// Quantized attributes are just normalized integer accessors, which we convert anyway
+				if ( extension.get< std::string >() != "KHR_mesh_quantization" )
+				{
+					error = fmt::format( "required extension {} isn't supported", extension.get< std::string >() );
+					return false;
+				}
+			}
+		}
+
+		if ( auto buffers = gltf.find( "buffers" ); buffers != gltf.end() && ( buffers->size() > 1 || ( !buffers->empty() && ( *buffers )[ 0 ].contains( "uri" ) ) ) )
+		{
+			error = "external buffers aren't supported";
+			return false;
+		}
+
+		if ( !gltf.contains( "nodes" ) || !gltf.contains( "meshes" ) )
+			return true;
+
+		Document document = { gltf, bin, binSize, *stats, error };
+
+		std::vector< size_t > rootNodes;
+
+		if ( auto scenes = gltf.find( "scenes" ); scenes != gltf.end() && !scenes->empty() )
+		{
+			const json &scene = scenes->at( gltf.value( "scene", size_t( 0 ) ) );
+			rootNodes = scene.value( "nodes", std::vector< size_t >() );
+		}
+		else
+		{
+			// No scene, every node that isn't somebody's child is a root
+			const json &nodes = gltf.at( "nodes" );
+			std::vector< bool > isChild( nodes.size(), false );
+
+			for ( const json &node : nodes )
+			{
+				for ( size_t child : node.value( "children", std::vector< size_t >() ) )
+				{
+					if ( child < isChild.size() )
+						isChild[ child ] = true;
+				}
+			}
+
+			for ( size_t i = 0; i < nodes.size(); ++i )
+			{
+				if ( !isChild[ i ] )
+					rootNodes.push_back( i );
+			}
+		}
+
+		for ( size_t node : rootNodes )
+		{
+			if ( !AddNode( document, node, glm::mat4( 1.0f ), 0, meshes ) )
+			{
+				meshes.clear();
+				return false;
+			}
+		}
+	}
+	catch ( const json::exception &e )
+	{
+		error = e.what();
+		meshes.clear();
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,27 @@
+#ifndef GLBPARSER_HPP
+#define GLBPARSER_HPP
+
+#include "parsedmesh.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Native binary glTF importer, accessors are read straight out of the BIN chunk where the file is mapped
+namespace GlbParser
+{
+	struct Stats
+	{
+		size_t primitives = 0;
+		size_t instances = 0;
+		size_t directCopies = 0; // Accessors that were tightly packed floats and got copied without conversion
+		size_t convertedCopies = 0;
+	};
+
+	// Parses a .glb into one mesh per node and primitive with the node's transform baked in.
+	// Returns false and describes the problem in 'error' for malformed files and features we don't
+	// handle (external or sparse buffers, compression extensions), so the caller can fall back to Assimp
+	bool Parse( const char *data, size_t size, std::vector< ParsedMesh > &meshes, std::string &error, Stats *stats = nullptr );
+}
+
+#endif // GLBPARSER_HPP
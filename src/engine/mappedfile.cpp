@@ -0,0 +1,115 @@
+#include "mappedfile.hpp"
+
+#if defined( _WIN32 )
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Map( const std::filesystem::path &abspath )
+{
+	Close();
+
+#if defined( _WIN32 )
+	HANDLE file = CreateFileW( abspath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+	if ( file == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	if ( !GetFileSizeEx( file, &fileSize ) )
+	{
+		CloseHandle( file );
+		return false;
+	}
+
+	// Zero length mappings aren't allowed
+	if ( fileSize.QuadPart == 0 )
+	{
+		CloseHandle( file );
+		open = true;
+		return true;
+	}
+
+	HANDLE mapping = CreateFileMappingW( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	CloseHandle( file );
+
+	if ( !mapping )
+		return false;
+
+	// The view keeps the mapping alive
+	view = static_cast< const char* >( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+	CloseHandle( mapping );
+
+	if ( !view )
+		return false;
+
+	viewSize = static_cast< std::size_t >( fileSize.QuadPart );
+#else
+	const int fd = ::open( abspath.c_str(), O_RDONLY );
+	if ( fd == -1 )
+		return false;
+
+	struct stat st = {};
+	if ( fstat( fd, &st ) != 0 )
+	{
+		close( fd );
+		return false;
+	}
+
+	// Zero length mappings aren't allowed
+	if ( st.st_size == 0 )
+	{
+		close( fd );
+		open = true;
+		return true;
+	}
+
+	void *address = mmap( nullptr, static_cast< std::size_t >( st.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+
+	if ( address == MAP_FAILED )
+		return false;
+
+	posix_madvise( address, static_cast< std::size_t >( st.st_size ), POSIX_MADV_WILLNEED );
+
+	view = static_cast< const char* >( address );
+	viewSize = static_cast< std::size_t >( st.st_size );
+#endif
+
+	open = ( view != nullptr );
+	return open;
+}
+
+void MappedFile::Assign( std::vector< char > &&contents )
+{
+	Close();
+	buffer = std::move( contents );
+	open = true;
+}
+
+void MappedFile::Close()
+{
+	if ( view )
+	{
+#if defined( _WIN32 )
+		UnmapViewOfFile( view );
+#else
+		munmap( const_cast< char* >( view ), viewSize );
+#endif
+		view = nullptr;
+		viewSize = 0;
+	}
+
+	buffer.clear();
+	buffer.shrink_to_fit();
+	open = false;
+}
@@ -0,0 +1,43 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <filesystem>
+#include <vector>
+#include <cstddef>
+
+// Read-only view of a whole file, memory mapped when it lives on disk or
+// backed by an owned buffer when it comes from a mount
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile( const MappedFile& ) = delete;
+	MappedFile &operator=( const MappedFile& ) = delete;
+
+	operator bool() const { return is_open(); }
+	bool is_open() const { return open; }
+
+	// Maps the file at abspath, returns false on failure. An empty file is open with no data
+	bool Map( const std::filesystem::path &abspath );
+
+	// Takes ownership of an already read file
+	void Assign( std::vector< char > &&contents );
+
+	void Close();
+
+	const char *data() const { return view ? view : buffer.data(); }
+	std::size_t size() const { return view ? viewSize : buffer.size(); }
+
+	bool IsMapped() const { return ( view != nullptr ); }
+
+private:
+	const char *view = nullptr;
+	std::size_t viewSize = 0;
+
+	std::vector< char > buffer;
+	bool open = false;
+};
+
+#endif // MAPPEDFILE_HPP
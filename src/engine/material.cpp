@@ -13,12 +13,30 @@
 #include "shadersystem.hpp"
 #include "texturesystem.hpp"
 
+static SortIdPool materialSortIds;
+
 Material::Material( Shader *shader, const MaterialBindings &bindings ) :
 	shader( shader ),
-	bindings( bindings )
+	bindings( bindings ),
+	sortId( materialSortIds.Acquire() )
 {
 }
 
 Material::~Material()
 {
+	materialSortIds.Release( sortId );
+
+	for ( auto &sampler : samplers )
+		samplerCache->Release( sampler.second );
+}
+
+VkSampler Material::GetSampler( const std::string &identifier )
+{
+	if ( auto it = samplers.find( identifier ); it != samplers.end() )
+		return it->second;
+
+	if ( Texture *texture = GetTexture( identifier ); texture )
+		return texture->GetSampler();
+
+	return VK_NULL_HANDLE;
 }
\ No newline at end of file
@@ -80,6 +80,9 @@ public:
 
 	Shader *GetShader() const { return shader; }
 
+	// Small id handed out in creation order, groups draws by material in the render list
+	uint32_t GetSortId() const { return sortId; }
+
 public:
 
 	//void SetTexture( const std::string &identifier, const std::filesystem::path &path ) { bindings.SetTexture( identifier, path ); }
@@ -97,6 +100,9 @@ public:
 
 	//std::filesystem::path GetTexture( const std::string &identifier ) { return bindings.GetTexture( identifier ); }
 	Texture *GetTexture( const std::string &identifier ) { return textures[ identifier ]; }
+
+	// The material's sampler for a texture binding if it overrides one, the texture's own otherwise
+	VkSampler GetSampler( const std::string &identifier );
 	glm::ivec2 GetVec2i( const std::string &identifier ) { return bindings.GetVec2i( identifier ); }
 	glm::ivec3 GetVec3i( const std::string &identifier ) { return bindings.GetVec3i( identifier ); }
 	glm::ivec4 GetVec4i( const std::string &identifier ) { return bindings.GetVec4i( identifier ); }
@@ -111,9 +117,14 @@ public:
 
 	std::unordered_map< std::string, Texture* > textures;
 
+	// Sampler state overrides from the material's "sampler" block, references are held on samplerCache
+	std::unordered_map< std::string, VkSampler > samplers;
+	SamplerCache *samplerCache = nullptr;
+
 private:
 	Shader *shader = nullptr;
 	MaterialBindings bindings;
+	const uint32_t sortId;
 };
 
 #endif // MATERIAL_HPP
\ No newline at end of file
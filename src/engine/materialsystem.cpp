@@ -10,8 +10,70 @@
 #include "glm/gtc/type_ptr.hpp"
 #include "glm/gtx/string_cast.hpp"
 
+#include <algorithm>
 #include <array>
 
+// Reads a material's sampler state override for one texture binding, e.g.
+// "sampler": { "diffuse": { "filter": "nearest", "mipmap": "linear", "address": "clamp", "anisotropy": 4, "lodbias": 0.5 } }
+// "addressu" and "addressv" set a single axis. Anything left out keeps the default from the sampler cache
+static void ParseSamplerState( const std::filesystem::path &relpath, const nlohmann::json &j, VkSamplerCreateInfo &samplerInfo )
+{
+	auto parseAddressMode = [ &relpath ]( const std::string &mode, VkSamplerAddressMode fallback )
+	{
+		if ( mode == "repeat" )
+			return VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		if ( mode == "mirror" )
+			return VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
+		if ( mode == "clamp" )
+			return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		if ( mode == "border" )
+			return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+
+		Log::PrintlnWarn( "[MaterialSystem]Unknown address mode {} in {}, expected repeat, mirror, clamp or border", mode, relpath.generic_string() );
+		return fallback;
+	};
+
+	if ( j.contains( "filter" ) )
+	{
+		const std::string filter = j[ "filter" ].get< std::string >();
+
+		if ( filter == "nearest" || filter == "linear" )
+			samplerInfo.magFilter = samplerInfo.minFilter = ( filter == "nearest" ) ? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
+		else
+			Log::PrintlnWarn( "[MaterialSystem]Unknown filter {} in {}, expected nearest or linear", filter, relpath.generic_string() );
+	}
+
+	if ( j.contains( "mipmap" ) )
+	{
+		const std::string mipmap = j[ "mipmap" ].get< std::string >();
+
+		if ( mipmap == "nearest" || mipmap == "linear" )
+			samplerInfo.mipmapMode = ( mipmap == "nearest" ) ? VK_SAMPLER_MIPMAP_MODE_NEAREST : VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		else
+			Log::PrintlnWarn( "[MaterialSystem]Unknown mipmap mode {} in {}, expected nearest or linear", mipmap, relpath.generic_string() );
+	}
+
+	if ( j.contains( "address" ) )
+		samplerInfo.addressModeU = samplerInfo.addressModeV = samplerInfo.addressModeW = parseAddressMode( j[ "address" ].get< std::string >(), samplerInfo.addressModeU );
+
+	if ( j.contains( "addressu" ) )
+		samplerInfo.addressModeU = parseAddressMode( j[ "addressu" ].get< std::string >(), samplerInfo.addressModeU );
+
+	if ( j.contains( "addressv" ) )
+		samplerInfo.addressModeV = parseAddressMode( j[ "addressv" ].get< std::string >(), samplerInfo.addressModeV );
+
+	if ( j.contains( "anisotropy" ) )
+	{
+		const float anisotropy = j[ "anisotropy" ].get< float >();
+
+		samplerInfo.anisotropyEnable = ( anisotropy > 1.0f ) ? VK_TRUE : VK_FALSE;
+		samplerInfo.maxAnisotropy = std::max( anisotropy, 1.0f );
+	}
+
+	if ( j.contains( "lodbias" ) )
+		samplerInfo.mipLodBias = j[ "lodbias" ].get< float >();
+}
+
 void MaterialSystem::configure( Engine *engine )
 {
 	EngineSystem::configure( engine );
@@ -40,6 +102,43 @@ void MaterialSystem::LoadDefaultMaterials()
 }
 
 IMaterial *MaterialSystem::LoadMaterial( const std::filesystem::path &relpath, const std::string &pathid, IResourcePool *resourcePoolPtr )
+{
+	return LoadMaterials( { relpath }, pathid, resourcePoolPtr )[ 0 ];
+}
+
+std::vector< IMaterial* > MaterialSystem::LoadMaterials( const std::vector< std::filesystem::path > &relpaths, const std::string &pathid, IResourcePool *resourcePoolPtr )
+{
+	std::vector< IMaterial* > materials( relpaths.size(), errorMaterial );
+	std::vector< TextureRequest > textureRequests;
+	std::vector< std::pair< Material*, std::string > > textureBindings;
+
+	// Parse everything first so all of the batch's textures can be decoded together
+	for ( size_t i = 0; i < relpaths.size(); ++i )
+	{
+		std::vector< std::pair< std::string, TextureRequest > > textures;
+		Material *material = ParseMaterial( relpaths[ i ], pathid, resourcePoolPtr, textures );
+
+		materials[ i ] = material;
+
+		if ( material == errorMaterial )
+			continue;
+
+		for ( auto &texture : textures )
+		{
+			textureBindings.emplace_back( material, texture.first );
+			textureRequests.push_back( std::move( texture.second ) );
+		}
+	}
+
+	const std::vector< ITexture* > textures = textureSystem->LoadTextures( textureRequests, pathid, resourcePoolPtr );
+
+	for ( size_t i = 0; i < textures.size(); ++i )
+		textureBindings[ i ].first->textures[ textureBindings[ i ].second ] = Texture::ToTexture( textures[ i ] );
+
+	return materials;
+}
+
+Material *MaterialSystem::ParseMaterial( const std::filesystem::path &relpath, const std::string &pathid, IResourcePool *resourcePoolPtr, std::vector< std::pair< std::string, TextureRequest > > &textures )
 {
 	using std::array;
 	using std::string;
@@ -250,10 +349,21 @@ IMaterial *MaterialSystem::LoadMaterial( const std::filesystem::path &relpath, c
 	auto resource = ResourcePool::createResource< Material >( ResourceInfo{ relpath.generic_string() }, shader, bindings );
 	Material *material = resource->resource.get();
 
+	// Materials with the same overrides share samplers, and with textures using the default
+	material->samplerCache = vulkanSystem->samplerCache.get();
+
+	for ( auto kv : j[ "sampler" ].items() )
+	{
+		VkSamplerCreateInfo samplerInfo = SamplerCache::GetDefaultCreateInfo();
+		ParseSamplerState( relpath, kv.value(), samplerInfo );
+
+		material->samplers[ kv.key() ] = material->samplerCache->Acquire( samplerInfo );
+	}
+
 	for ( const auto &kv : bindings.textures )
 	{
-		Texture *texture = Texture::ToTexture( textureSystem->LoadTexture( kv.second, pathid, resourcePoolPtr ) );
-		material->textures[ kv.first ] = texture;
+		const TextureUsage usage = ( kv.first == "normal" ) ? TextureUsage::Normal : TextureUsage::Color;
+		textures.emplace_back( kv.first, TextureRequest { kv.second, usage } );
 	}
 
 	materialsMutex.lock();
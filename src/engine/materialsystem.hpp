@@ -6,11 +6,11 @@
 #include "engine/imaterialsystem.hpp"
 #include "filesystem.hpp"
 #include "material.hpp"
+#include "texturesystem.hpp"
 
 #include <mutex>
 
 class ShaderSystem;
-class TextureSystem;
 
 class MaterialSystem : public IMaterialSystem, public EngineSystem
 {
@@ -24,12 +24,19 @@ public:
 	IMaterial *GetErrorMaterial() const { return errorMaterial; }
 
 	IMaterial *LoadMaterial( const std::filesystem::path &relpath, const std::string &pathid, IResourcePool *resourcePoolPtr ) override;
+
+	// Loads several materials, decoding all of their textures at once
+	std::vector< IMaterial* > LoadMaterials( const std::vector< std::filesystem::path > &relpaths, const std::string &pathid, IResourcePool *resourcePoolPtr );
+
 	IMaterial *FindMaterial( const std::filesystem::path &relpath, IResourcePool *resourcePoolPtr ) const override;
 
 private:
 
 	IMaterial *FindMaterial_Internal( const std::filesystem::path &relpath, IResourcePool *resourcePoolPtr );
 
+	// Reads a material definition and creates the material, its textures are returned to be loaded by the caller
+	Material *ParseMaterial( const std::filesystem::path &relpath, const std::string &pathid, IResourcePool *resourcePoolPtr, std::vector< std::pair< std::string, TextureRequest > > &textures );
+
 	Material *errorMaterial = nullptr;
 
 	FileSystem *fileSystem = nullptr;
@@ -9,17 +9,13 @@ Mesh::~Mesh()
 
 	destroySwapChain();
 
-	if ( IndexBuffer != VK_NULL_HANDLE ) {
-		vulkanSystem->VmaDestroyBuffer( IndexBuffer, IndexBufferAllocation );
-		IndexBuffer = VK_NULL_HANDLE;
-		IndexBufferAllocation = VK_NULL_HANDLE;
-	}	
-
-	if ( VertexBuffer != VK_NULL_HANDLE ) {
-		vulkanSystem->VmaDestroyBuffer( VertexBuffer, VertexBufferAllocation );
-		VertexBuffer = VK_NULL_HANDLE;
-		VertexBufferAllocation = VK_NULL_HANDLE;
+	if ( vulkanSystem->geometryArena ) {
+		vulkanSystem->geometryArena->Free( indexAllocation );
+		vulkanSystem->geometryArena->Free( vertexAllocation );
 	}
+
+	indexAllocation = nullptr;
+	vertexAllocation = nullptr;
 }
 
 void Mesh::Init( VulkanSystem *vulkanSystem, shared_ptr< VertexArray > vertices, shared_ptr< std::vector< uint32_t > > indices, Material *material )
@@ -46,8 +42,6 @@ void Mesh::onSwapChainResize()
 
 void Mesh::destroySwapChain()
 {
-	ubos.clear();
-
 	if ( descriptorPool != VK_NULL_HANDLE )
 	{
 		vulkanSystem->DestroyDescriptorPool( descriptorPool, nullptr );
@@ -55,6 +49,8 @@ void Mesh::destroySwapChain()
 	}
 
 	descriptorSets.clear();
+	uniformGenerations.clear();
+	dynamicOffsetCount = 0;
 }
 
 void Mesh::CreateVertexBuffer()
@@ -66,21 +62,8 @@ void Mesh::CreateVertexBuffer()
 	const VkDeviceSize bufferSize = vertices->GetVertexBufferSize();
 	vertexCount = static_cast< uint32_t >( vertices->GetVertexCount() );
 
-	VkBuffer stagingBuffer = VK_NULL_HANDLE;
-	VmaAllocation stagingBufferAllocation = VK_NULL_HANDLE;
-
-	vulkanSystem->VmaCreateBuffer( bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, stagingBuffer, stagingBufferAllocation );
-
-	void *pData = nullptr;
-
-	vulkanSystem->VmaMapMemory( stagingBufferAllocation, &pData );
-		std::memcpy( pData, vertices->GetVertexBuffer(), static_cast< size_t >( bufferSize ) );
-	vulkanSystem->VmaUnmapMemory( stagingBufferAllocation );
-
-	vulkanSystem->VmaCreateBuffer( bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, VertexBuffer, VertexBufferAllocation );
-	vulkanSystem->CopyBuffer( stagingBuffer, VertexBuffer, bufferSize );
-
-	vulkanSystem->VmaDestroyBuffer( stagingBuffer, stagingBufferAllocation );
+	vertexAllocation = vulkanSystem->geometryArena->AllocateVertices( vertices->GetLayout().GetStride(), vertexCount );
+	vulkanSystem->uploadManager->UploadBuffer( vertexAllocation->buffer, vertices->GetVertexBuffer(), bufferSize, vertexAllocation->GetByteOffset() );
 }
 
 void Mesh::CreateIndexBuffer()
@@ -89,22 +72,32 @@ void Mesh::CreateIndexBuffer()
 		return;
 	}
 
-	VkDeviceSize bufferSize = sizeof( uint32_t ) * indices->size();
 	indexCount = static_cast< uint32_t >( indices->size() );
 
-	VkBuffer stagingBuffer = VK_NULL_HANDLE;
-	VmaAllocation stagingBufferAllocation = VK_NULL_HANDLE;
+	if ( lods.empty() )
+		lods.push_back( MeshLOD { 0, indexCount, 0.0f } );
+
+	std::vector< uint16_t > shortIndices;
+	const void *indexData = indices->data();
 
-	vulkanSystem->VmaCreateBuffer( bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, stagingBuffer, stagingBufferAllocation );
+	if ( vertexCount <= std::numeric_limits< uint16_t >::max() + 1 )
+	{
+		shortIndices.resize( indices->size() );
+		for ( size_t i = 0; i < indices->size(); ++i )
+			shortIndices[ i ] = static_cast< uint16_t >( ( *indices )[ i ] );
 
-	void *pData = nullptr;
+		indexData = shortIndices.data();
+		indexType = VK_INDEX_TYPE_UINT16;
+	}
+	else
+	{
+		indexType = VK_INDEX_TYPE_UINT32;
+	}
 
-	vulkanSystem->VmaMapMemory( stagingBufferAllocation, &pData );
-		std::memcpy( pData, indices->data(), static_cast< size_t >( bufferSize ) );
-	vulkanSystem->VmaUnmapMemory( stagingBufferAllocation );
+	const VkDeviceSize bufferSize = GetIndexSize() * indices->size();
 
-	vulkanSystem->VmaCreateBuffer( bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, IndexBuffer, IndexBufferAllocation );
-	vulkanSystem->CopyBuffer( stagingBuffer, IndexBuffer, bufferSize );
+	indexAllocation = vulkanSystem->geometryArena->AllocateIndices( indexType, indexCount );
 
-	vulkanSystem->VmaDestroyBuffer( stagingBuffer, stagingBufferAllocation );
+	// The staging ring copies indexData right away, so shortIndices can go out of scope before the batch is submitted
+	vulkanSystem->uploadManager->UploadBuffer( indexAllocation->buffer, indexData, bufferSize, indexAllocation->GetByteOffset() );
 }
\ No newline at end of file
@@ -5,8 +5,10 @@
 #include "vulkansystem.hpp"
 #include "memory.hpp"
 #include "vertex.hpp"
-#include "ubo.hpp"
+#include "meshlod.hpp"
+#include "meshlet.hpp"
 
+#include <array>
 #include <vector>
 
 class Material;
@@ -27,16 +29,25 @@ public:
 	void onSwapChainResize() override;
 	void destroySwapChain();
 
-	const VkBuffer GetVertexBuffer() const { return VertexBuffer; }
-	const VkBuffer GetIndexBuffer() const { return IndexBuffer; }
+	// Buffers are shared with other meshes through the GeometryArena, draws have to add these offsets
+	const VkBuffer GetVertexBuffer() const { return vertexAllocation ? vertexAllocation->buffer : VK_NULL_HANDLE; }
+	const VkBuffer GetIndexBuffer() const { return indexAllocation ? indexAllocation->buffer : VK_NULL_HANDLE; }
+	int32_t GetVertexOffset() const { return vertexAllocation ? static_cast< int32_t >( vertexAllocation->first ) : 0; }
+	uint32_t GetFirstIndex() const { return indexAllocation ? static_cast< uint32_t >( indexAllocation->first ) : 0; }
 
 	inline size_t GetMeshIndex() const { return meshIndex; }
 
 	uint32_t GetVertexCount() const { return vertexCount; }
 	uint32_t GetIndexCount() const { return indexCount; }
 
+	// Index buffers are stored as uint16_t whenever every index fits
+	VkIndexType GetIndexType() const { return indexType; }
+	size_t GetIndexSize() const { return ( indexType == VK_INDEX_TYPE_UINT16 ) ? sizeof( uint16_t ) : sizeof( uint32_t ); }
+
 	Material *GetMaterial() const { return material; }
 
+	const std::vector< MeshLOD > &GetLODs() const { return lods; }
+
 	void CreateVertexBuffer();
 	void CreateIndexBuffer();
 
@@ -45,18 +56,31 @@ public:
 
 	uint32_t vertexCount = 0;
 	uint32_t indexCount = 0;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
 
 	Material *material = nullptr;
 
+	// Index ranges from finest to coarsest, filled in before Init, a single LOD covering every index is made otherwise
+	std::vector< MeshLOD > lods;
+
+	glm::vec3 boundsCenter = { 0.0f, 0.0f, 0.0f };
+	float boundsRadius = 0.0f;
+
+	// Clusters of LOD 0, culled individually by RenderSystem when LOD 0 is drawn
+	std::vector< Meshlet > meshlets;
+
 	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
 	std::vector< VkDescriptorSet > descriptorSets;
-	std::vector< unique_ptr< UBO > > ubos;
+	std::vector< uint64_t > textureGenerations; // TextureStreamer generation each descriptor set's textures were written at
+	std::vector< uint64_t > uniformGenerations; // UniformAllocator generation each descriptor set's uniform buffer was written at
 
-	VkBuffer VertexBuffer = VK_NULL_HANDLE;
-	VmaAllocation VertexBufferAllocation = VK_NULL_HANDLE;
+	// This frame's UniformAllocator slices in binding order, written by the shader's Update and bound with the descriptor set
+	static constexpr size_t MaxDynamicOffsets = 2;
+	std::array< uint32_t, MaxDynamicOffsets > dynamicOffsets = {};
+	uint32_t dynamicOffsetCount = 0;
 
-	VkBuffer IndexBuffer = VK_NULL_HANDLE;
-	VmaAllocation IndexBufferAllocation = VK_NULL_HANDLE;
+	GeometryArena::Allocation *vertexAllocation = nullptr;
+	GeometryArena::Allocation *indexAllocation = nullptr;
 
 protected:
 	size_t meshIndex = 0; // This will be set by MeshSystem
@@ -0,0 +1,23 @@
+#ifndef MESHLET_HPP
+#define MESHLET_HPP
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+
+// Contiguous run of a mesh's LOD 0 triangles, small enough to cull on its own
+struct Meshlet
+{
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+
+	// Bounding sphere in mesh space
+	glm::vec3 center = { 0.0f, 0.0f, 0.0f };
+	float radius = 0.0f;
+
+	// Every triangle faces away from a camera inside this cone, a cutoff of 1 means the cone is too wide to cull with
+	glm::vec3 coneAxis = { 0.0f, 0.0f, 1.0f };
+	float coneCutoff = 1.0f;
+};
+
+#endif // MESHLET_HPP
@@ -0,0 +1,15 @@
+#ifndef MESHLOD_HPP
+#define MESHLOD_HPP
+
+#include <cstdint>
+
+// Range of a mesh's index buffer drawn at a given detail level, error is the distance in mesh units
+// the simplified surface can deviate from the original
+struct MeshLOD
+{
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	float error = 0.0f;
+};
+
+#endif // MESHLOD_HPP
\ No newline at end of file
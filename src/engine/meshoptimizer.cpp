@@ -0,0 +1,811 @@
+#include "meshoptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numeric>
+#include <unordered_map>
+
+namespace
+{
+	constexpr uint32_t InvalidIndex = std::numeric_limits< uint32_t >::max();
+
+	// Hashes attribute values rather than raw bytes, aligned glm types carry uninitialized padding
+	struct VertexHash
+	{
+		size_t operator()( const VertexAttributes &vertex ) const
+		{
+			size_t hash = 0;
+			auto combine = [ &hash ]( float f ) {
+				// Adding zero folds -0.0f into 0.0f so both hash the same, matching operator==
+				hash ^= std::hash< float >()( f + 0.0f ) + 0x9e3779b9 + ( hash << 6 ) + ( hash >> 2 );
+			};
+
+			for ( int i = 0; i < 3; ++i ) combine( vertex.position[ i ] );
+			for ( int i = 0; i < 3; ++i ) combine( vertex.normal[ i ] );
+			for ( int i = 0; i < 4; ++i ) combine( vertex.color[ i ] );
+			for ( int i = 0; i < 2; ++i ) combine( vertex.uv[ i ] );
+			for ( int i = 0; i < 3; ++i ) combine( vertex.tangent[ i ] );
+			for ( int i = 0; i < 3; ++i ) combine( vertex.bitangent[ i ] );
+
+			return hash;
+		}
+	};
+
+	struct VertexEqual
+	{
+		bool operator()( const VertexAttributes &a, const VertexAttributes &b ) const
+		{
+			return a.position == b.position && a.normal == b.normal && a.color == b.color &&
+				a.uv == b.uv && a.tangent == b.tangent && a.bitangent == b.bitangent;
+		}
+	};
+
+	// Triangles touching each vertex, stored as offsets into a single flat array
+	struct Adjacency
+	{
+		Adjacency( const std::vector< uint32_t > &indices, size_t vertexCount ) :
+			counts( vertexCount, 0 ),
+			offsets( vertexCount + 1, 0 ),
+			triangles( indices.size() )
+		{
+			for ( uint32_t index : indices )
+				++counts[ index ];
+
+			for ( size_t v = 0; v < vertexCount; ++v )
+				offsets[ v + 1 ] = offsets[ v ] + counts[ v ];
+
+			std::vector< uint32_t > fill( offsets.begin(), offsets.end() - 1 );
+
+			for ( size_t i = 0; i < indices.size(); ++i )
+				triangles[ fill[ indices[ i ] ]++ ] = static_cast< uint32_t >( i / 3 );
+		}
+
+		std::vector< uint32_t > counts;
+		std::vector< uint32_t > offsets;
+		std::vector< uint32_t > triangles;
+	};
+
+	// Symmetric 4x4 error quadric, weighted so Evaluate returns a mean squared distance
+	struct Quadric
+	{
+		double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+		double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+		double c = 0.0;
+		double weight = 0.0;
+
+		static Quadric FromPlane( const glm::dvec3 &normal, double distance, double weight )
+		{
+			Quadric q;
+			q.a00 = weight * normal.x * normal.x;
+			q.a01 = weight * normal.x * normal.y;
+			q.a02 = weight * normal.x * normal.z;
+			q.a11 = weight * normal.y * normal.y;
+			q.a12 = weight * normal.y * normal.z;
+			q.a22 = weight * normal.z * normal.z;
+			q.b0 = weight * normal.x * distance;
+			q.b1 = weight * normal.y * distance;
+			q.b2 = weight * normal.z * distance;
+			q.c = weight * distance * distance;
+			q.weight = weight;
+			return q;
+		}
+
+		Quadric &operator+=( const Quadric &other )
+		{
+			a00 += other.a00; a01 += other.a01; a02 += other.a02;
+			a11 += other.a11; a12 += other.a12; a22 += other.a22;
+			b0 += other.b0; b1 += other.b1; b2 += other.b2;
+			c += other.c;
+			weight += other.weight;
+			return *this;
+		}
+
+		double Evaluate( const glm::vec3 &point ) const
+		{
+			const double x = point.x, y = point.y, z = point.z;
+			const double error =
+				a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z +
+				a11 * y * y + 2.0 * a12 * y * z + a22 * z * z +
+				2.0 * ( b0 * x + b1 * y + b2 * z ) + c;
+
+			return ( weight > 0.0 ) ? std::max( error / weight, 0.0 ) : 0.0;
+		}
+	};
+
+	enum class VertexKind : uint8_t
+	{
+		Manifold,	// Free to collapse onto any neighbour
+		Border,		// On an open edge, may only collapse along it
+		Locked		// Attribute seam, never moves
+	};
+
+	inline uint64_t EdgeKey( uint32_t a, uint32_t b ) { return ( uint64_t( a ) << 32 ) | b; }
+}
+
+size_t MeshOptimizer::WeldVertices( std::vector< VertexAttributes > &vertices, std::vector< uint32_t > &indices )
+{
+	std::unordered_map< VertexAttributes, uint32_t, VertexHash, VertexEqual > unique;
+	unique.reserve( vertices.size() );
+
+	std::vector< uint32_t > remap( vertices.size() );
+	std::vector< VertexAttributes > welded;
+	welded.reserve( vertices.size() );
+
+	for ( size_t v = 0; v < vertices.size(); ++v )
+	{
+		auto [ it, inserted ] = unique.try_emplace( vertices[ v ], static_cast< uint32_t >( welded.size() ) );
+
+		if ( inserted )
+			welded.push_back( vertices[ v ] );
+
+		remap[ v ] = it->second;
+	}
+
+	for ( uint32_t &index : indices )
+		index = remap[ index ];
+
+	vertices = std::move( welded );
+	return vertices.size();
+}
+
+void MeshOptimizer::OptimizeVertexCache( const std::vector< VertexAttributes > &vertices, std::vector< uint32_t > &indices, size_t cacheSize )
+{
+	const size_t vertexCount = vertices.size();
+	const size_t triangleCount = indices.size() / 3;
+
+	if ( triangleCount == 0 || vertexCount == 0 )
+		return;
+
+	Adjacency adjacency( indices, vertexCount );
+
+	std::vector< uint32_t > liveTriangles( adjacency.counts );
+	std::vector< uint32_t > cacheTime( vertexCount, 0 );
+	std::vector< bool > emitted( triangleCount, false );
+	std::vector< uint32_t > deadEnd;
+	std::vector< uint32_t > candidates;
+
+	std::vector< uint32_t > output;
+	output.reserve( indices.size() );
+
+	// Start of each cluster in output, a new one begins whenever we run out of cached neighbours
+	std::vector< size_t > clusters;
+
+	const uint32_t cacheSize32 = static_cast< uint32_t >( cacheSize );
+	uint32_t timeStamp = cacheSize32 + 1;
+	uint32_t cursor = 0;
+	uint32_t fanning = 0;
+
+	auto skipDeadEnd = [ & ]() -> uint32_t
+	{
+		while ( !deadEnd.empty() )
+		{
+			const uint32_t vertex = deadEnd.back();
+			deadEnd.pop_back();
+
+			if ( liveTriangles[ vertex ] > 0 )
+				return vertex;
+		}
+
+		for ( ; cursor < vertexCount; ++cursor )
+		{
+			if ( liveTriangles[ cursor ] > 0 )
+				return cursor;
+		}
+
+		return InvalidIndex;
+	};
+
+	clusters.push_back( 0 );
+
+	while ( fanning != InvalidIndex )
+	{
+		candidates.clear();
+
+		for ( uint32_t t = adjacency.offsets[ fanning ]; t < adjacency.offsets[ fanning + 1 ]; ++t )
+		{
+			const uint32_t triangle = adjacency.triangles[ t ];
+
+			if ( emitted[ triangle ] )
+				continue;
+
+			for ( size_t corner = 0; corner < 3; ++corner )
+			{
+				const uint32_t vertex = indices[ triangle * 3 + corner ];
+
+				output.push_back( vertex );
+				deadEnd.push_back( vertex );
+				candidates.push_back( vertex );
+				--liveTriangles[ vertex ];
+
+				if ( timeStamp - cacheTime[ vertex ] > cacheSize32 )
+					cacheTime[ vertex ] = timeStamp++;
+			}
+
+			emitted[ triangle ] = true;
+		}
+
+		// Pick the candidate that will still be in cache after emitting its remaining triangles
+		uint32_t next = InvalidIndex;
+		int bestPriority = -1;
+
+		for ( uint32_t vertex : candidates )
+		{
+			if ( liveTriangles[ vertex ] == 0 )
+				continue;
+
+			int priority = 0;
+			if ( timeStamp - cacheTime[ vertex ] + 2 * liveTriangles[ vertex ] <= cacheSize32 )
+				priority = static_cast< int >( timeStamp - cacheTime[ vertex ] );
+
+			if ( priority > bestPriority )
+			{
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+
+		if ( next == InvalidIndex )
+		{
+			next = skipDeadEnd();
+
+			if ( next != InvalidIndex && output.size() != clusters.back() )
+				clusters.push_back( output.size() );
+		}
+
+		fanning = next;
+	}
+
+	// Draw clusters facing away from the mesh center first, they're the least likely to be occluded
+	glm::vec3 meshCenter = { 0.0f, 0.0f, 0.0f };
+	for ( const auto &vertex : vertices )
+		meshCenter += vertex.position;
+	meshCenter /= static_cast< float >( vertexCount );
+
+	clusters.push_back( output.size() );
+	const size_t clusterCount = clusters.size() - 1;
+
+	std::vector< float > occlusionPotential( clusterCount, 0.0f );
+
+	for ( size_t c = 0; c < clusterCount; ++c )
+	{
+		glm::vec3 centroid = { 0.0f, 0.0f, 0.0f };
+		glm::vec3 normal = { 0.0f, 0.0f, 0.0f };
+		float areaSum = 0.0f;
+
+		for ( size_t i = clusters[ c ]; i < clusters[ c + 1 ]; i += 3 )
+		{
+			const glm::vec3 &p0 = vertices[ output[ i + 0 ] ].position;
+			const glm::vec3 &p1 = vertices[ output[ i + 1 ] ].position;
+			const glm::vec3 &p2 = vertices[ output[ i + 2 ] ].position;
+
+			// Area weighted, the cross product's length is twice the triangle's area
+			const glm::vec3 areaNormal = glm::cross( p1 - p0, p2 - p0 );
+			const float area = glm::length( areaNormal );
+
+			centroid += ( p0 + p1 + p2 ) * ( area / 3.0f );
+			areaSum += area;
+			normal += areaNormal;
+		}
+
+		// The summed normal only has the total area as its length when the cluster is flat
+		if ( areaSum > 0.0f && glm::dot( normal, normal ) > 0.0f )
+			occlusionPotential[ c ] = glm::dot( centroid / areaSum - meshCenter, glm::normalize( normal ) );
+	}
+
+	std::vector< size_t > order( clusterCount );
+	std::iota( order.begin(), order.end(), 0 );
+	std::stable_sort( order.begin(), order.end(), [ & ]( size_t a, size_t b ) { return occlusionPotential[ a ] > occlusionPotential[ b ]; } );
+
+	indices.clear();
+	for ( size_t c : order )
+		indices.insert( indices.end(), output.begin() + clusters[ c ], output.begin() + clusters[ c + 1 ] );
+}
+
+void MeshOptimizer::OptimizeVertexFetch( std::vector< VertexAttributes > &vertices, std::vector< uint32_t > &indices )
+{
+	std::vector< uint32_t > remap( vertices.size(), InvalidIndex );
+	std::vector< VertexAttributes > ordered;
+	ordered.reserve( vertices.size() );
+
+	for ( uint32_t &index : indices )
+	{
+		if ( remap[ index ] == InvalidIndex )
+		{
+			remap[ index ] = static_cast< uint32_t >( ordered.size() );
+			ordered.push_back( vertices[ index ] );
+		}
+
+		index = remap[ index ];
+	}
+
+	vertices = std::move( ordered );
+}
+
+float MeshOptimizer::ComputeACMR( const std::vector< uint32_t > &indices, size_t vertexCount, size_t cacheSize )
+{
+	const size_t triangleCount = indices.size() / 3;
+	if ( triangleCount == 0 )
+		return 0.0f;
+
+	// A vertex is cached if fewer than cacheSize misses happened since it was last loaded
+	std::vector< size_t > loadedAt( vertexCount, 0 );
+	size_t misses = 0;
+
+	for ( uint32_t index : indices )
+	{
+		if ( misses + 1 - loadedAt[ index ] > cacheSize || loadedAt[ index ] == 0 )
+			loadedAt[ index ] = ++misses;
+	}
+
+	return static_cast< float >( misses ) / static_cast< float >( triangleCount );
+}
+
+MeshOptimizer::Stats MeshOptimizer::Optimize( std::vector< VertexAttributes > &vertices, std::vector< uint32_t > &indices )
+{
+	Stats stats;
+	stats.verticesBefore = vertices.size();
+	stats.acmrBefore = ComputeACMR( indices, vertices.size() );
+
+	WeldVertices( vertices, indices );
+	OptimizeVertexCache( vertices, indices );
+	OptimizeVertexFetch( vertices, indices );
+
+	stats.verticesAfter = vertices.size();
+	stats.acmrAfter = ComputeACMR( indices, vertices.size() );
+
+	return stats;
+}
+
+std::vector< uint32_t > MeshOptimizer::Simplify( const std::vector< VertexAttributes > &vertices, const std::vector< uint32_t > &indices, size_t targetIndexCount, float targetError, float &resultError )
+{
+	std::vector< uint32_t > result( indices );
+	resultError = 0.0f;
+
+	const size_t vertexCount = vertices.size();
+	if ( vertexCount == 0 || result.size() <= targetIndexCount )
+		return result;
+
+	// Vertices split by other attributes share a position, collapses work on those shared positions
+	std::vector< uint32_t > positionId( vertexCount );
+	std::vector< uint32_t > wedgeCount( vertexCount, 0 );
+	{
+		struct PositionHash
+		{
+			size_t operator()( const glm::vec3 &p ) const {
+				const std::hash< float > hasher;
+				return hasher( p.x + 0.0f ) ^ ( hasher( p.y + 0.0f ) * 31 ) ^ ( hasher( p.z + 0.0f ) * 131 );
+			}
+		};
+
+		std::unordered_map< glm::vec3, uint32_t, PositionHash > positions;
+		positions.reserve( vertexCount );
+
+		for ( uint32_t v = 0; v < vertexCount; ++v )
+		{
+			positionId[ v ] = positions.try_emplace( vertices[ v ].position, v ).first->second;
+			++wedgeCount[ positionId[ v ] ];
+		}
+	}
+
+	// Open edges in the position topology have no edge running the other way
+	std::unordered_map< uint64_t, uint32_t > directedEdges;
+	directedEdges.reserve( result.size() );
+
+	for ( size_t i = 0; i < result.size(); i += 3 )
+	{
+		for ( size_t e = 0; e < 3; ++e )
+			++directedEdges[ EdgeKey( positionId[ result[ i + e ] ], positionId[ result[ i + ( e + 1 ) % 3 ] ] ) ];
+	}
+
+	auto isOpenEdge = [ & ]( uint32_t a, uint32_t b ) {
+		return directedEdges.find( EdgeKey( b, a ) ) == directedEdges.end() || directedEdges.find( EdgeKey( a, b ) ) == directedEdges.end();
+	};
+
+	std::vector< VertexKind > kind( vertexCount, VertexKind::Manifold );
+	std::vector< Quadric > quadrics( vertexCount );
+
+	for ( size_t i = 0; i < result.size(); i += 3 )
+	{
+		const uint32_t p[ 3 ] = { positionId[ result[ i ] ], positionId[ result[ i + 1 ] ], positionId[ result[ i + 2 ] ] };
+		const glm::dvec3 p0 = vertices[ p[ 0 ] ].position, p1 = vertices[ p[ 1 ] ].position, p2 = vertices[ p[ 2 ] ].position;
+
+		glm::dvec3 normal = glm::cross( p1 - p0, p2 - p0 );
+		const double area = glm::length( normal );
+		if ( area <= 0.0 )
+			continue;
+
+		normal /= area;
+		const Quadric plane = Quadric::FromPlane( normal, -glm::dot( normal, p0 ), area );
+
+		for ( size_t e = 0; e < 3; ++e )
+		{
+			quadrics[ p[ e ] ] += plane;
+
+			const uint32_t a = p[ e ], b = p[ ( e + 1 ) % 3 ];
+			if ( !isOpenEdge( a, b ) )
+				continue;
+
+			kind[ a ] = std::max( kind[ a ], VertexKind::Border );
+			kind[ b ] = std::max( kind[ b ], VertexKind::Border );
+
+			// Keep borders in place with a plane through the edge, perpendicular to the triangle
+			const glm::dvec3 edge = glm::dvec3( vertices[ b ].position ) - glm::dvec3( vertices[ a ].position );
+			const double edgeLength = glm::length( edge );
+			if ( edgeLength > 0.0 )
+			{
+				const glm::dvec3 borderNormal = glm::normalize( glm::cross( edge, normal ) );
+				const Quadric border = Quadric::FromPlane( borderNormal, -glm::dot( borderNormal, glm::dvec3( vertices[ a ].position ) ), edgeLength * edgeLength * 10.0 );
+				quadrics[ a ] += border;
+				quadrics[ b ] += border;
+			}
+		}
+	}
+
+	for ( uint32_t v = 0; v < vertexCount; ++v )
+	{
+		if ( wedgeCount[ positionId[ v ] ] > 1 )
+			kind[ positionId[ v ] ] = VertexKind::Locked;
+	}
+
+	const double errorLimit = double( targetError ) * double( targetError );
+	double maxError = 0.0;
+
+	struct Collapse
+	{
+		uint32_t from;	// position id, which is also the only vertex at that position
+		uint32_t to;	// position id
+		double error;
+	};
+
+	std::vector< Collapse > collapses;
+	std::vector< uint32_t > remap( vertexCount );
+	std::vector< bool > touched( vertexCount );
+
+	while ( result.size() > targetIndexCount )
+	{
+		const size_t triangleCount = result.size() / 3;
+
+		std::vector< uint32_t > positionIndices( result.size() );
+		for ( size_t i = 0; i < result.size(); ++i )
+			positionIndices[ i ] = positionId[ result[ i ] ];
+
+		Adjacency adjacency( positionIndices, vertexCount );
+
+		// Cheapest collapse for each vertex that is allowed to move
+		collapses.clear();
+		std::vector< Collapse > best( vertexCount, Collapse { 0, 0, -1.0 } );
+
+		for ( size_t i = 0; i < positionIndices.size(); i += 3 )
+		{
+			for ( size_t e = 0; e < 3; ++e )
+			{
+				for ( size_t dir = 0; dir < 2; ++dir )
+				{
+					const uint32_t from = positionIndices[ i + ( dir ? e : ( e + 1 ) % 3 ) ];
+					const uint32_t to = positionIndices[ i + ( dir ? ( e + 1 ) % 3 : e ) ];
+
+					if ( kind[ from ] == VertexKind::Locked || from == to )
+						continue;
+
+					if ( kind[ from ] == VertexKind::Border && !isOpenEdge( from, to ) )
+						continue;
+
+					Quadric combined = quadrics[ from ];
+					combined += quadrics[ to ];
+					const double error = combined.Evaluate( vertices[ to ].position );
+
+					if ( best[ from ].error < 0.0 || error < best[ from ].error )
+						best[ from ] = Collapse { from, to, error };
+				}
+			}
+		}
+
+		for ( const auto &collapse : best )
+		{
+			if ( collapse.error >= 0.0 && collapse.error <= errorLimit )
+				collapses.push_back( collapse );
+		}
+
+		if ( collapses.empty() )
+			break;
+
+		std::sort( collapses.begin(), collapses.end(), []( const Collapse &a, const Collapse &b ) { return a.error < b.error; } );
+
+		std::iota( remap.begin(), remap.end(), 0 );
+		std::fill( touched.begin(), touched.end(), false );
+
+		const size_t trianglesToRemove = triangleCount - targetIndexCount / 3;
+		size_t removed = 0;
+		size_t applied = 0;
+
+		for ( const auto &collapse : collapses )
+		{
+			if ( touched[ collapse.from ] || touched[ collapse.to ] )
+				continue;
+
+			const glm::vec3 &target = vertices[ collapse.to ].position;
+			bool flips = false;
+			size_t shared = 0;
+
+			// The vertex at the other end of the edge may be split, pick the copy the collapsing triangles use
+			uint32_t toVertex = std::numeric_limits< uint32_t >::max();
+
+			for ( uint32_t t = adjacency.offsets[ collapse.from ]; t < adjacency.offsets[ collapse.from + 1 ] && !flips; ++t )
+			{
+				const uint32_t triangle = adjacency.triangles[ t ];
+				const uint32_t *tri = &positionIndices[ triangle * 3 ];
+
+				if ( tri[ 0 ] == collapse.to || tri[ 1 ] == collapse.to || tri[ 2 ] == collapse.to )
+				{
+					++shared;
+
+					for ( size_t corner = 0; corner < 3; ++corner )
+					{
+						if ( tri[ corner ] != collapse.to )
+							continue;
+
+						const uint32_t vertex = result[ triangle * 3 + corner ];
+						if ( toVertex != std::numeric_limits< uint32_t >::max() && toVertex != vertex )
+							flips = true;
+
+						toVertex = vertex;
+					}
+
+					continue;
+				}
+
+				const glm::vec3 p0 = vertices[ tri[ 0 ] ].position, p1 = vertices[ tri[ 1 ] ].position, p2 = vertices[ tri[ 2 ] ].position;
+				const glm::vec3 before = glm::cross( p1 - p0, p2 - p0 );
+
+				const glm::vec3 q0 = ( tri[ 0 ] == collapse.from ) ? target : p0;
+				const glm::vec3 q1 = ( tri[ 1 ] == collapse.from ) ? target : p1;
+				const glm::vec3 q2 = ( tri[ 2 ] == collapse.from ) ? target : p2;
+				const glm::vec3 after = glm::cross( q1 - q0, q2 - q0 );
+
+				if ( glm::dot( before, after ) <= 1e-2f * glm::length( before ) * glm::length( after ) )
+					flips = true;
+			}
+
+			if ( flips || shared == 0 )
+				continue;
+
+			// Neighbours' triangles change shape, so nothing around this collapse may move again this pass
+			for ( uint32_t t = adjacency.offsets[ collapse.from ]; t < adjacency.offsets[ collapse.from + 1 ]; ++t )
+			{
+				const uint32_t *tri = &positionIndices[ adjacency.triangles[ t ] * 3 ];
+				touched[ tri[ 0 ] ] = touched[ tri[ 1 ] ] = touched[ tri[ 2 ] ] = true;
+			}
+
+			remap[ collapse.from ] = toVertex;
+			quadrics[ collapse.to ] += quadrics[ collapse.from ];
+			maxError = std::max( maxError, collapse.error );
+
+			removed += shared;
+			++applied;
+
+			if ( removed >= trianglesToRemove )
+				break;
+		}
+
+		if ( applied == 0 )
+			break;
+
+		// Only single vertices move, so remapping by vertex index is enough; drop triangles that collapsed
+		size_t write = 0;
+		for ( size_t i = 0; i < result.size(); i += 3 )
+		{
+			const uint32_t a = remap[ result[ i ] ], b = remap[ result[ i + 1 ] ], c = remap[ result[ i + 2 ] ];
+
+			if ( positionId[ a ] == positionId[ b ] || positionId[ b ] == positionId[ c ] || positionId[ a ] == positionId[ c ] )
+				continue;
+
+			result[ write++ ] = a;
+			result[ write++ ] = b;
+			result[ write++ ] = c;
+		}
+
+		result.resize( write );
+	}
+
+	resultError = static_cast< float >( std::sqrt( maxError ) );
+	return result;
+}
+
+void MeshOptimizer::ComputeTangents( std::vector< VertexAttributes > &vertices, const std::vector< uint32_t > &indices )
+{
+	auto safeNormalize = []( const glm::vec3 &v )
+	{
+		const float length = glm::length( v );
+		return ( length > 0.0f ) ? v / length : v;
+	};
+
+	for ( size_t i = 0; i + 2 < indices.size(); i += 3 )
+	{
+		VertexAttributes &v0 = vertices[ indices[ i + 0 ] ];
+		VertexAttributes &v1 = vertices[ indices[ i + 1 ] ];
+		VertexAttributes &v2 = vertices[ indices[ i + 2 ] ];
+
+		const glm::vec3 e1 = v1.position - v0.position;
+		const glm::vec3 e2 = v2.position - v0.position;
+		const glm::vec2 duv1 = v1.uv - v0.uv;
+		const glm::vec2 duv2 = v2.uv - v0.uv;
+
+		const float det = duv1.x * duv2.y - duv2.x * duv1.y;
+		if ( std::abs( det ) < 1e-12f )
+			continue;
+
+		const glm::vec3 tangent = ( e1 * duv2.y - e2 * duv1.y ) / det;
+		const glm::vec3 bitangent = ( e2 * duv1.x - e1 * duv2.x ) / det;
+
+		for ( VertexAttributes *vertex : { &v0, &v1, &v2 } )
+		{
+			vertex->tangent += tangent;
+			vertex->bitangent += bitangent;
+		}
+	}
+
+	for ( VertexAttributes &vertex : vertices )
+	{
+		// Normals don't get the y flip positions do on import, undo that to orthogonalize against them
+		const glm::vec3 normal = { vertex.normal.x, -vertex.normal.y, vertex.normal.z };
+
+		vertex.tangent = safeNormalize( vertex.tangent - normal * glm::dot( normal, vertex.tangent ) );
+		vertex.bitangent = safeNormalize( vertex.bitangent - normal * glm::dot( normal, vertex.bitangent ) );
+	}
+}
+
+void MeshOptimizer::ComputeBoundingSphere( const std::vector< VertexAttributes > &vertices, glm::vec3 &center, float &radius )
+{
+	center = { 0.0f, 0.0f, 0.0f };
+	radius = 0.0f;
+
+	if ( vertices.empty() )
+		return;
+
+	glm::vec3 mins = vertices[ 0 ].position, maxs = vertices[ 0 ].position;
+	for ( const auto &vertex : vertices )
+	{
+		mins = glm::min( mins, vertex.position );
+		maxs = glm::max( maxs, vertex.position );
+	}
+
+	center = ( mins + maxs ) * 0.5f;
+	for ( const auto &vertex : vertices )
+		radius = std::max( radius, glm::length( vertex.position - center ) );
+}
+
+std::vector< MeshLOD > MeshOptimizer::BuildLODChain( const std::vector< VertexAttributes > &vertices, std::vector< uint32_t > &indices )
+{
+	constexpr size_t MaxLODs = 5;
+	constexpr float MaxRelativeError = 0.05f;
+
+	std::vector< MeshLOD > lods;
+	lods.push_back( MeshLOD { 0, static_cast< uint32_t >( indices.size() ), 0.0f } );
+
+	glm::vec3 center;
+	float radius;
+	ComputeBoundingSphere( vertices, center, radius );
+
+	std::vector< uint32_t > previous( indices );
+	float previousError = 0.0f;
+
+	while ( lods.size() < MaxLODs )
+	{
+		float error = 0.0f;
+		std::vector< uint32_t > simplified = Simplify( vertices, previous, previous.size() / 2 / 3 * 3, radius * MaxRelativeError, error );
+
+		// Not worth a LOD if we couldn't get rid of a meaningful amount of triangles
+		if ( simplified.empty() || simplified.size() > previous.size() * 3 / 4 )
+			break;
+
+		OptimizeVertexCache( vertices, simplified );
+
+		// Errors accumulate since every LOD is built from the previous one
+		previousError += error;
+
+		lods.push_back( MeshLOD { static_cast< uint32_t >( indices.size() ), static_cast< uint32_t >( simplified.size() ), previousError } );
+		indices.insert( indices.end(), simplified.begin(), simplified.end() );
+		previous = std::move( simplified );
+	}
+
+	return lods;
+}
+
+std::vector< Meshlet > MeshOptimizer::BuildMeshlets( const std::vector< VertexAttributes > &vertices, const std::vector< uint32_t > &indices, uint32_t firstIndex, uint32_t indexCount, size_t maxVertices, size_t maxTriangles )
+{
+	std::vector< Meshlet > meshlets;
+	std::vector< uint32_t > meshletVertices;
+	std::vector< uint32_t > lastMeshlet( vertices.size(), InvalidIndex );
+
+	auto finishMeshlet = [ & ]( uint32_t first, uint32_t end )
+	{
+		Meshlet meshlet;
+		meshlet.firstIndex = first;
+		meshlet.indexCount = end - first;
+
+		glm::vec3 mins = vertices[ meshletVertices[ 0 ] ].position, maxs = mins;
+		for ( uint32_t vertex : meshletVertices )
+		{
+			mins = glm::min( mins, vertices[ vertex ].position );
+			maxs = glm::max( maxs, vertices[ vertex ].position );
+		}
+
+		meshlet.center = ( mins + maxs ) * 0.5f;
+		for ( uint32_t vertex : meshletVertices )
+			meshlet.radius = std::max( meshlet.radius, glm::length( vertices[ vertex ].position - meshlet.center ) );
+
+		std::vector< glm::vec3 > normals;
+		normals.reserve( meshlet.indexCount / 3 );
+
+		glm::vec3 axis = { 0.0f, 0.0f, 0.0f };
+		for ( uint32_t i = first; i < end; i += 3 )
+		{
+			const glm::vec3 &p0 = vertices[ indices[ i ] ].position;
+			const glm::vec3 &p1 = vertices[ indices[ i + 1 ] ].position;
+			const glm::vec3 &p2 = vertices[ indices[ i + 2 ] ].position;
+
+			const glm::vec3 normal = glm::cross( p1 - p0, p2 - p0 );
+			const float length = glm::length( normal );
+
+			if ( length > 0.0f )
+			{
+				normals.push_back( normal / length );
+				axis += normals.back();
+			}
+		}
+
+		const float axisLength = glm::length( axis );
+		if ( axisLength > 0.0f && !normals.empty() )
+		{
+			meshlet.coneAxis = axis / axisLength;
+
+			float minDot = 1.0f;
+			for ( const auto &normal : normals )
+				minDot = std::min( minDot, glm::dot( normal, meshlet.coneAxis ) );
+
+			// Cones past 90 degrees can always see some triangle
+			meshlet.coneCutoff = ( minDot <= 0.0f ) ? 1.0f : std::sqrt( 1.0f - minDot * minDot );
+		}
+
+		meshlets.push_back( meshlet );
+		meshletVertices.clear();
+	};
+
+	const uint32_t end = firstIndex + indexCount;
+	uint32_t meshletStart = firstIndex;
+
+	for ( uint32_t i = firstIndex; i + 2 < end; i += 3 )
+	{
+		const uint32_t meshletId = static_cast< uint32_t >( meshlets.size() );
+
+		size_t newVertices = 0;
+		for ( size_t corner = 0; corner < 3; ++corner )
+		{
+			if ( lastMeshlet[ indices[ i + corner ] ] != meshletId )
+				++newVertices;
+		}
+
+		if ( meshletVertices.size() + newVertices > maxVertices || ( i - meshletStart ) / 3 >= maxTriangles )
+		{
+			finishMeshlet( meshletStart, i );
+			meshletStart = i;
+		}
+
+		const uint32_t currentId = static_cast< uint32_t >( meshlets.size() );
+		for ( size_t corner = 0; corner < 3; ++corner )
+		{
+			const uint32_t vertex = indices[ i + corner ];
+			if ( lastMeshlet[ vertex ] != currentId )
+			{
+				lastMeshlet[ vertex ] = currentId;
+				meshletVertices.push_back( vertex );
+			}
+		}
+	}
+
+	if ( !meshletVertices.empty() )
+		finishMeshlet( meshletStart, end );
+
+	return meshlets;
+}
@@ -0,0 +1,60 @@
+#ifndef MESHOPTIMIZER_HPP
+#define MESHOPTIMIZER_HPP
+
+#include "vertex.hpp"
+#include "meshlod.hpp"
+#include "meshlet.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Import-time triangle list optimizations, run on meshes before they're packed and uploaded
+namespace MeshOptimizer
+{
+	// Size of the FIFO post-transform cache we optimize and measure against
+	constexpr size_t VertexCacheSize = 16;
+
+	// Merges bit-identical vertices and remaps indices, returns the new vertex count
+	size_t WeldVertices( std::vector< VertexAttributes > &vertices, std::vector< uint32_t > &indices );
+
+	// Reorders triangles for post-transform cache hits (Tipsify), then orders the resulting
+	// clusters so outward facing ones are drawn first to cut down on overdraw
+	void OptimizeVertexCache( const std::vector< VertexAttributes > &vertices, std::vector< uint32_t > &indices, size_t cacheSize = VertexCacheSize );
+
+	// Reorders vertices by first use in the index buffer, unreferenced vertices are dropped
+	void OptimizeVertexFetch( std::vector< VertexAttributes > &vertices, std::vector< uint32_t > &indices );
+
+	// Average cache miss ratio, transformed vertices per triangle with a FIFO cache of cacheSize
+	float ComputeACMR( const std::vector< uint32_t > &indices, size_t vertexCount, size_t cacheSize = VertexCacheSize );
+
+	struct Stats
+	{
+		size_t verticesBefore = 0;
+		size_t verticesAfter = 0;
+		float acmrBefore = 0.0f;
+		float acmrAfter = 0.0f;
+	};
+
+	// Runs every pass above in order
+	Stats Optimize( std::vector< VertexAttributes > &vertices, std::vector< uint32_t > &indices );
+
+	// Quadric error metric edge collapse, only removes triangles and never creates vertices so the result
+	// can share the source vertex buffer. Stops at targetIndexCount or once the next collapse would move
+	// the surface further than targetError, returns the resulting indices and the error reached in mesh units
+	std::vector< uint32_t > Simplify( const std::vector< VertexAttributes > &vertices, const std::vector< uint32_t > &indices, size_t targetIndexCount, float targetError, float &resultError );
+
+	// Replaces indices with LOD 0 followed by progressively simplified LODs sharing the same vertices
+	std::vector< MeshLOD > BuildLODChain( const std::vector< VertexAttributes > &vertices, std::vector< uint32_t > &indices );
+
+	// Splits the index range into meshlets of consecutive triangles, relies on the range already being ordered
+	// for locality (OptimizeVertexCache) so neighbouring triangles end up in the same meshlet
+	std::vector< Meshlet > BuildMeshlets( const std::vector< VertexAttributes > &vertices, const std::vector< uint32_t > &indices, uint32_t firstIndex, uint32_t indexCount, size_t maxVertices = 64, size_t maxTriangles = 124 );
+
+	// Per-vertex tangents and bitangents from positions and uvs, same math as Assimp's CalcTangentSpace.
+	// Expects normals in the convention our Assimp import produces
+	void ComputeTangents( std::vector< VertexAttributes > &vertices, const std::vector< uint32_t > &indices );
+
+	void ComputeBoundingSphere( const std::vector< VertexAttributes > &vertices, glm::vec3 &center, float &radius );
+}
+
+#endif // MESHOPTIMIZER_HPP
@@ -3,7 +3,15 @@
 #include "vfile.hpp"
 #include "log.hpp"
 #include "resourcepool.hpp"
+#include "meshoptimizer.hpp"
+#include "objparser.hpp"
+#include "glbparser.hpp"
+#include "mappedfile.hpp"
+#include "clock.hpp"
 #include "nlohmann/json.hpp"
+#include "commandlinesystem.hpp"
+
+#include <algorithm>
 
 #include "assimp/IOStream.hpp"
 #include "assimp/IOSystem.hpp"
@@ -102,6 +110,10 @@ void ModelSystem::configure( Engine *engine )
 	vulkanSystem = engine->GetVulkanSystem();
 	materialSystem = engine->GetMaterialSystem();
 	meshSystem = engine->GetMeshSystem();
+
+	staticBatching = engine->GetCommandLineSystem()->HasOption( "--staticbatch" );
+	assimpOBJ = engine->GetCommandLineSystem()->HasOption( "--assimpobj" );
+	assimpGLB = engine->GetCommandLineSystem()->HasOption( "--assimpglb" );
 }
 
 void ModelSystem::unconfigure( Engine *engine )
@@ -126,13 +138,6 @@ IModel *ModelSystem::LoadModel( const std::filesystem::path &relpath, const std:
 	if ( IModel *model = FindModel_Internal( relpath, resourcePoolPtr ); model )
 		return model;
 
-	Assimp::Importer Importer;
-	Importer.SetIOHandler( new assimpIOSystem( fileSystem, pathid ) );
-
-	const aiScene *pScene = Importer.ReadFile( relpath.string(), aiProcess_Triangulate | aiProcess_MakeLeftHanded | aiProcess_GenNormals | aiProcess_CalcTangentSpace );
-	if ( !pScene )
-		engine->Error( fmt::format( "Importer.ReadFile failed: {}", Importer.GetErrorString() ) );
-
 	Log::Println( "Loading model file: {}", relpath.string() );
 
 	std::unordered_map< std::string, std::filesystem::path > materialMap;
@@ -153,94 +158,335 @@ IModel *ModelSystem::LoadModel( const std::filesystem::path &relpath, const std:
 		}
 	}
 
-	auto resource = ResourcePool::createResource< Model >( ResourceInfo { relpath.generic_string() }, meshSystem );
-	Model *model = resource->resource.get();
-	model->meshes.resize( pScene->mNumMeshes );
-
-	for ( unsigned int meshidx = 0; meshidx < pScene->mNumMeshes; ++meshidx )
+	// Every material the model defines is loaded up front as one batch, so all of their textures decode in parallel
+	std::unordered_map< std::string, Material* > materials;
 	{
-		Material *material = nullptr;
-
-		model->meshes[ meshidx ] = meshSystem->CreateMesh();
-		const aiMesh *pAIMesh = pScene->mMeshes[ meshidx ];
+		std::vector< std::string > matNames;
+		std::vector< std::filesystem::path > matPaths;
 
-		if ( pAIMesh->mMaterialIndex >= 0 )
+		for ( const auto &kv : materialMap )
 		{
-			aiMaterial *pAIMaterial = pScene->mMaterials[ pAIMesh->mMaterialIndex ];
+			matNames.push_back( kv.first );
+			matPaths.push_back( kv.second );
+		}
 
-			if ( pAIMaterial != nullptr )
-			{
-				aiString matName;
-				pAIMaterial->Get( AI_MATKEY_NAME, matName );
-
-				//std::filesystem::path matPath = relpath.parent_path() / matName.C_Str() += ".json";
-
-				if ( auto it = materialMap.find( matName.C_Str() ); it != materialMap.end() )
-				{
-					const std::filesystem::path matPath = it->second;
-					material = Material::ToMaterial( materialSystem->LoadMaterial( matPath, pathid, resourcePoolPtr ) );
-				}
-				else
-				{
-					Log::PrintlnWarn( "Material definition for {} material not found", matName.C_Str() );
-					material = Material::ToMaterial( materialSystem->GetErrorMaterial() );
-				}
-			}
+		const std::vector< IMaterial* > loaded = materialSystem->LoadMaterials( matPaths, pathid, resourcePoolPtr );
+
+		for ( size_t i = 0; i < loaded.size(); ++i )
+			materials[ matNames[ i ] ] = Material::ToMaterial( loaded[ i ] );
+	}
+
+	const MaterialResolver resolveMaterial = [ & ]( const std::string &matName )
+	{
+		auto [ it, inserted ] = materials.try_emplace( matName, nullptr );
+
+		if ( inserted )
+		{
+			Log::PrintlnWarn( "Material definition for {} material not found", matName );
+			it->second = Material::ToMaterial( materialSystem->GetErrorMaterial() );
 		}
 
-		if ( !material )
+		return it->second;
+	};
+
+	std::vector< ImportedMesh > importedMeshes;
+	size_t sourceDraws = 0;
+
+	Clock importClock;
+	importClock.Start();
+
+	std::string extension = relpath.extension().string();
+	std::transform( extension.begin(), extension.end(), extension.begin(), ::tolower );
+
+	if ( extension == ".obj" && !assimpOBJ )
+		sourceDraws = ImportOBJ( relpath, pathid, resolveMaterial, importedMeshes );
+	else if ( extension == ".glb" && !assimpGLB )
+		sourceDraws = ImportGLB( relpath, pathid, resolveMaterial, importedMeshes );
+	else
+		sourceDraws = ImportAssimp( relpath, pathid, resolveMaterial, importedMeshes );
+
+	Log::Println( "{}: imported in {:.2f} ms", relpath.generic_string(), importClock.Duration< float, std::chrono::milliseconds >() );
+
+	for ( const auto &importedMesh : importedMeshes )
+	{
+		if ( !importedMesh.material )
 			return nullptr;
+	}
+
+	auto resource = ResourcePool::createResource< Model >( ResourceInfo { relpath.generic_string() }, meshSystem );
+	Model *model = resource->resource.get();
 
-		const VertexLayout vertexLayout = material->GetShader()->GetVertexLayout();
+	CreateMeshes( model, importedMeshes, relpath );
 
-		shared_ptr< VertexArray > vertices = std::make_shared< VertexArray >( vertexLayout );
-		vertices->Resize( pAIMesh->mNumVertices );
+	if ( staticBatching )
+		Log::Println( "{}: static batching {} -> {} draws", relpath.generic_string(), sourceDraws, model->meshes.size() );
 
-		shared_ptr< std::vector< uint32_t > > indices = std::make_shared< std::vector< uint32_t > >( pAIMesh->mNumFaces * 3 ); // * 3 because we're triangulating
+	modelsMutex.lock();
+	resourcePool->models.push_back( resource );
+	modelsMutex.unlock();
+
+	return model;
+}
+
+size_t ModelSystem::ImportAssimp( const std::filesystem::path &relpath, const std::string &pathid, const MaterialResolver &resolveMaterial, std::vector< ImportedMesh > &importedMeshes )
+{
+	Assimp::Importer Importer;
+	Importer.SetIOHandler( new assimpIOSystem( fileSystem, pathid ) );
+
+	const aiScene *pScene = Importer.ReadFile( relpath.string(), aiProcess_Triangulate | aiProcess_MakeLeftHanded | aiProcess_GenNormals | aiProcess_CalcTangentSpace );
+	if ( !pScene )
+		engine->Error( fmt::format( "Importer.ReadFile failed: {}", Importer.GetErrorString() ) );
+
+	// Resolve each Assimp material once, submeshes share them
+	std::vector< Material* > materials( pScene->mNumMaterials, nullptr );
+
+	for ( unsigned int matidx = 0; matidx < pScene->mNumMaterials; ++matidx )
+	{
+		aiMaterial *pAIMaterial = pScene->mMaterials[ matidx ];
+
+		if ( pAIMaterial != nullptr )
+		{
+			aiString matName;
+			pAIMaterial->Get( AI_MATKEY_NAME, matName );
+
+			materials[ matidx ] = resolveMaterial( matName.C_Str() );
+		}
+	}
+
+	auto convertMesh = [ & ]( const aiMesh *pAIMesh, const aiMatrix4x4 *transform, ImportedMesh &mesh )
+	{
+		aiMatrix3x3 normalTransform;
+		if ( transform )
+			normalTransform = aiMatrix3x3( *transform ).Inverse().Transpose();
+
+		const size_t firstVertex = mesh.attributes.size();
+		mesh.attributes.resize( firstVertex + pAIMesh->mNumVertices );
 
 		for ( unsigned int v = 0; v < pAIMesh->mNumVertices; ++v )
 		{
-			constexpr glm::vec4 defaultColor = { 1.0f, 1.0f, 1.0f, 1.0f };
+			VertexAttributes &attrib = mesh.attributes[ firstVertex + v ];
 
 			if ( pAIMesh->HasPositions() ) {
-				vertices->SetPosition( v, { pAIMesh->mVertices[ v ].x, -pAIMesh->mVertices[ v ].y, pAIMesh->mVertices[ v ].z }, 0 );
+				const aiVector3D position = transform ? *transform * pAIMesh->mVertices[ v ] : pAIMesh->mVertices[ v ];
+				attrib.position = { position.x, -position.y, position.z };
 			}
 
 			if ( pAIMesh->HasNormals() ) {
-				vertices->SetNormal( v, { pAIMesh->mNormals[ v ].x, pAIMesh->mNormals[ v ].y, pAIMesh->mNormals[ v ].z }, 0 );
+				const aiVector3D normal = transform ? ( normalTransform * pAIMesh->mNormals[ v ] ).Normalize() : pAIMesh->mNormals[ v ];
+				attrib.normal = { normal.x, normal.y, normal.z };
 			}
 
 			if ( pAIMesh->HasVertexColors( 0 ) ) {
-				vertices->SetColor( v, { pAIMesh->mColors[ 0 ][ v ].r, pAIMesh->mColors[ 0 ][ v ].g, pAIMesh->mColors[ 0 ][ v ].b, pAIMesh->mColors[ 0 ][ v ].a  }, 0 );
-			}
-			else {
-				vertices->SetColor( v, defaultColor, 0 );
+				attrib.color = { pAIMesh->mColors[ 0 ][ v ].r, pAIMesh->mColors[ 0 ][ v ].g, pAIMesh->mColors[ 0 ][ v ].b, pAIMesh->mColors[ 0 ][ v ].a  };
 			}
 			
 			if ( pAIMesh->HasTextureCoords( 0 ) ) {
-				vertices->SetUV( v, { pAIMesh->mTextureCoords[ 0 ][ v ].x, -pAIMesh->mTextureCoords[ 0 ][ v ].y }, 0 );
+				attrib.uv = { pAIMesh->mTextureCoords[ 0 ][ v ].x, -pAIMesh->mTextureCoords[ 0 ][ v ].y };
 			}
 
 			if ( pAIMesh->HasTangentsAndBitangents() ) {
-				vertices->SetTangent( v, { pAIMesh->mTangents[ v ].x, -pAIMesh->mTangents[ v ].y, pAIMesh->mTangents[ v ].z }, 0 );
-				vertices->SetBiTangent( v, { pAIMesh->mBitangents[ v ].x, -pAIMesh->mBitangents[ v ].y, pAIMesh->mBitangents[ v ].z }, 0 );
+				const aiVector3D tangent = transform ? ( aiMatrix3x3( *transform ) * pAIMesh->mTangents[ v ] ).Normalize() : pAIMesh->mTangents[ v ];
+				const aiVector3D bitangent = transform ? ( aiMatrix3x3( *transform ) * pAIMesh->mBitangents[ v ] ).Normalize() : pAIMesh->mBitangents[ v ];
+				attrib.tangent = { tangent.x, -tangent.y, tangent.z };
+				attrib.bitangent = { bitangent.x, -bitangent.y, bitangent.z };
 			}
 		}
 
+		const size_t firstIndex = mesh.indices.size();
+		mesh.indices.resize( firstIndex + pAIMesh->mNumFaces * 3 ); // * 3 because we're triangulating
+
+		// Mirroring transforms flip the winding, swap two corners back
+		const bool flipWinding = transform && transform->Determinant() < 0.0f;
+
 		for ( unsigned int face = 0; face < pAIMesh->mNumFaces; ++face )
 		{
 			for ( unsigned int idx = 0; idx < pAIMesh->mFaces[ face ].mNumIndices; ++idx )
-				indices->at( ( face * 3 ) + idx ) = pAIMesh->mFaces[ face ].mIndices[ idx ];
+				mesh.indices[ firstIndex + ( face * 3 ) + idx ] = static_cast< uint32_t >( firstVertex + pAIMesh->mFaces[ face ].mIndices[ idx ] );
+
+			if ( flipWinding )
+				std::swap( mesh.indices[ firstIndex + ( face * 3 ) + 1 ], mesh.indices[ firstIndex + ( face * 3 ) + 2 ] );
+		}
+	};
+
+	size_t sourceDraws = 0;
+
+	if ( staticBatching )
+	{
+		// Bake node transforms and append every instance into one mesh per material
+		std::unordered_map< Material*, size_t > batches;
+
+		std::function< void( const aiNode*, const aiMatrix4x4& ) > addNode = [ & ]( const aiNode *pNode, const aiMatrix4x4 &parentTransform )
+		{
+			const aiMatrix4x4 transform = parentTransform * pNode->mTransformation;
+
+			for ( unsigned int i = 0; i < pNode->mNumMeshes; ++i )
+			{
+				const aiMesh *pAIMesh = pScene->mMeshes[ pNode->mMeshes[ i ] ];
+				Material *material = materials[ pAIMesh->mMaterialIndex ];
+
+				auto [ it, inserted ] = batches.try_emplace( material, importedMeshes.size() );
+				if ( inserted )
+					importedMeshes.push_back( ImportedMesh { material, {}, {} } );
+
+				convertMesh( pAIMesh, &transform, importedMeshes[ it->second ] );
+				++sourceDraws;
+			}
+
+			for ( unsigned int i = 0; i < pNode->mNumChildren; ++i )
+				addNode( pNode->mChildren[ i ], transform );
+		};
+
+		addNode( pScene->mRootNode, aiMatrix4x4() );
+	}
+	else
+	{
+		importedMeshes.resize( pScene->mNumMeshes );
+
+		for ( unsigned int meshidx = 0; meshidx < pScene->mNumMeshes; ++meshidx )
+		{
+			const aiMesh *pAIMesh = pScene->mMeshes[ meshidx ];
+			importedMeshes[ meshidx ].material = materials[ pAIMesh->mMaterialIndex ];
+			convertMesh( pAIMesh, nullptr, importedMeshes[ meshidx ] );
 		}
 
-		model->meshes[ meshidx ]->Init( vulkanSystem, vertices, indices, material );
+		sourceDraws = importedMeshes.size();
 	}
 
-	modelsMutex.lock();
-	resourcePool->models.push_back( resource );
-	modelsMutex.unlock();
+	return sourceDraws;
+}
 
-	return model;
+size_t ModelSystem::ImportOBJ( const std::filesystem::path &relpath, const std::string &pathid, const MaterialResolver &resolveMaterial, std::vector< ImportedMesh > &importedMeshes )
+{
+	MappedFile file;
+	if ( !fileSystem->MapFile( relpath, pathid, file ) )
+		engine->Error( fmt::format( "Failed to open {}", relpath.generic_string() ) );
+
+	// Materials come from our own definitions file, so any mtllib is ignored like Assimp's are
+	std::vector< ParsedMesh > parsedMeshes;
+	std::string error;
+	ObjParser::Stats stats;
+
+	if ( !ObjParser::Parse( file.data(), file.size(), parsedMeshes, error, &stats ) )
+		engine->Error( fmt::format( "Failed to parse {}: {}", relpath.generic_string(), error ) );
+
+	Log::Println( "{}: parsed {} positions, {} triangles in {} chunks on {} threads", relpath.generic_string(), stats.positions, stats.triangles, stats.chunks, stats.threads );
+
+	AddParsedMeshes( parsedMeshes, resolveMaterial, importedMeshes );
+	return parsedMeshes.size();
+}
+
+size_t ModelSystem::ImportGLB( const std::filesystem::path &relpath, const std::string &pathid, const MaterialResolver &resolveMaterial, std::vector< ImportedMesh > &importedMeshes )
+{
+	MappedFile file;
+	if ( !fileSystem->MapFile( relpath, pathid, file ) )
+		engine->Error( fmt::format( "Failed to open {}", relpath.generic_string() ) );
+
+	std::vector< ParsedMesh > parsedMeshes;
+	std::string error;
+	GlbParser::Stats stats;
+
+	if ( !GlbParser::Parse( file.data(), file.size(), parsedMeshes, error, &stats ) )
+	{
+		Log::PrintlnWarn( "{}: {}, falling back to Assimp", relpath.generic_string(), error );
+		file.Close();
+
+		return ImportAssimp( relpath, pathid, resolveMaterial, importedMeshes );
+	}
+
+	Log::Println( "{}: {} primitives in {} mesh instances, {} accessors copied directly and {} converted", relpath.generic_string(),
+		stats.primitives, stats.instances, stats.directCopies, stats.convertedCopies );
+
+	AddParsedMeshes( parsedMeshes, resolveMaterial, importedMeshes );
+	return parsedMeshes.size();
+}
+
+void ModelSystem::AddParsedMeshes( std::vector< ParsedMesh > &parsedMeshes, const MaterialResolver &resolveMaterial, std::vector< ImportedMesh > &importedMeshes )
+{
+	// Transforms are already baked by the parsers, static batching just appends meshes that share a material
+	std::unordered_map< Material*, size_t > batches;
+
+	for ( auto &parsedMesh : parsedMeshes )
+	{
+		Material *material = resolveMaterial( parsedMesh.material );
+
+		if ( !staticBatching )
+		{
+			importedMeshes.push_back( ImportedMesh { material, std::move( parsedMesh.attributes ), std::move( parsedMesh.indices ) } );
+			continue;
+		}
+
+		auto [ it, inserted ] = batches.try_emplace( material, importedMeshes.size() );
+		if ( inserted )
+		{
+			importedMeshes.push_back( ImportedMesh { material, std::move( parsedMesh.attributes ), std::move( parsedMesh.indices ) } );
+			continue;
+		}
+
+		ImportedMesh &batch = importedMeshes[ it->second ];
+		const uint32_t firstVertex = static_cast< uint32_t >( batch.attributes.size() );
+
+		batch.attributes.insert( batch.attributes.end(), parsedMesh.attributes.begin(), parsedMesh.attributes.end() );
+
+		for ( uint32_t index : parsedMesh.indices )
+			batch.indices.push_back( firstVertex + index );
+	}
+}
+
+void ModelSystem::CreateMeshes( Model *model, std::vector< ImportedMesh > &importedMeshes, const std::filesystem::path &relpath )
+{
+	MeshOptimizer::Stats optimizeTotals;
+	size_t totalTriangles = 0;
+	size_t indexBytesSaved = 0;
+	std::vector< size_t > lodTriangles;
+	size_t totalMeshlets = 0;
+
+	for ( auto &importedMesh : importedMeshes )
+	{
+		std::vector< VertexAttributes > &attributes = importedMesh.attributes;
+		shared_ptr< std::vector< uint32_t > > indices = std::make_shared< std::vector< uint32_t > >( std::move( importedMesh.indices ) );
+
+		const MeshOptimizer::Stats stats = MeshOptimizer::Optimize( attributes, *indices );
+		optimizeTotals.verticesBefore += stats.verticesBefore;
+		optimizeTotals.verticesAfter += stats.verticesAfter;
+		optimizeTotals.acmrBefore += stats.acmrBefore * ( indices->size() / 3 );
+		optimizeTotals.acmrAfter += stats.acmrAfter * ( indices->size() / 3 );
+		totalTriangles += indices->size() / 3;
+
+		Mesh *mesh = meshSystem->CreateMesh();
+		model->meshes.push_back( mesh );
+
+		mesh->lods = MeshOptimizer::BuildLODChain( attributes, *indices );
+		MeshOptimizer::ComputeBoundingSphere( attributes, mesh->boundsCenter, mesh->boundsRadius );
+		mesh->meshlets = MeshOptimizer::BuildMeshlets( attributes, *indices, mesh->lods[ 0 ].firstIndex, mesh->lods[ 0 ].indexCount );
+		totalMeshlets += mesh->meshlets.size();
+
+		for ( size_t lod = 0; lod < mesh->lods.size(); ++lod )
+		{
+			if ( lodTriangles.size() <= lod )
+				lodTriangles.resize( lod + 1, 0 );
+
+			lodTriangles[ lod ] += mesh->lods[ lod ].indexCount / 3;
+		}
+
+		shared_ptr< VertexArray > vertices = std::make_shared< VertexArray >( importedMesh.material->GetShader()->GetVertexLayout() );
+		vertices->Pack( attributes.data(), attributes.size() );
+
+		mesh->Init( vulkanSystem, vertices, indices, importedMesh.material );
+		indexBytesSaved += ( sizeof( uint32_t ) - mesh->GetIndexSize() ) * indices->size();
+	}
+
+	if ( totalTriangles > 0 )
+	{
+		Log::Println( "{}: {} -> {} vertices, ACMR {:.3f} -> {:.3f}, 16-bit indices saved {} bytes", relpath.generic_string(),
+			optimizeTotals.verticesBefore, optimizeTotals.verticesAfter,
+			optimizeTotals.acmrBefore / totalTriangles, optimizeTotals.acmrAfter / totalTriangles, indexBytesSaved );
+
+		std::string lodSummary;
+		for ( size_t lod = 0; lod < lodTriangles.size(); ++lod )
+			lodSummary += fmt::format( ( lod == 0 ) ? "{}" : " / {}", lodTriangles[ lod ] );
+
+		Log::Println( "{}: LOD triangles {}, {} meshlets", relpath.generic_string(), lodSummary, totalMeshlets );
+	}
 }
 
 IModel *ModelSystem::FindModel( const std::filesystem::path &relpath, IResourcePool *resourcePoolPtr ) const
@@ -7,8 +7,10 @@
 #include "materialsystem.hpp"
 #include "meshsystem.hpp"
 #include "model.hpp"
+#include "parsedmesh.hpp"
 #include "resource.hpp"
 
+#include <functional>
 #include <vector>
 #include <mutex>
 
@@ -24,6 +26,28 @@ public:
 	IModel *FindModel( const std::filesystem::path &relpath, IResourcePool *resourcePoolPtr ) const override;
 
 private:
+	// Geometry of one Mesh before it's optimized and uploaded
+	struct ImportedMesh
+	{
+		Material *material = nullptr;
+		std::vector< VertexAttributes > attributes;
+		std::vector< uint32_t > indices;
+	};
+
+	// Maps a material name from the source file to one of ours
+	using MaterialResolver = std::function< Material*( const std::string &matName ) >;
+
+	// These fill importedMeshes and return how many draws the source file had
+	size_t ImportAssimp( const std::filesystem::path &relpath, const std::string &pathid, const MaterialResolver &resolveMaterial, std::vector< ImportedMesh > &importedMeshes );
+	size_t ImportOBJ( const std::filesystem::path &relpath, const std::string &pathid, const MaterialResolver &resolveMaterial, std::vector< ImportedMesh > &importedMeshes );
+	size_t ImportGLB( const std::filesystem::path &relpath, const std::string &pathid, const MaterialResolver &resolveMaterial, std::vector< ImportedMesh > &importedMeshes );
+
+	// Resolves the native parsers' material names, merging by material when static batching
+	void AddParsedMeshes( std::vector< ParsedMesh > &parsedMeshes, const MaterialResolver &resolveMaterial, std::vector< ImportedMesh > &importedMeshes );
+
+	// Optimizes, builds LODs and meshlets for, and uploads every imported mesh into model
+	void CreateMeshes( Model *model, std::vector< ImportedMesh > &importedMeshes, const std::filesystem::path &relpath );
+
 	IModel *FindModel_Internal( const std::filesystem::path &relpath, IResourcePool *resourcePoolPtr ) const;
 
 	FileSystem *fileSystem = nullptr;
@@ -32,6 +56,15 @@ private:
 	MeshSystem *meshSystem = nullptr;
 
 	mutable std::mutex modelsMutex;
+
+	// --staticbatch, merges every submesh sharing a material into one mesh with node transforms baked in
+	bool staticBatching = false;
+
+	// --assimpobj, loads .obj files through Assimp instead of ObjParser
+	bool assimpOBJ = false;
+
+	// --assimpglb, loads .glb files through Assimp instead of GlbParser
+	bool assimpGLB = false;
 };
 
 #endif // MODELSYSTEM_HPP
\ No newline at end of file
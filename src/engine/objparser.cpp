@@ -0,0 +1,590 @@
+#include "objparser.hpp"
+#include "meshoptimizer.hpp"
+#include "thread.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <map>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+	constexpr int32_t MissingIndex = std::numeric_limits< int32_t >::min();
+
+	// Indices are 0 based and global once the chunks are stitched together
+	struct Corner
+	{
+		int32_t position = MissingIndex;
+		int32_t uv = MissingIndex;
+		int32_t normal = MissingIndex;
+	};
+
+	// Negative OBJ indices count back from the end of what's been read so far, which a chunk only
+	// knows locally. These get rebased by the element counts of every chunk before it
+	struct RelativeIndex
+	{
+		size_t corner;
+		int32_t Corner::*attribute;
+	};
+
+	// usemtl, o and g lines, each one starts a new run of corners
+	struct Switch
+	{
+		enum class Kind
+		{
+			Material,
+			Object
+		};
+
+		size_t corner;
+		Kind kind;
+		std::string name;
+	};
+
+	struct Chunk
+	{
+		const char *begin = nullptr;
+		const char *end = nullptr;
+
+		std::vector< glm::vec3 > positions;
+		std::vector< glm::vec4 > colors; // Only filled once a vertex with a color shows up
+		std::vector< glm::vec2 > uvs;
+		std::vector< glm::vec3 > normals;
+
+		std::vector< Corner > corners; // Triangulated, 3 per triangle
+		std::vector< RelativeIndex > relativeIndices;
+		std::vector< Switch > switches;
+
+		size_t lines = 0;
+		size_t errorLine = 0;
+		std::string error;
+	};
+
+	// A contiguous range of one chunk's corners that lands in a single mesh
+	struct Run
+	{
+		size_t chunk;
+		size_t firstCorner;
+		size_t endCorner;
+	};
+
+	struct CornerKey
+	{
+		Corner corner;
+		uint32_t face; // Corners without a normal get a flat one, so they can't be shared across faces
+
+		bool operator==( const CornerKey &other ) const
+		{
+			return corner.position == other.corner.position && corner.uv == other.corner.uv && corner.normal == other.corner.normal && face == other.face;
+		}
+	};
+
+	struct CornerKeyHash
+	{
+		size_t operator()( const CornerKey &key ) const
+		{
+			size_t hash = static_cast< uint32_t >( key.corner.position );
+			hash = hash * 0x9E3779B97F4A7C15ull + static_cast< uint32_t >( key.corner.uv );
+			hash = hash * 0x9E3779B97F4A7C15ull + static_cast< uint32_t >( key.corner.normal );
+			hash = hash * 0x9E3779B97F4A7C15ull + key.face;
+			return hash ^ ( hash >> 29 );
+		}
+	};
+
+	bool IsSpace( char c )
+	{
+		return ( c == ' ' || c == '\t' || c == '\r' );
+	}
+
+	bool IsLineEnd( const char *p, const char *end )
+	{
+		return ( p == end || *p == '\n' || *p == '#' );
+	}
+
+	const char *SkipSpaces( const char *p, const char *end )
+	{
+		while ( p != end && IsSpace( *p ) )
+			++p;
+
+		return p;
+	}
+
+	const char *SkipLine( const char *p, const char *end )
+	{
+		p = static_cast< const char* >( std::memchr( p, '\n', end - p ) );
+		return p ? p + 1 : end;
+	}
+
+	// True if the line starts with keyword followed by whitespace
+	bool MatchKeyword( const char *p, const char *end, std::string_view keyword )
+	{
+		if ( static_cast< size_t >( end - p ) <= keyword.size() )
+			return false;
+
+		return ( std::string_view( p, keyword.size() ) == keyword && IsSpace( p[ keyword.size() ] ) );
+	}
+
+	bool ParseFloat( const char *&p, const char *end, float &value )
+	{
+		p = SkipSpaces( p, end );
+
+		// from_chars doesn't take an explicit plus sign
+		if ( p != end && *p == '+' )
+			++p;
+
+		auto [ ptr, ec ] = std::from_chars( p, end, value );
+		if ( ec != std::errc() )
+			return false;
+
+		p = ptr;
+		return true;
+	}
+
+	bool ParseInt( const char *&p, const char *end, int32_t &value )
+	{
+		if ( p != end && *p == '+' )
+			++p;
+
+		auto [ ptr, ec ] = std::from_chars( p, end, value );
+		if ( ec != std::errc() )
+			return false;
+
+		p = ptr;
+		return true;
+	}
+
+	// Rest of the line with surrounding whitespace trimmed
+	std::string ParseName( const char *p, const char *end )
+	{
+		p = SkipSpaces( p, end );
+
+		const char *nameEnd = p;
+		while ( nameEnd != end && *nameEnd != '\n' )
+			++nameEnd;
+
+		while ( nameEnd != p && IsSpace( nameEnd[ -1 ] ) )
+			--nameEnd;
+
+		return std::string( p, nameEnd );
+	}
+
+	bool ParseChunk( Chunk &chunk )
+	{
+		struct PolygonCorner
+		{
+			Corner corner;
+			int32_t Corner::*relative[ 3 ];
+			size_t relativeCount;
+		};
+
+		std::vector< PolygonCorner > polygon;
+		const char *end = chunk.end;
+
+		auto fail = [ &chunk ]( std::string error )
+		{
+			chunk.errorLine = chunk.lines;
+			chunk.error = std::move( error );
+			return false;
+		};
+
+		for ( const char *p = chunk.begin; p != end; p = SkipLine( p, end ) )
+		{
+			++chunk.lines;
+			p = SkipSpaces( p, end );
+
+			if ( IsLineEnd( p, end ) )
+				continue;
+
+			if ( MatchKeyword( p, end, "v" ) )
+			{
+				p += 1;
+
+				glm::vec3 position;
+				if ( !ParseFloat( p, end, position.x ) || !ParseFloat( p, end, position.y ) || !ParseFloat( p, end, position.z ) )
+					return fail( "bad vertex position" );
+
+				chunk.positions.push_back( position );
+
+				// Some exporters append an RGB color
+				float rgb[ 3 ];
+				const bool hasColor = ParseFloat( p, end, rgb[ 0 ] ) && ParseFloat( p, end, rgb[ 1 ] ) && ParseFloat( p, end, rgb[ 2 ] );
+
+				if ( hasColor && chunk.colors.empty() )
+					chunk.colors.resize( chunk.positions.size() - 1, VertexAttributes().color );
+
+				if ( hasColor )
+					chunk.colors.emplace_back( rgb[ 0 ], rgb[ 1 ], rgb[ 2 ], 1.0f );
+				else if ( !chunk.colors.empty() )
+					chunk.colors.push_back( VertexAttributes().color );
+			}
+			else if ( MatchKeyword( p, end, "vt" ) )
+			{
+				p += 2;
+
+				glm::vec2 uv;
+				if ( !ParseFloat( p, end, uv.x ) )
+					return fail( "bad texture coordinate" );
+
+				// 1D texture coordinates are allowed
+				if ( !ParseFloat( p, end, uv.y ) )
+					uv.y = 0.0f;
+
+				chunk.uvs.push_back( uv );
+			}
+			else if ( MatchKeyword( p, end, "vn" ) )
+			{
+				p += 2;
+
+				glm::vec3 normal;
+				if ( !ParseFloat( p, end, normal.x ) || !ParseFloat( p, end, normal.y ) || !ParseFloat( p, end, normal.z ) )
+					return fail( "bad vertex normal" );
+
+				chunk.normals.push_back( normal );
+			}
+			else if ( MatchKeyword( p, end, "f" ) )
+			{
+				p += 1;
+				polygon.clear();
+
+				while ( true )
+				{
+					p = SkipSpaces( p, end );
+					if ( IsLineEnd( p, end ) )
+						break;
+
+					PolygonCorner polygonCorner = {};
+
+					auto parseIndex = [ & ]( int32_t Corner::*attribute, size_t count )
+					{
+						int32_t index = 0;
+						if ( !ParseInt( p, end, index ) || index == 0 )
+							return false;
+
+						if ( index > 0 )
+						{
+							polygonCorner.corner.*attribute = index - 1;
+						}
+						else
+						{
+							polygonCorner.corner.*attribute = static_cast< int32_t >( count ) + index;
+							polygonCorner.relative[ polygonCorner.relativeCount++ ] = attribute;
+						}
+
+						return true;
+					};
+
+					if ( !parseIndex( &Corner::position, chunk.positions.size() ) )
+						return fail( "bad face index" );
+
+					if ( p != end && *p == '/' )
+					{
+						++p;
+
+						if ( p != end && *p != '/' && !parseIndex( &Corner::uv, chunk.uvs.size() ) )
+							return fail( "bad face texture coordinate index" );
+
+						if ( p != end && *p == '/' )
+						{
+							++p;
+
+							if ( !parseIndex( &Corner::normal, chunk.normals.size() ) )
+								return fail( "bad face normal index" );
+						}
+					}
+
+					if ( !IsLineEnd( p, end ) && !IsSpace( *p ) )
+						return fail( "bad face" );
+
+					polygon.push_back( polygonCorner );
+				}
+
+				// Triangulate as a fan, anything under 3 corners isn't a surface
+				for ( size_t i = 1; i + 1 < polygon.size(); ++i )
+				{
+					for ( const PolygonCorner *polygonCorner : { &polygon[ 0 ], &polygon[ i ], &polygon[ i + 1 ] } )
+					{
+						for ( size_t r = 0; r < polygonCorner->relativeCount; ++r )
+							chunk.relativeIndices.push_back( RelativeIndex { chunk.corners.size(), polygonCorner->relative[ r ] } );
+
+						chunk.corners.push_back( polygonCorner->corner );
+					}
+				}
+			}
+			else if ( MatchKeyword( p, end, "usemtl" ) )
+			{
+				chunk.switches.push_back( Switch { chunk.corners.size(), Switch::Kind::Material, ParseName( p + 6, end ) } );
+			}
+			else if ( MatchKeyword( p, end, "o" ) || MatchKeyword( p, end, "g" ) )
+			{
+				chunk.switches.push_back( Switch { chunk.corners.size(), Switch::Kind::Object, ParseName( p + 1, end ) } );
+			}
+
+			// Everything else (s, l, p, mtllib, ...) doesn't affect triangle meshes
+		}
+
+		return true;
+	}
+
+	glm::vec3 SafeNormalize( const glm::vec3 &v )
+	{
+		const float length = glm::length( v );
+		return ( length > 0.0f ) ? v / length : v;
+	}
+}
+
+bool ObjParser::Parse( const char *data, size_t size, std::vector< ParsedMesh > &meshes, std::string &error, Stats *stats )
+{
+	meshes.clear();
+
+	const size_t threadCount = std::max< size_t >( std::thread::hardware_concurrency(), 1 );
+
+	// A few chunks per thread so one dense chunk doesn't hold everyone up
+	const size_t chunkCount = std::clamp< size_t >( size / MinChunkSize, 1, threadCount * 4 );
+	std::vector< Chunk > chunks( chunkCount );
+
+	const char *const end = data + size;
+	const char *chunkBegin = data;
+
+	for ( size_t i = 0; i < chunkCount; ++i )
+	{
+		const char *chunkEnd = ( i + 1 == chunkCount ) ? end : SkipLine( std::max( chunkBegin, data + size / chunkCount * ( i + 1 ) ), end );
+
+		chunks[ i ].begin = chunkBegin;
+		chunks[ i ].end = chunkEnd;
+		chunkBegin = chunkEnd;
+	}
+
+	Thread::ParallelFor( chunkCount, threadCount, [ &chunks ]( size_t i ) { ParseChunk( chunks[ i ] ); } );
+
+	size_t linesBefore = 0;
+	for ( const Chunk &chunk : chunks )
+	{
+		if ( !chunk.error.empty() )
+		{
+			error = fmt::format( "line {}: {}", linesBefore + chunk.errorLine, chunk.error );
+			return false;
+		}
+
+		linesBefore += chunk.lines;
+	}
+
+	// Stitch the chunks' vertex data together and rebase their relative indices
+	struct Offsets
+	{
+		size_t positions = 0;
+		size_t uvs = 0;
+		size_t normals = 0;
+	};
+
+	std::vector< Offsets > offsets( chunkCount + 1 );
+	bool hasColors = false;
+
+	for ( size_t i = 0; i < chunkCount; ++i )
+	{
+		offsets[ i + 1 ].positions = offsets[ i ].positions + chunks[ i ].positions.size();
+		offsets[ i + 1 ].uvs = offsets[ i ].uvs + chunks[ i ].uvs.size();
+		offsets[ i + 1 ].normals = offsets[ i ].normals + chunks[ i ].normals.size();
+		hasColors |= !chunks[ i ].colors.empty();
+	}
+
+	if ( offsets.back().positions > static_cast< size_t >( std::numeric_limits< int32_t >::max() ) )
+	{
+		error = "too many vertices";
+		return false;
+	}
+
+	std::vector< glm::vec3 > positions( offsets.back().positions );
+	std::vector< glm::vec4 > colors( hasColors ? positions.size() : 0 );
+	std::vector< glm::vec2 > uvs( offsets.back().uvs );
+	std::vector< glm::vec3 > normals( offsets.back().normals );
+
+	Thread::ParallelFor( chunkCount, threadCount, [ & ]( size_t i )
+	{
+		Chunk &chunk = chunks[ i ];
+
+		std::copy( chunk.positions.begin(), chunk.positions.end(), positions.begin() + offsets[ i ].positions );
+		std::copy( chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + offsets[ i ].uvs );
+		std::copy( chunk.normals.begin(), chunk.normals.end(), normals.begin() + offsets[ i ].normals );
+
+		if ( !chunk.colors.empty() )
+			std::copy( chunk.colors.begin(), chunk.colors.end(), colors.begin() + offsets[ i ].positions );
+		else if ( hasColors )
+			std::fill_n( colors.begin() + offsets[ i ].positions, chunk.positions.size(), VertexAttributes().color );
+
+		for ( const RelativeIndex &relative : chunk.relativeIndices )
+		{
+			int32_t &index = chunk.corners[ relative.corner ].*relative.attribute;
+
+			if ( relative.attribute == &Corner::position )
+				index += static_cast< int32_t >( offsets[ i ].positions );
+			else if ( relative.attribute == &Corner::uv )
+				index += static_cast< int32_t >( offsets[ i ].uvs );
+			else
+				index += static_cast< int32_t >( offsets[ i ].normals );
+		}
+
+		chunk.positions = {};
+		chunk.colors = {};
+		chunk.uvs = {};
+		chunk.normals = {};
+	} );
+
+	// Split the corners into meshes by object and material, in file order
+	std::map< std::pair< size_t, std::string >, size_t > meshLookup;
+	std::vector< std::vector< Run > > meshRuns;
+
+	size_t object = 0;
+	std::string material;
+
+	for ( size_t i = 0; i < chunkCount; ++i )
+	{
+		const Chunk &chunk = chunks[ i ];
+		size_t runBegin = 0;
+
+		auto addRun = [ & ]( size_t runEnd )
+		{
+			if ( runEnd == runBegin )
+				return;
+
+			auto [ it, inserted ] = meshLookup.try_emplace( { object, material }, meshes.size() );
+			if ( inserted )
+			{
+				meshes.push_back( ParsedMesh { material, {}, {} } );
+				meshRuns.emplace_back();
+			}
+
+			meshRuns[ it->second ].push_back( Run { i, runBegin, runEnd } );
+			runBegin = runEnd;
+		};
+
+		for ( const Switch &change : chunk.switches )
+		{
+			addRun( change.corner );
+
+			if ( change.kind == Switch::Kind::Material )
+				material = change.name;
+			else
+				++object;
+		}
+
+		addRun( chunk.corners.size() );
+	}
+
+	// Build each mesh's vertices, sharing the ones with identical OBJ indices
+	std::vector< std::string > meshErrors( meshes.size() );
+
+	Thread::ParallelFor( meshes.size(), threadCount, [ & ]( size_t m )
+	{
+		ParsedMesh &mesh = meshes[ m ];
+
+		size_t cornerCount = 0;
+		for ( const Run &run : meshRuns[ m ] )
+			cornerCount += run.endCorner - run.firstCorner;
+
+		mesh.indices.reserve( cornerCount );
+
+		std::unordered_map< CornerKey, uint32_t, CornerKeyHash > vertexLookup;
+		vertexLookup.reserve( cornerCount / 2 );
+
+		uint32_t face = 0;
+
+		for ( const Run &run : meshRuns[ m ] )
+		{
+			const std::vector< Corner > &corners = chunks[ run.chunk ].corners;
+
+			for ( size_t c = run.firstCorner; c < run.endCorner; c += 3, ++face )
+			{
+				glm::vec3 faceNormal = {};
+				bool faceNormalValid = false;
+
+				for ( size_t k = 0; k < 3; ++k )
+				{
+					const Corner &corner = corners[ c + k ];
+
+					if ( corner.position < 0 || static_cast< size_t >( corner.position ) >= positions.size() ||
+						( corner.uv != MissingIndex && ( corner.uv < 0 || static_cast< size_t >( corner.uv ) >= uvs.size() ) ) ||
+						( corner.normal != MissingIndex && ( corner.normal < 0 || static_cast< size_t >( corner.normal ) >= normals.size() ) ) )
+					{
+						meshErrors[ m ] = fmt::format( "face index out of range in mesh {} ({})", m, mesh.material );
+						return;
+					}
+
+					const CornerKey key = { corner, ( corner.normal == MissingIndex ) ? face + 1 : 0 };
+					auto [ it, inserted ] = vertexLookup.try_emplace( key, static_cast< uint32_t >( mesh.attributes.size() ) );
+					mesh.indices.push_back( it->second );
+
+					if ( !inserted )
+						continue;
+
+					// Same flips our Assimp import ends up with, MakeLeftHanded negates z, then y and v get flipped for Vulkan
+					VertexAttributes attrib;
+					const glm::vec3 &position = positions[ corner.position ];
+					attrib.position = { position.x, -position.y, -position.z };
+
+					if ( hasColors )
+						attrib.color = colors[ corner.position ];
+
+					if ( corner.uv != MissingIndex )
+						attrib.uv = { uvs[ corner.uv ].x, -uvs[ corner.uv ].y };
+
+					glm::vec3 normal;
+					if ( corner.normal != MissingIndex )
+					{
+						normal = normals[ corner.normal ];
+					}
+					else
+					{
+						if ( !faceNormalValid )
+						{
+							const glm::vec3 &p0 = positions[ corners[ c ].position ];
+							const glm::vec3 &p1 = positions[ corners[ c + 1 ].position ];
+							const glm::vec3 &p2 = positions[ corners[ c + 2 ].position ];
+
+							faceNormal = SafeNormalize( glm::cross( p1 - p0, p2 - p0 ) );
+							faceNormalValid = true;
+						}
+
+						normal = faceNormal;
+					}
+
+					attrib.normal = { normal.x, normal.y, -normal.z };
+					mesh.attributes.push_back( attrib );
+				}
+			}
+		}
+
+		if ( !uvs.empty() )
+			MeshOptimizer::ComputeTangents( mesh.attributes, mesh.indices );
+	} );
+
+	for ( const std::string &meshError : meshErrors )
+	{
+		if ( !meshError.empty() )
+		{
+			error = meshError;
+			meshes.clear();
+			return false;
+		}
+	}
+
+	if ( stats )
+	{
+		stats->threads = std::min( threadCount, chunkCount );
+		stats->chunks = chunkCount;
+		stats->positions = positions.size();
+		stats->triangles = 0;
+
+		for ( const ParsedMesh &mesh : meshes )
+			stats->triangles += mesh.indices.size() / 3;
+	}
+
+	return true;
+}
@@ -0,0 +1,28 @@
+#ifndef OBJPARSER_HPP
+#define OBJPARSER_HPP
+
+#include "parsedmesh.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Native Wavefront OBJ importer, the file is split into line aligned chunks that are parsed in parallel
+namespace ObjParser
+{
+	// Chunks smaller than this aren't worth a thread
+	constexpr size_t MinChunkSize = 1 << 20;
+
+	struct Stats
+	{
+		size_t threads = 0;
+		size_t chunks = 0;
+		size_t positions = 0;
+		size_t triangles = 0;
+	};
+
+	// Parses OBJ text into one mesh per object and material, on failure returns false and describes the problem in 'error'
+	bool Parse( const char *data, size_t size, std::vector< ParsedMesh > &meshes, std::string &error, Stats *stats = nullptr );
+}
+
+#endif // OBJPARSER_HPP
@@ -0,0 +1,19 @@
+#ifndef PARSEDMESH_HPP
+#define PARSEDMESH_HPP
+
+#include "vertex.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Geometry straight out of one of our native model parsers, already in engine space
+// (same conventions as our Assimp import), materials are still referenced by name
+struct ParsedMesh
+{
+	std::string material;
+	std::vector< VertexAttributes > attributes;
+	std::vector< uint32_t > indices;
+};
+
+#endif // PARSEDMESH_HPP
@@ -0,0 +1,545 @@
+#include "pixelkernels.hpp"
+#include "clock.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+#define PIXELKERNELS_X86 1
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PIXELKERNELS_TARGET( isa )
+#else
+// Lets the SIMD paths build without raising the minimum CPU for the rest of the engine
+#define PIXELKERNELS_TARGET( isa ) __attribute__( ( target( isa ) ) )
+#endif
+#endif
+
+namespace
+{
+	using PixelKernels::Isa;
+
+	// First texel the SIMD loop doesn't reach. Chunks of 'chunk' texels start at multiples of it and each one reads
+	// 'reach' texels worth of source, which may be more than it converts
+	inline size_t SimdEnd( size_t count, size_t chunk, size_t reach )
+	{
+		return ( count >= reach ) ? ( ( count - reach ) / chunk + 1 ) * chunk : 0;
+	}
+
+	void ExpandScalar( const uint8_t *src, uint8_t *dst, size_t begin, size_t end, uint32_t channels )
+	{
+		// Back to front and through locals, a texel's output never overlaps the input of one before it
+		for ( size_t i = end; i-- > begin; )
+		{
+			const uint8_t *s = src + i * channels;
+			uint8_t *d = dst + i * 4;
+
+			uint8_t r = s[ 0 ];
+			uint8_t g = r;
+			uint8_t b = r;
+			uint8_t a = 255;
+
+			if ( channels == 2 ) {
+				a = s[ 1 ];
+			}
+			else if ( channels == 3 ) {
+				g = s[ 1 ];
+				b = s[ 2 ];
+			}
+
+			d[ 0 ] = r;
+			d[ 1 ] = g;
+			d[ 2 ] = b;
+			d[ 3 ] = a;
+		}
+	}
+
+	void SwizzleScalar( uint8_t *rgba, size_t begin, size_t end, const uint8_t order[ 4 ] )
+	{
+		for ( size_t i = begin; i < end; ++i )
+		{
+			uint8_t *texel = rgba + i * 4;
+			const uint8_t in[ 4 ] = { texel[ 0 ], texel[ 1 ], texel[ 2 ], texel[ 3 ] };
+
+			for ( int c = 0; c < 4; ++c )
+				texel[ c ] = in[ order[ c ] ];
+		}
+	}
+
+	void PackScalar( const uint8_t *rgba, uint8_t *dst, size_t begin, size_t end, uint32_t channels )
+	{
+		for ( size_t i = begin; i < end; ++i )
+		{
+			dst[ i * channels ] = rgba[ i * 4 ];
+
+			if ( channels == 2 )
+				dst[ i * 2 + 1 ] = rgba[ i * 4 + 1 ];
+		}
+	}
+
+	bool IsOpaqueScalar( const uint8_t *rgba, size_t begin, size_t end )
+	{
+		for ( size_t i = begin; i < end; ++i )
+		{
+			if ( rgba[ i * 4 + 3 ] != 255 )
+				return false;
+		}
+
+		return true;
+	}
+
+#if PIXELKERNELS_X86
+	PIXELKERNELS_TARGET( "ssse3" )
+	void ExpandSSSE3( const uint8_t *src, uint8_t *dst, size_t count, uint32_t channels )
+	{
+		const __m128i alpha = _mm_set1_epi32( static_cast< int >( 0xFF000000u ) );
+
+		if ( channels == 1 )
+		{
+			const size_t end = SimdEnd( count, 16, 16 );
+			ExpandScalar( src, dst, end, count, channels );
+
+			const __m128i masks[ 4 ] = {
+				_mm_setr_epi8( 0, 0, 0, -1, 1, 1, 1, -1, 2, 2, 2, -1, 3, 3, 3, -1 ),
+				_mm_setr_epi8( 4, 4, 4, -1, 5, 5, 5, -1, 6, 6, 6, -1, 7, 7, 7, -1 ),
+				_mm_setr_epi8( 8, 8, 8, -1, 9, 9, 9, -1, 10, 10, 10, -1, 11, 11, 11, -1 ),
+				_mm_setr_epi8( 12, 12, 12, -1, 13, 13, 13, -1, 14, 14, 14, -1, 15, 15, 15, -1 )
+			};
+
+			for ( size_t i = end; i > 0; )
+			{
+				i -= 16;
+				const __m128i gray = _mm_loadu_si128( reinterpret_cast< const __m128i* >( src + i ) );
+
+				for ( int q = 0; q < 4; ++q )
+					_mm_storeu_si128( reinterpret_cast< __m128i* >( dst + ( i + q * 4 ) * 4 ), _mm_or_si128( _mm_shuffle_epi8( gray, masks[ q ] ), alpha ) );
+			}
+		}
+		else if ( channels == 2 )
+		{
+			const size_t end = SimdEnd( count, 8, 8 );
+			ExpandScalar( src, dst, end, count, channels );
+
+			const __m128i lo = _mm_setr_epi8( 0, 0, 0, 1, 2, 2, 2, 3, 4, 4, 4, 5, 6, 6, 6, 7 );
+			const __m128i hi = _mm_setr_epi8( 8, 8, 8, 9, 10, 10, 10, 11, 12, 12, 12, 13, 14, 14, 14, 15 );
+
+			for ( size_t i = end; i > 0; )
+			{
+				i -= 8;
+				const __m128i grayAlpha = _mm_loadu_si128( reinterpret_cast< const __m128i* >( src + i * 2 ) );
+
+				_mm_storeu_si128( reinterpret_cast< __m128i* >( dst + i * 4 ), _mm_shuffle_epi8( grayAlpha, lo ) );
+				_mm_storeu_si128( reinterpret_cast< __m128i* >( dst + i * 4 + 16 ), _mm_shuffle_epi8( grayAlpha, hi ) );
+			}
+		}
+		else
+		{
+			// 16 bytes are loaded for 4 texels, so stop while there are still 16 bytes of source left
+			const size_t end = SimdEnd( count, 4, 6 );
+			ExpandScalar( src, dst, end, count, channels );
+
+			const __m128i mask = _mm_setr_epi8( 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 );
+
+			for ( size_t i = end; i > 0; )
+			{
+				i -= 4;
+				const __m128i rgb = _mm_loadu_si128( reinterpret_cast< const __m128i* >( src + i * 3 ) );
+				_mm_storeu_si128( reinterpret_cast< __m128i* >( dst + i * 4 ), _mm_or_si128( _mm_shuffle_epi8( rgb, mask ), alpha ) );
+			}
+		}
+	}
+
+	PIXELKERNELS_TARGET( "ssse3" )
+	void SwizzleSSSE3( uint8_t *rgba, size_t count, const uint8_t order[ 4 ] )
+	{
+		alignas( 16 ) int8_t bytes[ 16 ];
+		for ( int i = 0; i < 16; ++i )
+			bytes[ i ] = static_cast< int8_t >( ( i & ~3 ) + order[ i & 3 ] );
+
+		const __m128i mask = _mm_load_si128( reinterpret_cast< const __m128i* >( bytes ) );
+		const size_t end = count & ~size_t( 3 );
+
+		for ( size_t i = 0; i < end; i += 4 )
+		{
+			__m128i *texels = reinterpret_cast< __m128i* >( rgba + i * 4 );
+			_mm_storeu_si128( texels, _mm_shuffle_epi8( _mm_loadu_si128( texels ), mask ) );
+		}
+
+		SwizzleScalar( rgba, end, count, order );
+	}
+
+	PIXELKERNELS_TARGET( "avx2" )
+	void SwizzleAVX2( uint8_t *rgba, size_t count, const uint8_t order[ 4 ] )
+	{
+		alignas( 32 ) int8_t bytes[ 32 ];
+		for ( int i = 0; i < 32; ++i )
+			bytes[ i ] = static_cast< int8_t >( ( i & 12 ) + order[ i & 3 ] );
+
+		const __m256i mask = _mm256_load_si256( reinterpret_cast< const __m256i* >( bytes ) );
+		const size_t end = count & ~size_t( 7 );
+
+		for ( size_t i = 0; i < end; i += 8 )
+		{
+			__m256i *texels = reinterpret_cast< __m256i* >( rgba + i * 4 );
+			_mm256_storeu_si256( texels, _mm256_shuffle_epi8( _mm256_loadu_si256( texels ), mask ) );
+		}
+
+		SwizzleScalar( rgba, end, count, order );
+	}
+
+	PIXELKERNELS_TARGET( "ssse3" )
+	void PackSSSE3( const uint8_t *rgba, uint8_t *dst, size_t count, uint32_t channels )
+	{
+		const size_t end = count & ~size_t( 15 );
+
+		if ( channels == 1 )
+		{
+			// Each load's four reds land in their own dword of the output
+			const __m128i masks[ 4 ] = {
+				_mm_setr_epi8( 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 ),
+				_mm_setr_epi8( -1, -1, -1, -1, 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1 ),
+				_mm_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, 0, 4, 8, 12, -1, -1, -1, -1 ),
+				_mm_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 4, 8, 12 )
+			};
+
+			for ( size_t i = 0; i < end; i += 16 )
+			{
+				const __m128i *texels = reinterpret_cast< const __m128i* >( rgba + i * 4 );
+				__m128i red = _mm_setzero_si128();
+
+				for ( int q = 0; q < 4; ++q )
+					red = _mm_or_si128( red, _mm_shuffle_epi8( _mm_loadu_si128( texels + q ), masks[ q ] ) );
+
+				_mm_storeu_si128( reinterpret_cast< __m128i* >( dst + i ), red );
+			}
+		}
+		else
+		{
+			const __m128i lo = _mm_setr_epi8( 0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1 );
+			const __m128i hi = _mm_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 4, 5, 8, 9, 12, 13 );
+
+			for ( size_t i = 0; i < end; i += 8 )
+			{
+				const __m128i *texels = reinterpret_cast< const __m128i* >( rgba + i * 4 );
+				const __m128i redGreen = _mm_or_si128( _mm_shuffle_epi8( _mm_loadu_si128( texels ), lo ), _mm_shuffle_epi8( _mm_loadu_si128( texels + 1 ), hi ) );
+
+				_mm_storeu_si128( reinterpret_cast< __m128i* >( dst + i * 2 ), redGreen );
+			}
+		}
+
+		PackScalar( rgba, dst, end, count, channels );
+	}
+
+	PIXELKERNELS_TARGET( "avx2" )
+	void PackAVX2( const uint8_t *rgba, uint8_t *dst, size_t count, uint32_t channels )
+	{
+		if ( channels == 1 )
+		{
+			const size_t end = count & ~size_t( 31 );
+
+			// Shuffling leaves each load's reds in dword q of both lanes, the permute puts the lanes back in order
+			__m256i masks[ 4 ];
+			for ( int q = 0; q < 4; ++q )
+			{
+				alignas( 32 ) int8_t bytes[ 32 ];
+				for ( int i = 0; i < 32; ++i )
+					bytes[ i ] = ( ( i & 15 ) >> 2 == q ) ? static_cast< int8_t >( ( i & 3 ) * 4 ) : -1;
+
+				masks[ q ] = _mm256_load_si256( reinterpret_cast< const __m256i* >( bytes ) );
+			}
+
+			const __m256i order = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+
+			for ( size_t i = 0; i < end; i += 32 )
+			{
+				const __m256i *texels = reinterpret_cast< const __m256i* >( rgba + i * 4 );
+				__m256i red = _mm256_setzero_si256();
+
+				for ( int q = 0; q < 4; ++q )
+					red = _mm256_or_si256( red, _mm256_shuffle_epi8( _mm256_loadu_si256( texels + q ), masks[ q ] ) );
+
+				_mm256_storeu_si256( reinterpret_cast< __m256i* >( dst + i ), _mm256_permutevar8x32_epi32( red, order ) );
+			}
+
+			PackScalar( rgba, dst, end, count, channels );
+		}
+		else
+		{
+			const size_t end = count & ~size_t( 15 );
+
+			const __m256i lo = _mm256_setr_epi8( 0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1 );
+			const __m256i hi = _mm256_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 4, 5, 8, 9, 12, 13 );
+
+			for ( size_t i = 0; i < end; i += 16 )
+			{
+				const __m256i *texels = reinterpret_cast< const __m256i* >( rgba + i * 4 );
+				const __m256i redGreen = _mm256_or_si256( _mm256_shuffle_epi8( _mm256_loadu_si256( texels ), lo ), _mm256_shuffle_epi8( _mm256_loadu_si256( texels + 1 ), hi ) );
+
+				// Quadwords come out as texels 0-3, 8-11, 4-7, 12-15
+				_mm256_storeu_si256( reinterpret_cast< __m256i* >( dst + i * 2 ), _mm256_permute4x64_epi64( redGreen, 0xD8 ) );
+			}
+
+			PackScalar( rgba, dst, end, count, channels );
+		}
+	}
+
+	PIXELKERNELS_TARGET( "ssse3" )
+	bool IsOpaqueSSSE3( const uint8_t *rgba, size_t count )
+	{
+		const __m128i colorBits = _mm_set1_epi32( 0x00FFFFFF );
+		const size_t end = count & ~size_t( 15 );
+
+		for ( size_t i = 0; i < end; i += 16 )
+		{
+			const __m128i *texels = reinterpret_cast< const __m128i* >( rgba + i * 4 );
+			__m128i all = _mm_set1_epi32( -1 );
+
+			for ( int q = 0; q < 4; ++q )
+				all = _mm_and_si128( all, _mm_loadu_si128( texels + q ) );
+
+			if ( _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_or_si128( all, colorBits ), _mm_set1_epi32( -1 ) ) ) != 0xFFFF )
+				return false;
+		}
+
+		return IsOpaqueScalar( rgba, end, count );
+	}
+
+	PIXELKERNELS_TARGET( "avx2" )
+	bool IsOpaqueAVX2( const uint8_t *rgba, size_t count )
+	{
+		const __m256i colorBits = _mm256_set1_epi32( 0x00FFFFFF );
+		const size_t end = count & ~size_t( 31 );
+
+		for ( size_t i = 0; i < end; i += 32 )
+		{
+			const __m256i *texels = reinterpret_cast< const __m256i* >( rgba + i * 4 );
+			__m256i all = _mm256_set1_epi32( -1 );
+
+			for ( int q = 0; q < 4; ++q )
+				all = _mm256_and_si256( all, _mm256_loadu_si256( texels + q ) );
+
+			if ( _mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_or_si256( all, colorBits ), _mm256_set1_epi32( -1 ) ) ) != -1 )
+				return false;
+		}
+
+		return IsOpaqueScalar( rgba, end, count );
+	}
+
+	Isa DetectIsa()
+	{
+#ifdef _MSC_VER
+		int info[ 4 ] = {};
+		__cpuid( info, 0 );
+		const int maxLeaf = info[ 0 ];
+
+		__cpuid( info, 1 );
+		const bool ssse3 = ( info[ 2 ] & ( 1 << 9 ) ) != 0;
+		const bool osxsave = ( info[ 2 ] & ( 1 << 27 ) ) != 0;
+
+		bool avx2 = false;
+
+		// AVX2 also needs the OS to save the upper halves of the registers
+		if ( maxLeaf >= 7 && osxsave && ( _xgetbv( 0 ) & 6 ) == 6 )
+		{
+			__cpuidex( info, 7, 0 );
+			avx2 = ( info[ 1 ] & ( 1 << 5 ) ) != 0;
+		}
+#else
+		__builtin_cpu_init();
+		const bool ssse3 = __builtin_cpu_supports( "ssse3" );
+		const bool avx2 = __builtin_cpu_supports( "avx2" );
+#endif
+		return avx2 ? Isa::AVX2 : ssse3 ? Isa::SSSE3 : Isa::Scalar;
+	}
+#else
+	Isa DetectIsa()
+	{
+		return Isa::Scalar;
+	}
+#endif
+}
+
+PixelKernels::Isa PixelKernels::GetIsa()
+{
+	static const Isa isa = DetectIsa();
+	return isa;
+}
+
+const char *PixelKernels::GetIsaName( Isa isa )
+{
+	switch ( isa )
+	{
+	case Isa::SSSE3:
+		return "SSSE3";
+	case Isa::AVX2:
+		return "AVX2";
+	default:
+		return "scalar";
+	}
+}
+
+void PixelKernels::ExpandToRGBA( const uint8_t *src, uint8_t *dst, size_t count, uint32_t channels, Isa isa /*= GetIsa()*/ )
+{
+	if ( channels == 4 ) {
+		if ( src != dst )
+			std::memcpy( dst, src, count * 4 );
+
+		return;
+	}
+
+#if PIXELKERNELS_X86
+	// No AVX2 version, shuffles can't cross 128 bit lanes and the extra loads and broadcasts made it slower than SSSE3
+	if ( isa != Isa::Scalar ) {
+		ExpandSSSE3( src, dst, count, channels );
+		return;
+	}
+#endif
+
+	ExpandScalar( src, dst, 0, count, channels );
+}
+
+void PixelKernels::SwizzleRGBA( uint8_t *rgba, size_t count, const uint8_t order[ 4 ], Isa isa /*= GetIsa()*/ )
+{
+#if PIXELKERNELS_X86
+	if ( isa == Isa::AVX2 ) {
+		SwizzleAVX2( rgba, count, order );
+		return;
+	}
+
+	if ( isa == Isa::SSSE3 ) {
+		SwizzleSSSE3( rgba, count, order );
+		return;
+	}
+#endif
+
+	SwizzleScalar( rgba, 0, count, order );
+}
+
+void PixelKernels::PackRGBA( const uint8_t *rgba, uint8_t *dst, size_t count, uint32_t channels, Isa isa /*= GetIsa()*/ )
+{
+#if PIXELKERNELS_X86
+	if ( isa == Isa::AVX2 ) {
+		PackAVX2( rgba, dst, count, channels );
+		return;
+	}
+
+	if ( isa == Isa::SSSE3 ) {
+		PackSSSE3( rgba, dst, count, channels );
+		return;
+	}
+#endif
+
+	PackScalar( rgba, dst, 0, count, channels );
+}
+
+bool PixelKernels::IsOpaque( const uint8_t *rgba, size_t count, Isa isa /*= GetIsa()*/ )
+{
+#if PIXELKERNELS_X86
+	if ( isa == Isa::AVX2 )
+		return IsOpaqueAVX2( rgba, count );
+
+	if ( isa == Isa::SSSE3 )
+		return IsOpaqueSSSE3( rgba, count );
+#endif
+
+	return IsOpaqueScalar( rgba, 0, count );
+}
+
+void PixelKernels::RunBenchmark( size_t texelCount )
+{
+	constexpr int Repeats = 20;
+
+	// An odd count so every kernel's scalar tail gets some work too
+	texelCount |= 1;
+
+	std::vector< uint8_t > source( texelCount * 4 );
+	std::mt19937 random( 1234 );
+
+	for ( uint8_t &byte : source )
+		byte = static_cast< uint8_t >( random() );
+
+	std::vector< uint8_t > reference( texelCount * 4 );
+	std::vector< uint8_t > result( texelCount * 4 );
+
+	Log::Println( "[PixelKernels]Benchmark: {} texels, best is {}", texelCount, GetIsaName( GetIsa() ) );
+
+	auto run = [ & ]( const char *name, const std::function< void( Isa, std::vector< uint8_t >& ) > &kernel )
+	{
+		// Not every kernel writes the whole buffer
+		std::fill( reference.begin(), reference.end(), uint8_t( 0 ) );
+		kernel( Isa::Scalar, reference );
+
+		for ( int isaIndex = 0; isaIndex <= static_cast< int >( GetIsa() ); ++isaIndex )
+		{
+			const Isa isa = static_cast< Isa >( isaIndex );
+			std::fill( result.begin(), result.end(), uint8_t( 0 ) );
+
+			Clock clock;
+			clock.Start();
+
+			for ( int repeat = 0; repeat < Repeats; ++repeat )
+				kernel( isa, result );
+
+			const double seconds = clock.Duration< double >();
+			const bool matches = ( result == reference );
+
+			if ( matches )
+				Log::Println( "\t{} {}: {:.0f} Mtexels/s", name, GetIsaName( isa ), texelCount * Repeats / seconds / 1e6 );
+			else
+				Log::PrintlnWarn( "\t{} {}: doesn't match the scalar kernel", name, GetIsaName( isa ) );
+		}
+	};
+
+	for ( uint32_t channels = 1; channels <= 3; ++channels )
+	{
+		const std::string name = fmt::format( "ExpandToRGBA {}ch", channels );
+
+		run( name.c_str(), [ & ]( Isa isa, std::vector< uint8_t > &out )
+		{
+			ExpandToRGBA( source.data(), out.data(), texelCount, channels, isa );
+		} );
+
+		run( ( name + " in place" ).c_str(), [ & ]( Isa isa, std::vector< uint8_t > &out )
+		{
+			std::memcpy( out.data(), source.data(), texelCount * channels );
+			ExpandToRGBA( out.data(), out.data(), texelCount, channels, isa );
+		} );
+	}
+
+	const uint8_t alphaToGreen[ 4 ] = { 0, 3, 2, 3 };
+
+	run( "SwizzleRGBA", [ & ]( Isa isa, std::vector< uint8_t > &out )
+	{
+		std::memcpy( out.data(), source.data(), source.size() );
+		SwizzleRGBA( out.data(), texelCount, alphaToGreen, isa );
+	} );
+
+	for ( uint32_t channels = 1; channels <= 2; ++channels )
+	{
+		run( fmt::format( "PackRGBA {}ch", channels ).c_str(), [ & ]( Isa isa, std::vector< uint8_t > &out )
+		{
+			PackRGBA( source.data(), out.data(), texelCount, channels, isa );
+		} );
+	}
+
+	// Opaque all the way through so nothing returns early, then with the last texel translucent
+	std::vector< uint8_t > opaque( source );
+	for ( size_t i = 3; i < opaque.size(); i += 4 )
+		opaque[ i ] = 255;
+
+	run( "IsOpaque", [ & ]( Isa isa, std::vector< uint8_t > &out )
+	{
+		opaque.back() = 255;
+		out[ 0 ] = IsOpaque( opaque.data(), texelCount, isa );
+
+		opaque.back() = 254;
+		out[ 1 ] = IsOpaque( opaque.data(), texelCount, isa );
+	} );
+}
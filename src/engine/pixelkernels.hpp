@@ -0,0 +1,40 @@
+#ifndef PIXELKERNELS_HPP
+#define PIXELKERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Per texel conversions between the layouts stb_image decodes to and the ones textures are stored in. Every kernel
+// has a scalar and an SSSE3 version, most an AVX2 one too, picked at runtime by what the CPU supports. They all give
+// the same output, the scalar one is the reference
+namespace PixelKernels
+{
+	enum class Isa
+	{
+		Scalar,
+		SSSE3,
+		AVX2
+	};
+
+	// Widest instruction set this CPU runs, checked once
+	Isa GetIsa();
+	const char *GetIsaName( Isa isa );
+
+	// 1, 2 or 3 channels to RGBA8 the same way stb_image does it, gray goes to every color channel and missing alpha
+	// is 255. Runs back to front, so 'dst' may be the same pointer as 'src' to expand in place
+	void ExpandToRGBA( const uint8_t *src, uint8_t *dst, size_t count, uint32_t channels, Isa isa = GetIsa() );
+
+	// Reorders the channels of RGBA8 texels in place, channel i takes what was in channel order[ i ]
+	void SwizzleRGBA( uint8_t *rgba, size_t count, const uint8_t order[ 4 ], Isa isa = GetIsa() );
+
+	// Keeps the first 1 or 2 channels of RGBA8 texels, 'dst' must not overlap 'rgba'
+	void PackRGBA( const uint8_t *rgba, uint8_t *dst, size_t count, uint32_t channels, Isa isa = GetIsa() );
+
+	// True when every texel's alpha is 255
+	bool IsOpaque( const uint8_t *rgba, size_t count, Isa isa = GetIsa() );
+
+	// Times every kernel on each instruction set the CPU has and checks the results against the scalar ones
+	void RunBenchmark( size_t texelCount );
+}
+
+#endif // PIXELKERNELS_HPP
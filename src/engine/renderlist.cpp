@@ -0,0 +1,110 @@
+#include "renderlist.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+
+uint64_t RenderList::MakeSortKey( RenderPass pass, uint32_t pipelineId, uint32_t materialId, size_t meshIndex, float depth )
+{
+	// Positive floats order the same as their bits, the top 16 keep the exponent and 7 bits of mantissa
+	uint32_t depthBits = 0;
+	if ( depth > 0.0f )
+		std::memcpy( &depthBits, &depth, sizeof( depthBits ) );
+
+	if ( ( pipelineId >> PipelineIdBits ) != 0 || ( materialId >> MaterialIdBits ) != 0 || ( meshIndex >> MeshIndexBits ) != 0 ) {
+		static std::atomic< bool > warned = false;
+
+		if ( !warned.exchange( true ) )
+			Log::PrintlnWarn( "[RenderList]Sort key field overflow (pipeline {}, material {}, mesh {}), draws will group less well", pipelineId, materialId, meshIndex );
+	}
+
+	return ( static_cast< uint64_t >( static_cast< uint32_t >( pass ) & 0x3 ) << 62 ) |
+		( static_cast< uint64_t >( pipelineId & ( ( 1u << PipelineIdBits ) - 1 ) ) << 52 ) |
+		( static_cast< uint64_t >( materialId & ( ( 1u << MaterialIdBits ) - 1 ) ) << 38 ) |
+		( static_cast< uint64_t >( meshIndex & ( ( 1u << MeshIndexBits ) - 1 ) ) << 16 ) |
+		static_cast< uint64_t >( depthBits >> 16 );
+}
+
+void RenderList::Add( const RenderInfo &renderInfo, uint64_t sortKey )
+{
+	entries.push_back( { sortKey, static_cast< uint32_t >( items.size() ) } );
+	items.push_back( renderInfo );
+}
+
+void RenderList::Sort()
+{
+	const size_t count = entries.size();
+
+	if ( count < 2 )
+		return;
+
+	scratch.resize( count );
+
+	// LSD radix sort on 8 bit digits, every digit's histogram is counted in a single pass over the keys
+	uint32_t histograms[ 8 ][ 256 ] = {};
+
+	for ( const Entry &entry : entries )
+	{
+		for ( uint32_t digit = 0; digit < 8; ++digit )
+			++histograms[ digit ][ ( entry.key >> ( digit * 8 ) ) & 0xFF ];
+	}
+
+	Entry *src = entries.data();
+	Entry *dst = scratch.data();
+
+	for ( uint32_t digit = 0; digit < 8; ++digit )
+	{
+		const uint32_t shift = digit * 8;
+		uint32_t *histogram = histograms[ digit ];
+
+		// Every key has the same digit here, the pass wouldn't move anything. Common for the high digits
+		if ( histogram[ ( src[ 0 ].key >> shift ) & 0xFF ] == count )
+			continue;
+
+		uint32_t offset = 0;
+		for ( uint32_t bucket = 0; bucket < 256; ++bucket )
+		{
+			const uint32_t bucketCount = histogram[ bucket ];
+			histogram[ bucket ] = offset;
+			offset += bucketCount;
+		}
+
+		for ( size_t i = 0; i < count; ++i )
+			dst[ histogram[ ( src[ i ].key >> shift ) & 0xFF ]++ ] = src[ i ];
+
+		std::swap( src, dst );
+	}
+
+	if ( src != entries.data() )
+		entries.swap( scratch );
+}
+
+void RenderList::Clear()
+{
+	items.clear();
+	entries.clear();
+}
+
+uint32_t SortIdPool::Acquire()
+{
+	std::lock_guard< std::mutex > lock( mutex );
+
+	if ( freeIds.empty() )
+		return nextId++;
+
+	std::pop_heap( freeIds.begin(), freeIds.end(), std::greater< uint32_t >() );
+	const uint32_t id = freeIds.back();
+	freeIds.pop_back();
+
+	return id;
+}
+
+void SortIdPool::Release( uint32_t id )
+{
+	std::lock_guard< std::mutex > lock( mutex );
+
+	freeIds.push_back( id );
+	std::push_heap( freeIds.begin(), freeIds.end(), std::greater< uint32_t >() );
+}
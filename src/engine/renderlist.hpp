@@ -3,18 +3,80 @@
 
 #include "glm/glm.hpp"
 #include "mesh.hpp"
-#include <set>
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
 
 struct RenderInfo
 {
 	Mesh *mesh = nullptr;
 	glm::mat4 modelMat = {};
+	uint32_t lod = 0;
+
+	// Index range to draw, an indexCount of 0 draws the whole LOD
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+};
+
+// Draws go through in this order, everything is opaque for now
+enum class RenderPass : uint32_t
+{
+	Opaque
+};
+
+// A frame's draws, queued into flat arrays that keep their capacity from frame to frame and radix sorted once by a
+// 64 bit key. Draws sharing a pipeline, then a material, then a mesh end up next to each other so recording can skip
+// binds, nearer draws of the same mesh go first
+class RenderList
+{
+public:
+	static constexpr uint32_t PipelineIdBits = 10;
+	static constexpr uint32_t MaterialIdBits = 14;
+	static constexpr uint32_t MeshIndexBits = 22;
+
+	// From the most significant bits down: pass 2, pipeline 10, material 14, mesh 22, depth 16. Ids too big for their
+	// field wrap, that costs grouping and is logged once. Depth is the view distance, anything behind the camera counts as 0
+	static uint64_t MakeSortKey( RenderPass pass, uint32_t pipelineId, uint32_t materialId, size_t meshIndex, float depth );
 
-	// These are used by std::multiset, and are not meant for general comparison
-	friend bool operator==( const RenderInfo &lhs, const RenderInfo &rhs ) { return lhs.mesh->GetMeshIndex() == rhs.mesh->GetMeshIndex(); }
-	friend bool operator< ( const RenderInfo &lhs, const RenderInfo &rhs ) { return lhs.mesh->GetMeshIndex() < rhs.mesh->GetMeshIndex(); }
+	void Add( const RenderInfo &renderInfo, uint64_t sortKey );
+
+	// Orders by key, draws with equal keys keep the order they were added in
+	void Sort();
+
+	// Keeps the memory around for the next frame
+	void Clear();
+
+	size_t Size() const { return entries.size(); }
+	bool Empty() const { return entries.empty(); }
+
+	// i-th draw in key order once sorted, in the order added before that
+	const RenderInfo &Get( size_t i ) const { return items[ entries[ i ].index ]; }
+
+private:
+	struct Entry
+	{
+		uint64_t key;
+		uint32_t index; // Into items
+	};
+
+	std::vector< RenderInfo > items;
+	std::vector< Entry > entries;
+	std::vector< Entry > scratch; // Radix sort's other buffer
 };
 
-using RenderList = std::multiset< RenderInfo >;
+// Hands out the smallest free id so sort ids stay as small as the number of live shaders or materials, instead of
+// counting every one ever created past what a sort key field holds. Thread safe
+class SortIdPool
+{
+public:
+	uint32_t Acquire();
+	void Release( uint32_t id );
+
+private:
+	std::mutex mutex;
+	std::vector< uint32_t > freeIds; // Min heap
+	uint32_t nextId = 0;
+};
 
-#endif // RENDERLIST_HPP
\ No newline at end of file
+#endif // RENDERLIST_HPP
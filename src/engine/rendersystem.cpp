@@ -4,9 +4,36 @@
 #include "glm/glm.hpp"
 #include "glm/gtx/transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
+#include "glm/gtc/constants.hpp"
 #include "material.hpp"
 #include "shadersystem.hpp"
 #include "shader.hpp"
+#include "texturesystem.hpp"
+#include "texturestreamer.hpp"
+#include "thread.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Draws per secondary command buffer, a change re-records at most this many
+static constexpr size_t MaxBucketDraws = 256;
+
+// Draws left to record before another thread is worth waking
+static constexpr size_t MinThreadDraws = 2048;
+
+// Fewer dirty buckets than this are recorded on the main thread
+static constexpr size_t MinThreadBuckets = 4;
+
+// Buckets not drawn for this many frames give their command buffer back
+static constexpr uint64_t BucketRetireFrames = 120;
+
+// FNV-1a, a word at a time
+static inline uint64_t HashCombine( uint64_t hash, uint64_t value )
+{
+	hash ^= value;
+	hash *= 1099511628211ull;
+	return hash;
+}
 
 void RenderSystem::configure( Engine *engine )
 {
@@ -16,6 +43,7 @@ void RenderSystem::configure( Engine *engine )
 	shaderSystem = engine->GetShaderSystem();
 	materialSystem = engine->GetMaterialSystem();
 	meshSystem = engine->GetMeshSystem();
+	textureStreamer = engine->GetTextureSystem()->GetStreamer();
 
 	commandBuffers.resize( vulkanSystem->numSwapChainImages );
 
@@ -35,7 +63,11 @@ void RenderSystem::configure( Engine *engine )
 	}
 
 	activeRenderList.resize( vulkanSystem->numSwapChainImages );
-	lastRenderList.resize( vulkanSystem->numSwapChainImages );
+	drawBuckets.resize( vulkanSystem->numSwapChainImages );
+	executedBuckets.resize( vulkanSystem->numSwapChainImages );
+
+	recordThreadCount = Thread::GetMaxThreads();
+	CreateRecordPools();
 
 	const float aspect = ( float )vulkanSystem->swapChainExtent.width / ( float )vulkanSystem->swapChainExtent.height;
 	renderView.viewMatrix = glm::mat4( 1.0f );
@@ -45,12 +77,15 @@ void RenderSystem::configure( Engine *engine )
 void RenderSystem::unconfigure( Engine *engine )
 {
 	WaitIdle();
+	ClearDrawBuckets();
+	DestroyRecordPools();
 
 	if ( commandBuffers.size() > 0 ) {
 		vkFreeCommandBuffers( vulkanSystem->device, vulkanSystem->commandPool, vulkanSystem->numSwapChainImages, commandBuffers.data() );
 		commandBuffers.clear();
 	}
 
+	textureStreamer = nullptr;
 	meshSystem = nullptr;
 	materialSystem = nullptr;
 	shaderSystem = nullptr;
@@ -66,8 +101,27 @@ void RenderSystem::WaitIdle()
 	}
 }
 
+void RenderSystem::QueueRender( const RenderInfo &renderInfo )
+{
+	Mesh *mesh = renderInfo.mesh;
+
+	if ( !mesh )
+		return;
+
+	Material *material = Material::ToMaterial( mesh->GetMaterial() );
+
+	const uint32_t pipelineId = ( material && material->GetShader() ) ? material->GetShader()->GetSortId() : 0;
+	const uint32_t materialId = material ? material->GetSortId() : 0;
+	const float depth = -( renderView.viewMatrix * ( renderInfo.modelMat * glm::vec4( mesh->boundsCenter, 1.0f ) ) ).z;
+
+	activeRenderList[ imageIndex ].Add( renderInfo, RenderList::MakeSortKey( RenderPass::Opaque, pipelineId, materialId, mesh->GetMeshIndex(), depth ) );
+}
+
 void RenderSystem::DrawMesh( IMesh *mesh, const glm::mat4 &modelMat )
 {
+	if ( textureStreamer )
+		NotifyTexturesVisible( Mesh::ToMesh( mesh ), modelMat );
+
 	QueueRender( RenderInfo{ Mesh::ToMesh( mesh ), modelMat } );
 }
 
@@ -76,16 +130,194 @@ void RenderSystem::DrawModel( IModel *model, const glm::mat4 &modelMat )
 {
 	Model *realModel = Model::ToModel( model );
 	for ( auto mesh : realModel->meshes )
-		DrawMesh( mesh, modelMat );
+	{
+		const uint32_t lod = SelectLOD( mesh, modelMat );
+
+		if ( textureStreamer )
+			NotifyTexturesVisible( mesh, modelMat );
+
+		if ( lod == 0 && !mesh->meshlets.empty() )
+			QueueVisibleMeshlets( mesh, modelMat );
+		else
+			QueueRender( RenderInfo{ mesh, modelMat, lod } );
+	}
+}
+
+// Gribb/Hartmann plane extraction, planes point inwards
+static std::array< glm::vec4, 6 > ExtractFrustumPlanes( const glm::mat4 &viewProj )
+{
+	const glm::mat4 m = glm::transpose( viewProj );
+	std::array< glm::vec4, 6 > planes = {
+		m[ 3 ] + m[ 0 ],
+		m[ 3 ] - m[ 0 ],
+		m[ 3 ] + m[ 1 ],
+		m[ 3 ] - m[ 1 ],
+		m[ 2 ], // Depth is 0 to 1
+		m[ 3 ] - m[ 2 ]
+	};
+
+	for ( auto &plane : planes )
+		plane /= glm::length( glm::vec3( plane ) );
+
+	return planes;
+}
+
+void RenderSystem::QueueVisibleMeshlets( Mesh *mesh, const glm::mat4 &modelMat )
+{
+	const std::array< glm::vec4, 6 > planes = ExtractFrustumPlanes( renderView.projectionMatrix * renderView.viewMatrix );
+	const glm::vec3 cameraPosition = glm::vec3( glm::inverse( renderView.viewMatrix )[ 3 ] );
+	const glm::mat3 normalMatrix = glm::mat3( modelMat );
+	const glm::vec3 axisScales = { glm::length( normalMatrix[ 0 ] ), glm::length( normalMatrix[ 1 ] ), glm::length( normalMatrix[ 2 ] ) };
+	const float scale = std::max( { axisScales.x, axisScales.y, axisScales.z } );
+
+	// Cones only survive rotation and uniform scale, non-uniform scale changes their angle and mirroring flips which
+	// side of a triangle the pipeline culls. Those draws and pipelines not culling back faces skip the cone test
+	Material *material = Material::ToMaterial( mesh->GetMaterial() );
+	const bool cullsBackFaces = material && material->GetShader() && material->GetShader()->GetCullMode() == VK_CULL_MODE_BACK_BIT;
+	const bool uniformScale = ( scale - std::min( { axisScales.x, axisScales.y, axisScales.z } ) ) <= scale * 1e-3f;
+	const bool coneCulling = cullsBackFaces && uniformScale && glm::determinant( normalMatrix ) > 0.0f;
+
+	auto isVisible = [ & ]( const Meshlet &meshlet )
+	{
+		const glm::vec3 center = glm::vec3( modelMat * glm::vec4( meshlet.center, 1.0f ) );
+		const float radius = meshlet.radius * scale;
+
+		for ( const auto &plane : planes )
+		{
+			if ( glm::dot( glm::vec3( plane ), center ) + plane.w < -radius )
+				return false;
+		}
+
+		if ( coneCulling && meshlet.coneCutoff < 1.0f )
+		{
+			const glm::vec3 axis = glm::normalize( normalMatrix * meshlet.coneAxis );
+			const glm::vec3 toCenter = center - cameraPosition;
+
+			if ( glm::dot( toCenter, axis ) >= meshlet.coneCutoff * glm::length( toCenter ) + radius )
+				return false;
+		}
+
+		return true;
+	};
+
+	RenderInfo range = { mesh, modelMat, 0, 0, 0 };
+
+	for ( const auto &meshlet : mesh->meshlets )
+	{
+		if ( !isVisible( meshlet ) )
+			continue;
+
+		if ( range.indexCount > 0 && range.firstIndex + range.indexCount == meshlet.firstIndex )
+		{
+			range.indexCount += meshlet.indexCount;
+			continue;
+		}
+
+		if ( range.indexCount > 0 )
+			QueueRender( range );
+
+		range.firstIndex = meshlet.firstIndex;
+		range.indexCount = meshlet.indexCount;
+	}
+
+	if ( range.indexCount > 0 )
+		QueueRender( range );
+}
+
+uint32_t RenderSystem::SelectLOD( Mesh *mesh, const glm::mat4 &modelMat )
+{
+	constexpr float LODErrorThreshold = 1.0f;
+	// Coarser LODs need to be this far under the threshold before we switch, keeps LODs from popping back and forth
+	constexpr float LODHysteresis = 0.75f;
+
+	const auto &lods = mesh->GetLODs();
+	if ( lods.size() <= 1 )
+		return 0;
+
+	const float scale = std::max( { glm::length( glm::vec3( modelMat[ 0 ] ) ), glm::length( glm::vec3( modelMat[ 1 ] ) ), glm::length( glm::vec3( modelMat[ 2 ] ) ) } );
+	const glm::vec4 viewCenter = renderView.viewMatrix * modelMat * glm::vec4( mesh->boundsCenter, 1.0f );
+	const float distance = std::max( glm::length( glm::vec3( viewCenter ) ) - mesh->boundsRadius * scale, 0.01f );
+
+	// World space error to pixels on screen, projectionMatrix[ 1 ][ 1 ] is cot( fovy / 2 )
+	const float pixelsPerUnit = renderView.projectionMatrix[ 1 ][ 1 ] * 0.5f * static_cast< float >( vulkanSystem->swapChainExtent.height ) / distance;
+	auto projectedError = [ & ]( uint32_t lod ) { return lods[ lod ].error * scale * pixelsPerUnit; };
+
+	std::vector< uint32_t > &instanceLODs = frameLODs[ mesh ];
+	uint32_t lod = 0;
+
+	if ( auto last = lastFrameLODs.find( mesh ); last != lastFrameLODs.end() && instanceLODs.size() < last->second.size() )
+		lod = std::min( last->second[ instanceLODs.size() ], static_cast< uint32_t >( lods.size() - 1 ) );
+
+	while ( lod > 0 && projectedError( lod ) > LODErrorThreshold )
+		--lod;
+
+	while ( lod + 1 < lods.size() && projectedError( lod + 1 ) < LODErrorThreshold * LODHysteresis )
+		++lod;
+
+	instanceLODs.push_back( lod );
+	return lod;
+}
+
+void RenderSystem::NotifyTexturesVisible( Mesh *mesh, const glm::mat4 &modelMat )
+{
+	Material *material = mesh->GetMaterial();
+
+	if ( !material ) {
+		return;
+	}
+
+	// Bounding sphere projected the same way as SelectLOD, a rough pixel count is all the streamer needs to order textures
+	const float scale = std::max( { glm::length( glm::vec3( modelMat[ 0 ] ) ), glm::length( glm::vec3( modelMat[ 1 ] ) ), glm::length( glm::vec3( modelMat[ 2 ] ) ) } );
+	const glm::vec4 viewCenter = renderView.viewMatrix * modelMat * glm::vec4( mesh->boundsCenter, 1.0f );
+	const float distance = std::max( glm::length( glm::vec3( viewCenter ) ) - mesh->boundsRadius * scale, 0.01f );
+	const float pixelsPerUnit = renderView.projectionMatrix[ 1 ][ 1 ] * 0.5f * static_cast< float >( vulkanSystem->swapChainExtent.height ) / distance;
+	const float radius = mesh->boundsRadius * scale * pixelsPerUnit;
+	const float screenArea = std::min( glm::pi< float >() * radius * radius, static_cast< float >( vulkanSystem->swapChainExtent.width ) * static_cast< float >( vulkanSystem->swapChainExtent.height ) );
+
+	for ( const auto &texture : material->textures )
+	{
+		if ( texture.second )
+			textureStreamer->NotifyVisible( texture.second, screenArea );
+	}
+}
+
+void RenderSystem::UpdateTextureDescriptors()
+{
+	const uint64_t generation = textureStreamer->GetGeneration();
+
+	const RenderList &renderList = activeRenderList[ imageIndex ];
+
+	for ( size_t i = 0; i < renderList.Size(); ++i )
+	{
+		Mesh *mesh = renderList.Get( i ).mesh;
+
+		if ( !mesh )
+			continue;
+
+		// InitMesh wrote the views of the time, recreating the descriptor sets resets this too
+		if ( mesh->textureGenerations.size() != mesh->descriptorSets.size() )
+			mesh->textureGenerations.assign( mesh->descriptorSets.size(), 0 );
+
+		if ( mesh->textureGenerations.empty() || mesh->textureGenerations[ imageIndex ] == generation )
+			continue;
+
+		Material::ToMaterial( mesh->GetMaterial() )->GetShader()->UpdateTextureDescriptors( imageIndex, mesh );
+		mesh->textureGenerations[ imageIndex ] = generation;
+	}
 }
 
 void RenderSystem::NotifyWindowResized( uint32_t width, uint32_t height )
 {
 	vulkanSystem->NotifyWindowResized( width, height );
 	ClearRenderLists();
+	ClearDrawBuckets();
+	DestroyRecordPools();
 
 	activeRenderList.resize( vulkanSystem->numSwapChainImages );
-	lastRenderList.resize( vulkanSystem->numSwapChainImages );
+	drawBuckets.resize( vulkanSystem->numSwapChainImages );
+	executedBuckets.resize( vulkanSystem->numSwapChainImages );
+
+	CreateRecordPools();
 }
 
 void RenderSystem::NotifyWindowMaximized()
@@ -101,7 +333,7 @@ void RenderSystem::NotifyWindowMinimized()
 void RenderSystem::BeginFrame()
 {
 	if ( isMinimized ) {
-		activeRenderList[ imageIndex ].clear();
+		activeRenderList[ imageIndex ].Clear();
 		return;
 	}
 
@@ -123,7 +355,15 @@ void RenderSystem::BeginFrame()
 
 void RenderSystem::EndFrame()
 {
+	// Meshes not drawn this frame drop out, keys are only compared so destroyed ones do no harm
+	lastFrameLODs.swap( frameLODs );
+	frameLODs.clear();
+
 	meshSystem->DestroyDeadMeshes();
+	vulkanSystem->geometryArena->Compact();
+
+	if ( textureStreamer )
+		textureStreamer->Update();
 	isReadyToDraw = false;
 }
 
@@ -133,11 +373,16 @@ void RenderSystem::DrawScene()
 		return;
 	}
 
+	// Once per frame, everything after walks the list in this order
+	activeRenderList[ imageIndex ].Sort();
+
 	UpdateUBOs();
 
-	// Record Command Buffer
-	if ( activeRenderList[ imageIndex ] != lastRenderList[ imageIndex ] )
-		RecordCommandBuffer();
+	// Streamed in mips come with a new image view, this has to happen before buckets are hashed
+	if ( textureStreamer )
+		UpdateTextureDescriptors();
+
+	RecordCommandBuffer();
 
 	VkSemaphore waitSemaphores[] = { vulkanSystem->imageAvailableSemaphores[ currentFrame ] };
 	VkSubmitInfo submitInfo = {};
@@ -154,8 +399,13 @@ void RenderSystem::DrawScene()
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
+	// Uploads recorded since the last frame have to be on the queue ahead of anything that draws with them
+	vulkanSystem->uploadManager->Flush();
+
 	vkResetFences( vulkanSystem->device, 1, &vulkanSystem->inFlightFences[ currentFrame ] );
 
+	std::unique_lock< std::mutex > queueLock( vulkanSystem->graphicsQueueMutex );
+
 	if ( vkQueueSubmit( vulkanSystem->graphicsQueue, 1, &submitInfo, vulkanSystem->inFlightFences[ currentFrame ] ) != VK_SUCCESS ) {
 		Log::PrintlnWarn( "[Vulkan]Queue submit failed!" );
 		return;
@@ -175,8 +425,10 @@ void RenderSystem::DrawScene()
 		return;
 	}
 
-	lastRenderList[ imageIndex ] = activeRenderList[ imageIndex ];
-	activeRenderList[ imageIndex ].clear();
+	queueLock.unlock();
+
+	activeRenderList[ imageIndex ].Clear();
+	++frameNumber;
 		
 	currentFrame = ( currentFrame + 1 ) % MAX_FRAMES_IN_FLIGHT;
 
@@ -190,52 +442,142 @@ void RenderSystem::DrawScene()
 
 void RenderSystem::UpdateUBOs()
 {
-	for ( const auto &renderInfo : activeRenderList[ imageIndex ] )
+	UniformAllocator *uniformAllocator = vulkanSystem->uniformAllocator.get();
+	const RenderList &renderList = activeRenderList[ imageIndex ];
+
+	uniformAllocator->BeginFrame( imageIndex );
+
+	// Second time around only when the frame didn't fit, the uniforms are written again into the grown buffer
+	for ( int attempt = 0; attempt < 2; ++attempt )
 	{
-		auto mesh = renderInfo.mesh;
-		auto material = Material::ToMaterial( mesh->GetMaterial() );
-		auto shader = material->GetShader();
-		MVP mvp = {
-			renderInfo.modelMat,
-			renderView.viewMatrix,
-			renderView.projectionMatrix
-		};
+		const Mesh *lastMesh = nullptr;
+
+		for ( size_t i = 0; i < renderList.Size(); ++i )
+		{
+			const RenderInfo &renderInfo = renderList.Get( i );
+			auto mesh = renderInfo.mesh;
+
+			// Draws of the same mesh sort next to each other and share its uniforms
+			if ( mesh == lastMesh )
+				continue;
+
+			lastMesh = mesh;
+			auto material = Material::ToMaterial( mesh->GetMaterial() );
+			auto shader = material->GetShader();
+			MVP mvp = {
+				renderInfo.modelMat,
+				renderView.viewMatrix,
+				renderView.projectionMatrix
+			};
 
-		shader->Update( imageIndex, mvp, mesh );
+			if ( !mesh->uniformGenerations.empty() && mesh->uniformGenerations[ imageIndex ] != uniformAllocator->GetGeneration( imageIndex ) )
+				shader->UpdateUniformDescriptors( imageIndex, mesh );
+
+			shader->Update( imageIndex, mvp, mesh );
+		}
+
+		if ( !uniformAllocator->Overflowed() )
+			break;
+
+		uniformAllocator->Grow();
 	}
+
+	uniformAllocator->Flush();
 }
 
-void RenderSystem::RecordCommandBuffer()
+void RenderSystem::BuildBucketRanges()
 {
-	Log::PrintlnColor( fmt::color::blue, "Recording command buffer!" );
-	auto &commandBuffer = commandBuffers[ imageIndex ];
+	const RenderList &renderList = activeRenderList[ imageIndex ];
 
-	VkCommandBufferBeginInfo beginInfo = {};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-	beginInfo.pInheritanceInfo = nullptr; // Optional
+	// Compacting the geometry arena moves meshes, nothing recorded before it holds up
+	const uint64_t geometryGeneration = vulkanSystem->geometryArena->GetGeneration();
 
-	if ( vkBeginCommandBuffer( commandBuffer, &beginInfo ) != VK_SUCCESS ) {
-		engine->Error( "[Vulkan]Failed to create command buffers" );
-	}
+	bucketRanges.clear();
+	bucketChunks.clear();
+
+	const Material *material = nullptr;
+
+	for ( size_t i = 0; i < renderList.Size(); ++i )
+	{
+		const RenderInfo &renderInfo = renderList.Get( i );
+		const Mesh *mesh = renderInfo.mesh;
+
+		if ( !mesh )
+			continue;
+
+		const Material *drawMaterial = Material::ToMaterial( mesh->GetMaterial() );
+
+		if ( bucketRanges.empty() || drawMaterial != material || bucketRanges.back().last - bucketRanges.back().first == MaxBucketDraws ) {
+			material = drawMaterial;
+
+			// Counted per material, draws of one material only end up split by another's when their sort ids collide
+			BucketRange range;
+			range.key = { material, bucketChunks[ material ]++ };
+			range.first = i;
+			range.last = i;
+			range.hash = HashCombine( 14695981039346656037ull, geometryGeneration );
+			bucketRanges.push_back( range );
+		}
+
+		// Everything RecordDraws reads from the draw. Descriptor sets are rewritten when textures stream in or the uniform
+		// buffer grows, and uniform offsets move with every draw allocated ahead of them
+		const Shader *shader = material->GetShader();
+		const uint64_t textureGeneration = mesh->textureGenerations.empty() ? 0 : mesh->textureGenerations[ imageIndex ];
+		const uint64_t uniformGeneration = mesh->uniformGenerations.empty() ? 0 : mesh->uniformGenerations[ imageIndex ];
+
+		const uint64_t fields[] = {
+			( uint64_t )( shader->GetPipeline() ),
+			( uint64_t )( shader->GetPipelineLayout() ),
+			( uint64_t )( mesh->descriptorSets[ imageIndex ] ),
+			( uint64_t )( mesh->GetVertexBuffer() ),
+			( uint64_t )( mesh->GetIndexBuffer() ),
+			static_cast< uint64_t >( mesh->GetIndexType() ),
+			static_cast< uint64_t >( mesh->GetVertexOffset() ),
+			( static_cast< uint64_t >( mesh->GetFirstIndex() ) << 32 ) | mesh->GetVertexCount(),
+			( static_cast< uint64_t >( renderInfo.lod ) << 32 ) | renderInfo.firstIndex,
+			renderInfo.indexCount,
+			textureGeneration,
+			uniformGeneration,
+			( static_cast< uint64_t >( mesh->dynamicOffsets[ 0 ] ) << 32 ) | mesh->dynamicOffsets[ 1 ],
+			mesh->dynamicOffsetCount
+		};
+
+		BucketRange &range = bucketRanges.back();
 
-	VkRenderPassBeginInfo renderPassInfo = {};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassInfo.renderPass = vulkanSystem->renderPass;
-	renderPassInfo.framebuffer = vulkanSystem->swapChainFramebuffers[ imageIndex ];
-	renderPassInfo.renderArea.offset = { 0, 0 };
-	renderPassInfo.renderArea.extent = vulkanSystem->swapChainExtent;
+		for ( uint64_t field : fields )
+			range.hash = HashCombine( range.hash, field );
 
-	std::array< VkClearValue, 2 > clearValues;
-	clearValues[ 0 ].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-	clearValues[ 1 ].depthStencil = { 1.0f, 0 };
+		// Pushed into the command buffer, moving an object re-records its bucket
+		if ( shader->UsesDrawConstants() ) {
+			uint64_t model[ sizeof( glm::mat4 ) / sizeof( uint64_t ) ];
+			std::memcpy( model, &renderInfo.modelMat, sizeof( model ) );
 
-	renderPassInfo.clearValueCount = static_cast< uint32_t >( clearValues.size() );
-	renderPassInfo.pClearValues = clearValues.data();
+			for ( uint64_t word : model )
+				range.hash = HashCombine( range.hash, word );
+		}
 
-	vkCmdBeginRenderPass( commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE );
-	for ( const auto &renderInfo : activeRenderList[ imageIndex ] )
+		range.last = i + 1;
+	}
+}
+
+void RenderSystem::RecordDraws( VkCommandBuffer commandBuffer, size_t first, size_t last )
+{
+	// The list is sorted by pipeline, material and mesh, so only bind what changed from the draw before. Meshes share
+	// arena buffers too, those only change with the block or index type
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout boundPipelineLayout = VK_NULL_HANDLE;
+	VkDescriptorSet boundDescriptorSet = VK_NULL_HANDLE;
+	VkPipelineLayout pushedLayout = VK_NULL_HANDLE;
+	const glm::mat4 *pushedModel = nullptr;
+	VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+	VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+	VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+
+	const RenderList &renderList = activeRenderList[ imageIndex ];
+
+	for ( size_t i = first; i < last; ++i )
 	{
+		const RenderInfo &renderInfo = renderList.Get( i );
 		const auto mesh = renderInfo.mesh;
 
 		if ( !mesh )
@@ -248,33 +590,264 @@ void RenderSystem::RecordCommandBuffer()
 			auto material = Material::ToMaterial( mesh->GetMaterial() );
 			auto shader = material->GetShader();
 
-			vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shader->GetPipeline() );
-			vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shader->GetPipelineLayout(), 0, 1, &mesh->descriptorSets[ imageIndex ], 0, nullptr );
+			if ( shader->GetPipeline() != boundPipeline ) {
+				vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shader->GetPipeline() );
+				boundPipeline = shader->GetPipeline();
+			}
+
+			// Sets bound with another layout may have been disturbed by the pipeline change. Dynamic offsets are per mesh
+			// like the set, so a new set covers them too
+			if ( mesh->descriptorSets[ imageIndex ] != boundDescriptorSet || shader->GetPipelineLayout() != boundPipelineLayout ) {
+				vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shader->GetPipelineLayout(), 0, 1, &mesh->descriptorSets[ imageIndex ], mesh->dynamicOffsetCount, mesh->dynamicOffsets.data() );
+				boundDescriptorSet = mesh->descriptorSets[ imageIndex ];
+				boundPipelineLayout = shader->GetPipelineLayout();
+			}
+
+			// Meshlet ranges of a mesh share its model matrix, only push when it changes
+			if ( shader->UsesDrawConstants() && ( shader->GetPipelineLayout() != pushedLayout || !pushedModel || *pushedModel != renderInfo.modelMat ) ) {
+				const DrawConstants drawConstants = { renderInfo.modelMat };
+				const VkPushConstantRange range = Shader::GetDrawConstantRange();
 
-			const VkDeviceSize offset = 0;
-			vkCmdBindVertexBuffers( commandBuffer, 0, 1, &VertexBuffer, &offset );
+				vkCmdPushConstants( commandBuffer, shader->GetPipelineLayout(), range.stageFlags, range.offset, range.size, &drawConstants );
+				pushedLayout = shader->GetPipelineLayout();
+				pushedModel = &renderInfo.modelMat;
+			}
+
+			if ( VertexBuffer != boundVertexBuffer ) {
+				const VkDeviceSize offset = 0;
+				vkCmdBindVertexBuffers( commandBuffer, 0, 1, &VertexBuffer, &offset );
+				boundVertexBuffer = VertexBuffer;
+			}
 
 			if ( IndexBuffer != VK_NULL_HANDLE ) {
-				vkCmdBindIndexBuffer( commandBuffer, IndexBuffer, 0, VK_INDEX_TYPE_UINT32 );
-				vkCmdDrawIndexed( commandBuffer, mesh->GetIndexCount(), 1, 0, 0, 0 );
+				const MeshLOD &lod = mesh->GetLODs()[ std::min< size_t >( renderInfo.lod, mesh->GetLODs().size() - 1 ) ];
+				const uint32_t firstIndex = ( renderInfo.indexCount > 0 ) ? renderInfo.firstIndex : lod.firstIndex;
+				const uint32_t indexCount = ( renderInfo.indexCount > 0 ) ? renderInfo.indexCount : lod.indexCount;
+
+				if ( IndexBuffer != boundIndexBuffer || mesh->GetIndexType() != boundIndexType ) {
+					vkCmdBindIndexBuffer( commandBuffer, IndexBuffer, 0, mesh->GetIndexType() );
+					boundIndexBuffer = IndexBuffer;
+					boundIndexType = mesh->GetIndexType();
+				}
+
+				vkCmdDrawIndexed( commandBuffer, indexCount, 1, mesh->GetFirstIndex() + firstIndex, mesh->GetVertexOffset(), 0 );
 			}
 			else {
-				vkCmdDraw( commandBuffer, mesh->GetVertexCount(), 1, 0, 0 );
+				vkCmdDraw( commandBuffer, mesh->GetVertexCount(), 1, static_cast< uint32_t >( mesh->GetVertexOffset() ), 0 );
 			}
 		}
 	}
+}
+
+void RenderSystem::RecordBucket( const BucketRange &range, uint32_t pool )
+{
+	DrawBucket &bucket = *range.bucket;
+
+	if ( bucket.commandBuffer == VK_NULL_HANDLE ) {
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = recordPools[ imageIndex ][ pool ];
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		if ( vkAllocateCommandBuffers( vulkanSystem->device, &allocInfo, &bucket.commandBuffer ) != VK_SUCCESS ) {
+			engine->Error( "[Vulkan]Failed to allocate secondary command buffer" );
+		}
+
+		bucket.pool = pool;
+	}
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = vulkanSystem->renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = vulkanSystem->swapChainFramebuffers[ imageIndex ];
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	if ( vkBeginCommandBuffer( bucket.commandBuffer, &beginInfo ) != VK_SUCCESS ) {
+		engine->Error( "[Vulkan]Failed to begin secondary command buffer" );
+	}
+
+	RecordDraws( bucket.commandBuffer, range.first, range.last );
+
+	if ( vkEndCommandBuffer( bucket.commandBuffer ) != VK_SUCCESS ) {
+		engine->Error( "[Vulkan]Failed to record secondary command buffer" );
+	}
+
+	bucket.hash = range.hash;
+}
+
+void RenderSystem::RecordCommandBuffer()
+{
+	BuildBucketRanges();
+
+	auto &buckets = drawBuckets[ imageIndex ];
+	size_t dirtyDraws = 0;
+
+	dirtyBuckets.clear();
+
+	for ( BucketRange &range : bucketRanges )
+	{
+		DrawBucket &bucket = buckets[ range.key ];
+		bucket.lastUsedFrame = frameNumber;
+		range.bucket = &bucket;
+
+		if ( bucket.commandBuffer != VK_NULL_HANDLE && bucket.hash == range.hash )
+			continue;
+
+		dirtyBuckets.push_back( &range );
+		dirtyDraws += range.last - range.first;
+	}
+
+	// Each thread records a contiguous share of the dirty buckets from its own pool. A bucket whose buffer came from
+	// another thread's pool gets a new one, the old one is freed once the threads are done
+	const size_t dirtyCount = dirtyBuckets.size();
+	const size_t threadCount = dirtyCount < MinThreadBuckets ? 1 : std::clamp< size_t >( dirtyDraws / MinThreadDraws, 1, std::min( recordThreadCount, dirtyCount ) );
+
+	for ( size_t i = 0; i < dirtyCount; ++i )
+	{
+		DrawBucket &bucket = *dirtyBuckets[ i ]->bucket;
+		const uint32_t pool = static_cast< uint32_t >( i * threadCount / dirtyCount );
+
+		if ( bucket.commandBuffer != VK_NULL_HANDLE && bucket.pool != pool ) {
+			retiredBuckets.push_back( { bucket.pool, bucket.commandBuffer } );
+			bucket.commandBuffer = VK_NULL_HANDLE;
+		}
+	}
+
+	Thread::ParallelFor( threadCount, threadCount, [ & ]( size_t thread )
+	{
+		const size_t first = ( thread * dirtyCount + threadCount - 1 ) / threadCount;
+		const size_t last = ( ( thread + 1 ) * dirtyCount + threadCount - 1 ) / threadCount;
+
+		for ( size_t i = first; i < last; ++i )
+			RecordBucket( *dirtyBuckets[ i ], static_cast< uint32_t >( thread ) );
+	} );
+
+	for ( const auto &retired : retiredBuckets )
+		vkFreeCommandBuffers( vulkanSystem->device, recordPools[ imageIndex ][ retired.first ], 1, &retired.second );
+
+	retiredBuckets.clear();
+
+	frameBuckets.clear();
+
+	for ( const BucketRange &range : bucketRanges )
+		frameBuckets.push_back( range.bucket->commandBuffer );
+
+	const bool bucketsRecorded = dirtyCount > 0;
+
+	// Re-recording a secondary invalidates the primary executing it, same as a different set of them would
+	if ( bucketsRecorded || frameBuckets != executedBuckets[ imageIndex ] ) {
+		auto &commandBuffer = commandBuffers[ imageIndex ];
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		beginInfo.pInheritanceInfo = nullptr; // Optional
 
-	vkCmdEndRenderPass( commandBuffer );
+		if ( vkBeginCommandBuffer( commandBuffer, &beginInfo ) != VK_SUCCESS ) {
+			engine->Error( "[Vulkan]Failed to create command buffers" );
+		}
+
+		VkRenderPassBeginInfo renderPassInfo = {};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = vulkanSystem->renderPass;
+		renderPassInfo.framebuffer = vulkanSystem->swapChainFramebuffers[ imageIndex ];
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = vulkanSystem->swapChainExtent;
+
+		std::array< VkClearValue, 2 > clearValues;
+		clearValues[ 0 ].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+		clearValues[ 1 ].depthStencil = { 1.0f, 0 };
+
+		renderPassInfo.clearValueCount = static_cast< uint32_t >( clearValues.size() );
+		renderPassInfo.pClearValues = clearValues.data();
+
+		vkCmdBeginRenderPass( commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS );
+
+		if ( !frameBuckets.empty() )
+			vkCmdExecuteCommands( commandBuffer, static_cast< uint32_t >( frameBuckets.size() ), frameBuckets.data() );
+
+		vkCmdEndRenderPass( commandBuffer );
 
-	if ( vkEndCommandBuffer( commandBuffer ) != VK_SUCCESS ) {
-		engine->Error( "[Vulkan]Failed to create command buffers" );
+		if ( vkEndCommandBuffer( commandBuffer ) != VK_SUCCESS ) {
+			engine->Error( "[Vulkan]Failed to create command buffers" );
+		}
+
+		executedBuckets[ imageIndex ] = frameBuckets;
 	}
+
+	// Buckets left out of this image's primary aren't referenced anymore once it's re-recorded above
+	for ( auto it = buckets.begin(); it != buckets.end(); )
+	{
+		if ( frameNumber - it->second.lastUsedFrame < BucketRetireFrames ) {
+			++it;
+			continue;
+		}
+
+		vkFreeCommandBuffers( vulkanSystem->device, recordPools[ imageIndex ][ it->second.pool ], 1, &it->second.commandBuffer );
+		it = buckets.erase( it );
+	}
+}
+
+void RenderSystem::ClearDrawBuckets()
+{
+	WaitIdle();
+
+	for ( size_t image = 0; image < drawBuckets.size(); ++image )
+	{
+		for ( auto &bucket : drawBuckets[ image ] )
+		{
+			if ( bucket.second.commandBuffer != VK_NULL_HANDLE )
+				vkFreeCommandBuffers( vulkanSystem->device, recordPools[ image ][ bucket.second.pool ], 1, &bucket.second.commandBuffer );
+		}
+
+		drawBuckets[ image ].clear();
+	}
+
+	for ( auto &executed : executedBuckets )
+		executed.clear();
+}
+
+void RenderSystem::CreateRecordPools()
+{
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = vulkanSystem->queueFamilyIndices.graphicsFamily.value();
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	recordPools.resize( vulkanSystem->numSwapChainImages );
+
+	for ( auto &pools : recordPools )
+	{
+		pools.resize( recordThreadCount, VK_NULL_HANDLE );
+
+		for ( auto &pool : pools )
+		{
+			if ( vkCreateCommandPool( vulkanSystem->device, &poolInfo, nullptr, &pool ) != VK_SUCCESS ) {
+				engine->Error( "[Vulkan]Failed to create record command pool" );
+			}
+		}
+	}
+}
+
+void RenderSystem::DestroyRecordPools()
+{
+	for ( auto &pools : recordPools )
+	{
+		for ( auto &pool : pools )
+			vkDestroyCommandPool( vulkanSystem->device, pool, nullptr );
+	}
+
+	recordPools.clear();
 }
 
 void RenderSystem::ClearRenderLists()
 {
 	for ( auto &renderList : activeRenderList )
-		renderList.clear();
-	for ( auto &renderList : lastRenderList )
-		renderList.clear();
+		renderList.Clear();
 }
\ No newline at end of file
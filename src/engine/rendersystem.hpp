@@ -10,10 +10,15 @@
 #include "renderlist.hpp"
 #include "meshsystem.hpp"
 
+#include <map>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+class Material;
 class MaterialSystem;
 class ShaderSystem;
+class TextureStreamer;
 
 class RenderSystem : public IRenderSystem, public EngineSystem
 {
@@ -40,7 +45,7 @@ public:
 	MaterialSystem *GetMaterialSystem() const { return materialSystem; }
 	ShaderSystem *GetShaderSystem() const { return shaderSystem; }
 
-	void QueueRender( const RenderInfo &renderInfo ) { activeRenderList[ imageIndex ].insert( renderInfo ); }
+	void QueueRender( const RenderInfo &renderInfo );
 
 	void BeginFrame();
 	void EndFrame();
@@ -50,21 +55,89 @@ public:
 	void RecordCommandBuffer();
 
 private:
+	// Draws of one material, split every MaxBucketDraws, recorded into a secondary command buffer that's kept
+	// for as long as the draws it holds hash the same
+	using BucketKey = std::pair< const Material*, uint32_t >; // Material and which chunk of its draws
+
+	struct DrawBucket
+	{
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		uint32_t pool = 0; // Which of the image's record pools commandBuffer came from
+		uint64_t hash = 0;
+		uint64_t lastUsedFrame = 0;
+	};
+
+	// A bucket's slice of this frame's render list
+	struct BucketRange
+	{
+		BucketKey key;
+		size_t first = 0;
+		size_t last = 0;
+		uint64_t hash = 0;
+		DrawBucket *bucket = nullptr;
+	};
+
 	void ClearRenderLists();
 
+	// Frees every cached secondary command buffer, they're tied to the swap chain's render pass and framebuffers
+	void ClearDrawBuckets();
+
+	// One command pool per recording thread per swap chain image, command pools can only be used by one thread at a time
+	void CreateRecordPools();
+	void DestroyRecordPools();
+
+	// (Re-)records a bucket's secondary command buffer from the given pool, called from the recording threads
+	void RecordBucket( const BucketRange &range, uint32_t pool );
+
+	// Splits this frame's sorted render list into buckets and hashes what each would record
+	void BuildBucketRanges();
+
+	// Records draws first to last of this frame's render list, binding only what changes between them
+	void RecordDraws( VkCommandBuffer commandBuffer, size_t first, size_t last );
+
+	// Picks the coarsest LOD whose error projects to under LODErrorThreshold pixels, starting from what the same
+	// instance got last frame
+	uint32_t SelectLOD( Mesh *mesh, const glm::mat4 &modelMat );
+
+	// Queues only the meshlets inside the view frustum that have front facing triangles, merging neighbouring ones into a single draw
+	void QueueVisibleMeshlets( Mesh *mesh, const glm::mat4 &modelMat );
+
+	// Tells the texture streamer how much of the screen the mesh's textures cover
+	void NotifyTexturesVisible( Mesh *mesh, const glm::mat4 &modelMat );
+
+	// Rewrites descriptor sets of meshes in this frame's render list whose textures were streamed in since. That
+	// invalidates command buffers they're bound in, the texture generation is part of each bucket's hash for that
+	void UpdateTextureDescriptors();
+
 	VulkanSystem *vulkanSystem = nullptr;
 
 	ShaderSystem *shaderSystem = nullptr;
 	MaterialSystem *materialSystem = nullptr;
 	MeshSystem *meshSystem = nullptr;
+	TextureStreamer *textureStreamer = nullptr;
 
 	RenderView renderView = {};
 
 	std::vector< RenderList > activeRenderList;
-	std::vector< RenderList > lastRenderList;
+
+	// LODs picked per mesh in draw order, an instance is the n-th draw of its mesh in a frame. Kept for one frame
+	// for SelectLOD's hysteresis
+	std::unordered_map< const Mesh*, std::vector< uint32_t > > frameLODs;
+	std::unordered_map< const Mesh*, std::vector< uint32_t > > lastFrameLODs;
 
 	std::vector< VkCommandBuffer > commandBuffers;
 
+	std::vector< std::map< BucketKey, DrawBucket > > drawBuckets; // Per swap chain image
+	std::vector< std::vector< VkCommandBuffer > > executedBuckets; // Secondaries each primary was last recorded with, in order
+	std::vector< BucketRange > bucketRanges;
+	std::unordered_map< const Material*, uint32_t > bucketChunks; // Next chunk of each material's buckets this frame
+	std::vector< const BucketRange* > dirtyBuckets; // Ranges whose bucket has to be recorded this frame
+	std::vector< std::pair< uint32_t, VkCommandBuffer > > retiredBuckets; // Pool and buffer of buckets recorded on another thread now
+	std::vector< VkCommandBuffer > frameBuckets;
+	std::vector< std::vector< VkCommandPool > > recordPools; // [ swap chain image ][ recording thread ]
+	size_t recordThreadCount = 1;
+	uint64_t frameNumber = 0;
+
 	uint32_t imageIndex = 0;
 	uint32_t currentFrame = 0;
 
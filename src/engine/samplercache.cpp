@@ -0,0 +1,207 @@
+#include "samplercache.hpp"
+#include "vulkansystem.hpp"
+#include "engine.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+SamplerCache::SamplerCache( Engine *engine, VulkanSystem *vulkanSystem ) :
+	engine( engine ),
+	vulkanSystem( vulkanSystem )
+{
+	if ( vulkanSystem->SupportsSamplerAnisotropy() ) {
+		VkPhysicalDeviceProperties properties = {};
+		vkGetPhysicalDeviceProperties( vulkanSystem->physicalDevice, &properties );
+
+		maxAnisotropy = std::max( properties.limits.maxSamplerAnisotropy, 1.0f );
+	}
+}
+
+SamplerCache::~SamplerCache()
+{
+	for ( auto &entry : samplers )
+	{
+		if ( entry.second.references > 0 )
+			Log::PrintlnWarn( "[Vulkan]Sampler still has {} references at shutdown", entry.second.references );
+
+		vulkanSystem->DestroySampler( entry.second.sampler, nullptr );
+	}
+
+	samplers.clear();
+	samplerHashes.clear();
+}
+
+VkSamplerCreateInfo SamplerCache::GetDefaultCreateInfo()
+{
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.anisotropyEnable = VK_TRUE;
+	samplerInfo.maxAnisotropy = 16.0f;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	return samplerInfo;
+}
+
+VkSampler SamplerCache::Acquire( const VkSamplerCreateInfo &requestedInfo )
+{
+	// Clamped before hashing, requests the device can't tell apart share a sampler
+	const VkSamplerCreateInfo createInfo = ClampToDevice( requestedInfo );
+
+	std::lock_guard< std::mutex > lock( mutex );
+
+	const uint64_t hash = Hash( createInfo );
+	auto range = samplers.equal_range( hash );
+
+	for ( auto it = range.first; it != range.second; ++it )
+	{
+		if ( IsSameState( it->second.createInfo, createInfo ) ) {
+			++it->second.references;
+			return it->second.sampler;
+		}
+	}
+
+	Entry entry;
+	entry.createInfo = createInfo;
+	entry.createInfo.pNext = nullptr;
+	entry.references = 1;
+
+	vulkanSystem->CreateSampler( &entry.createInfo, nullptr, &entry.sampler );
+
+	samplerHashes[ entry.sampler ] = hash;
+	samplers.emplace( hash, entry );
+
+	Log::Println( "[Vulkan]Created a sampler, {} in use", samplers.size() );
+
+	return entry.sampler;
+}
+
+void SamplerCache::Release( VkSampler sampler )
+{
+	if ( sampler == VK_NULL_HANDLE ) {
+		return;
+	}
+
+	std::lock_guard< std::mutex > lock( mutex );
+
+	auto hash = samplerHashes.find( sampler );
+
+	if ( hash == samplerHashes.end() ) {
+		Log::PrintlnWarn( "[Vulkan]Released a sampler that didn't come from the sampler cache" );
+		return;
+	}
+
+	auto range = samplers.equal_range( hash->second );
+
+	for ( auto it = range.first; it != range.second; ++it )
+	{
+		if ( it->second.sampler != sampler )
+			continue;
+
+		if ( --it->second.references > 0 )
+			return;
+
+		// Only happens when the last user of a sampler state goes away, descriptor sets in flight may still use it
+		vulkanSystem->WaitIdle();
+		vulkanSystem->DestroySampler( sampler, nullptr );
+
+		samplers.erase( it );
+		samplerHashes.erase( hash );
+		return;
+	}
+}
+
+size_t SamplerCache::GetSamplerCount() const
+{
+	std::lock_guard< std::mutex > lock( mutex );
+	return samplers.size();
+}
+
+VkSamplerCreateInfo SamplerCache::ClampToDevice( const VkSamplerCreateInfo &createInfo ) const
+{
+	VkSamplerCreateInfo clamped = createInfo;
+
+	if ( clamped.anisotropyEnable == VK_TRUE ) {
+		clamped.maxAnisotropy = std::clamp( clamped.maxAnisotropy, 1.0f, maxAnisotropy );
+		clamped.anisotropyEnable = ( clamped.maxAnisotropy > 1.0f ) ? VK_TRUE : VK_FALSE;
+	}
+
+	// maxAnisotropy is ignored when it's off, normalize it so those states hash the same
+	if ( clamped.anisotropyEnable == VK_FALSE )
+		clamped.maxAnisotropy = 1.0f;
+
+	return clamped;
+}
+
+uint64_t SamplerCache::Hash( const VkSamplerCreateInfo &createInfo )
+{
+	// Field by field, hashing the struct's bytes would pick up padding and the pNext pointer
+	auto floatBits = []( float value )
+	{
+		uint32_t bits = 0;
+		std::memcpy( &bits, &value, sizeof( bits ) );
+		return bits;
+	};
+
+	const uint32_t fields[] = {
+		static_cast< uint32_t >( createInfo.flags ),
+		static_cast< uint32_t >( createInfo.magFilter ),
+		static_cast< uint32_t >( createInfo.minFilter ),
+		static_cast< uint32_t >( createInfo.mipmapMode ),
+		static_cast< uint32_t >( createInfo.addressModeU ),
+		static_cast< uint32_t >( createInfo.addressModeV ),
+		static_cast< uint32_t >( createInfo.addressModeW ),
+		floatBits( createInfo.mipLodBias ),
+		static_cast< uint32_t >( createInfo.anisotropyEnable ),
+		floatBits( createInfo.maxAnisotropy ),
+		static_cast< uint32_t >( createInfo.compareEnable ),
+		static_cast< uint32_t >( createInfo.compareOp ),
+		floatBits( createInfo.minLod ),
+		floatBits( createInfo.maxLod ),
+		static_cast< uint32_t >( createInfo.borderColor ),
+		static_cast< uint32_t >( createInfo.unnormalizedCoordinates )
+	};
+
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+
+	for ( uint32_t field : fields )
+	{
+		hash ^= field;
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+bool SamplerCache::IsSameState( const VkSamplerCreateInfo &a, const VkSamplerCreateInfo &b )
+{
+	return a.flags == b.flags &&
+		a.magFilter == b.magFilter &&
+		a.minFilter == b.minFilter &&
+		a.mipmapMode == b.mipmapMode &&
+		a.addressModeU == b.addressModeU &&
+		a.addressModeV == b.addressModeV &&
+		a.addressModeW == b.addressModeW &&
+		a.mipLodBias == b.mipLodBias &&
+		a.anisotropyEnable == b.anisotropyEnable &&
+		a.maxAnisotropy == b.maxAnisotropy &&
+		a.compareEnable == b.compareEnable &&
+		a.compareOp == b.compareOp &&
+		a.minLod == b.minLod &&
+		a.maxLod == b.maxLod &&
+		a.borderColor == b.borderColor &&
+		a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+}
@@ -0,0 +1,58 @@
+#ifndef SAMPLERCACHE_HPP
+#define SAMPLERCACHE_HPP
+
+#include <mutex>
+#include <unordered_map>
+
+#include <vulkan/vulkan.h>
+
+class Engine;
+class VulkanSystem;
+
+// Hands out one VkSampler per distinct sampler state instead of one per texture, drivers only allow so many
+// sampler objects to exist at once. Samplers are reference counted and destroyed with their last reference.
+// pNext chains aren't part of the key, create infos passed in must not have one
+class SamplerCache
+{
+public:
+	SamplerCache( Engine *engine, VulkanSystem *vulkanSystem );
+	~SamplerCache();
+
+	// Linear filtering, repeat addressing and 16x anisotropy. maxLod is left unclamped so textures with any
+	// number of mips share it, the image view limits the levels anyway
+	static VkSamplerCreateInfo GetDefaultCreateInfo();
+
+	// Returns a sampler with this state, creating it the first time it's asked for. Anisotropy is clamped to what the
+	// device allows and turned off without the samplerAnisotropy feature. Thread safe
+	VkSampler Acquire( const VkSamplerCreateInfo &createInfo );
+
+	// Drops a reference from Acquire, waits for the device before destroying a sampler's last one
+	void Release( VkSampler sampler );
+
+	size_t GetSamplerCount() const;
+
+private:
+	struct Entry
+	{
+		VkSamplerCreateInfo createInfo = {};
+		VkSampler sampler = VK_NULL_HANDLE;
+		size_t references = 0;
+	};
+
+	VkSamplerCreateInfo ClampToDevice( const VkSamplerCreateInfo &createInfo ) const;
+
+	static uint64_t Hash( const VkSamplerCreateInfo &createInfo );
+	static bool IsSameState( const VkSamplerCreateInfo &a, const VkSamplerCreateInfo &b );
+
+	Engine *engine = nullptr;
+	VulkanSystem *vulkanSystem = nullptr;
+
+	float maxAnisotropy = 1.0f; // 1 when anisotropic filtering isn't enabled
+
+	std::unordered_multimap< uint64_t, Entry > samplers; // Keyed by Hash, collisions are told apart by IsSameState
+	std::unordered_map< VkSampler, uint64_t > samplerHashes;
+
+	mutable std::mutex mutex;
+};
+
+#endif // SAMPLERCACHE_HPP
@@ -12,14 +12,19 @@
 #include <string_view>
 #include <algorithm>
 
+static SortIdPool shaderSortIds;
+
 Shader::Shader( VulkanSystem *vulkanSystem, const std::string &shaderName ) :
 	VulkanInterface( vulkanSystem ),
-	shaderName( shaderName )
+	shaderName( shaderName ),
+	sortId( shaderSortIds.Acquire() )
 {
 }
 
 Shader::~Shader()
 {
+	shaderSortIds.Release( sortId );
+
 	vulkanSystem->WaitIdle();
 
 	for ( auto &shaderModule : shaderModules )
@@ -48,7 +53,7 @@ VkDescriptorPool Shader::CreateDescriptorPool() const
 	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
 
 	std::array< VkDescriptorPoolSize, 2 > poolSizes;
-	poolSizes[ 0 ].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[ 0 ].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	poolSizes[ 0 ].descriptorCount = vulkanSystem->numSwapChainImages;
 	poolSizes[ 1 ].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	poolSizes[ 1 ].descriptorCount = vulkanSystem->numSwapChainImages;
@@ -11,7 +11,6 @@
 #include "vulkan/vulkan.h"
 #include "vk_mem_alloc.h"
 #include "glm/glm.hpp"
-#include "ubo.hpp"
 #include "log.hpp"
 #include "mesh.hpp"
 #include "vertex.hpp"
@@ -33,6 +32,12 @@ struct MVP
 	glm::mat4 proj;
 };
 
+// Per draw data that goes into the command buffer with vkCmdPushConstants instead of through uniform memory
+struct DrawConstants
+{
+	glm::mat4 model;
+};
+
 class Shader : public IShader, public VulkanInterface
 {
 	friend class RenderSystem;
@@ -44,7 +49,11 @@ public:
 
 	static inline Shader *ToShader( IShader *shader ) { return static_cast< Shader* >( shader ); }
 
-	inline virtual VertexLayout GetVertexLayout() const = 0;
+	// Runtime view of the shader's VertexFormat, see Shader_StaticMesh::Format
+	virtual const VertexLayout &GetVertexLayout() const = 0;
+
+	// Faces the pipeline culls, meshlet cone culling only applies to shaders culling back faces
+	virtual VkCullModeFlags GetCullMode() const = 0;
 
 	virtual VkDescriptorPool CreateDescriptorPool() const;
 	virtual void InitMaterial( Material &material ) = 0;
@@ -54,6 +63,9 @@ public:
 	const std::string &GetShaderName() const { return shaderName; }
 	const VkDescriptorSetLayout GetDescriptorSetLayout() const { return descriptorSetLayout; }
 
+	// Small id handed out in creation order, groups draws by pipeline in the render list
+	uint32_t GetSortId() const { return sortId; }
+
 private:
 	void onSwapChainResize() override final;
 	void DestroySwapChainElements();
@@ -67,12 +79,25 @@ protected:
 	VkPipelineLayout GetPipelineLayout() const { return pipelineLayout; }
 	VkPipeline GetPipeline() const { return pipeline; }
 
+	// Shaders that take DrawConstants return true and add GetDrawConstantRange to their pipeline layout,
+	// RenderSystem pushes them for every draw then
+	virtual bool UsesDrawConstants() const { return false; }
+	static VkPushConstantRange GetDrawConstantRange() { return { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof( DrawConstants ) }; }
+
 	virtual void CreateDescriptorSetLayout() = 0;
 	virtual void CreateGraphicsPipelineLayout() = 0;
 	virtual void CreateGraphicsPipeline() = 0;
 
+	// Writes the mesh's uniforms for this frame into slices of the UniformAllocator and sets its dynamicOffsets.
+	// Shaders taking DrawConstants get the model matrix from those instead of mvp.model
 	virtual void Update( const uint32_t imageIndex, const MVP &mvp, Mesh *mesh ) = 0;
 
+	// Points the mesh's descriptor set at the UniformAllocator's current buffer for this image
+	virtual void UpdateUniformDescriptors( const uint32_t, Mesh * ) {}
+
+	// Rewrites the mesh's texture descriptors for one swap image after a texture's view changed
+	virtual void UpdateTextureDescriptors( const uint32_t, Mesh * ) {}
+
 	void CreateShaderModules( FileSystem *fileSystem );
 
 	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
@@ -82,6 +107,7 @@ protected:
 
 private:
 	const std::string shaderName;
+	const uint32_t sortId;
 };
 
 #endif // SHADER_HPP
\ No newline at end of file
@@ -10,9 +10,9 @@ VkDescriptorPool Shader_StaticMesh::CreateDescriptorPool() const
 	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
 
 	std::array< VkDescriptorPoolSize, 3 > poolSizes;
-	poolSizes[ 0 ].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[ 0 ].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	poolSizes[ 0 ].descriptorCount = vulkanSystem->numSwapChainImages;
-	poolSizes[ 1 ].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[ 1 ].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	poolSizes[ 1 ].descriptorCount = vulkanSystem->numSwapChainImages;
 	poolSizes[ 2 ].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	poolSizes[ 2 ].descriptorCount = vulkanSystem->numSwapChainImages;
@@ -46,14 +46,9 @@ void Shader_StaticMesh::InitMesh( Mesh *mesh )
 	mesh->descriptorSets.resize( vulkanSystem->numSwapChainImages );
 	vulkanSystem->AllocateDescriptorSets( &allocInfo, mesh->descriptorSets.data() );
 
-	auto material = mesh->GetMaterial();
-
-	mesh->ubos.resize( (size_t)Uniforms::Count );
-	mesh->ubos[ (size_t)Uniforms::MVP ] = make_unique< UBO >( vulkanSystem, sizeof( glm::mat4 ) );
-	mesh->ubos[ (size_t)Uniforms::LightState ] = make_unique< UBO >( vulkanSystem, sizeof( glm::vec4 ) );
+	mesh->uniformGenerations.assign( vulkanSystem->numSwapChainImages, 0 );
 
-	auto ubo_mvp = mesh->ubos[ (size_t)Uniforms::MVP ].get();
-	auto ubo_lightState = mesh->ubos[ (size_t)Uniforms::LightState ].get();
+	auto material = mesh->GetMaterial();
 	auto diffuse = material->GetTexture( "diffuse" );
 
 	if ( !diffuse ) {
@@ -62,78 +57,120 @@ void Shader_StaticMesh::InitMesh( Mesh *mesh )
 
 	for ( uint32_t imageIndex = 0; imageIndex < vulkanSystem->numSwapChainImages; ++imageIndex )
 	{
-		VkDescriptorBufferInfo mvpBufferInfo = {};
-		mvpBufferInfo.buffer = ubo_mvp->uniformBuffer[ imageIndex ];
-		mvpBufferInfo.offset = 0;
-		mvpBufferInfo.range = ubo_mvp->BufferSize();
-
-		VkDescriptorBufferInfo lightStateBufferInfo = {};
-		lightStateBufferInfo.buffer = ubo_lightState->uniformBuffer[ imageIndex ];
-		lightStateBufferInfo.offset = 0;
-		lightStateBufferInfo.range = ubo_lightState->BufferSize();
+		UpdateUniformDescriptors( imageIndex, mesh );
 
 		VkDescriptorImageInfo imageInfo = {};
 		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
 		if ( diffuse ) {
 			imageInfo.imageView = diffuse->GetImageView();
-			imageInfo.sampler = diffuse->GetSampler();
+			imageInfo.sampler = material->GetSampler( "diffuse" );
 		}
 
-		std::array< VkWriteDescriptorSet, 3 > descriptorWrites = {};
-
-		descriptorWrites[ 0 ].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[ 0 ].dstSet = mesh->descriptorSets[ imageIndex ];
-		descriptorWrites[ 0 ].dstBinding = 0;
-		descriptorWrites[ 0 ].dstArrayElement = 0;
-		descriptorWrites[ 0 ].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrites[ 0 ].descriptorCount = 1;
-		descriptorWrites[ 0 ].pBufferInfo = &mvpBufferInfo;
-
-		descriptorWrites[ 1 ].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[ 1 ].dstSet = mesh->descriptorSets[ imageIndex ];
-		descriptorWrites[ 1 ].dstBinding = 1;
-		descriptorWrites[ 1 ].dstArrayElement = 0;
-		descriptorWrites[ 1 ].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrites[ 1 ].descriptorCount = 1;
-		descriptorWrites[ 1 ].pBufferInfo = &lightStateBufferInfo;
-
-		descriptorWrites[ 2 ].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[ 2 ].dstSet = mesh->descriptorSets[ imageIndex ];
-		descriptorWrites[ 2 ].dstBinding = 2;
-		descriptorWrites[ 2 ].dstArrayElement = 0;
-		descriptorWrites[ 2 ].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorWrites[ 2 ].descriptorCount = 1;
-		descriptorWrites[ 2 ].pImageInfo = &imageInfo;
-
-		vkUpdateDescriptorSets( vulkanSystem->device, static_cast< uint32_t >( descriptorWrites.size() ), descriptorWrites.data(), 0, nullptr );
+		VkWriteDescriptorSet descriptorWrite = {};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = mesh->descriptorSets[ imageIndex ];
+		descriptorWrite.dstBinding = 2;
+		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pImageInfo = &imageInfo;
+
+		vkUpdateDescriptorSets( vulkanSystem->device, 1, &descriptorWrite, 0, nullptr );
 	}
 }
 
-void Shader_StaticMesh::Update( const uint32_t imageIndex, const MVP &mvp, Mesh *mesh )
+void Shader_StaticMesh::Update( const uint32_t, const MVP &mvp, Mesh *mesh )
 {
-	auto ubo_mvp = mesh->ubos[ (size_t)Uniforms::MVP ]->uniformBufferAllocation[ imageIndex ];
-	auto ubo_lightState = mesh->ubos[ (size_t)Uniforms::LightState ]->uniformBufferAllocation[ imageIndex ];
+	UniformAllocator *uniformAllocator = vulkanSystem->uniformAllocator.get();
 
-	const glm::mat4 modelToClip = mvp.proj * mvp.view * mvp.model;
+	// The model matrix is pushed per draw, what's left is the same for every mesh and written once a frame
+	if ( uniformFrame != uniformAllocator->GetFrame() ) {
+		const glm::mat4 viewProj = mvp.proj * mvp.view;
+		const glm::vec4 ambientLight = { 1.0f, 1.0f, 1.0f, 1.0f };
 
-	if ( ubo_mvp != VK_NULL_HANDLE )
-	{
-		void *pData = nullptr;
-		vulkanSystem->VmaMapMemory( ubo_mvp, &pData );
-			std::memcpy( pData, &modelToClip, sizeof( modelToClip ) );
-		vulkanSystem->VmaUnmapMemory( ubo_mvp );
+		const UniformAllocator::Slice mvpSlice = uniformAllocator->Allocate( sizeof( viewProj ) );
+		const UniformAllocator::Slice lightStateSlice = uniformAllocator->Allocate( sizeof( ambientLight ) );
+
+		// Out of space, RenderSystem grows the buffer and updates everything again
+		if ( !mvpSlice.data || !lightStateSlice.data )
+			return;
+
+		std::memcpy( mvpSlice.data, &viewProj, sizeof( viewProj ) );
+		std::memcpy( lightStateSlice.data, &ambientLight, sizeof( ambientLight ) );
+
+		uniformOffsets[ (size_t)Uniforms::MVP ] = mvpSlice.offset;
+		uniformOffsets[ (size_t)Uniforms::LightState ] = lightStateSlice.offset;
+		uniformFrame = uniformAllocator->GetFrame();
 	}
 
-	const glm::vec4 ambientLight = { 1.0f, 1.0f, 1.0f, 1.0f };
+	mesh->dynamicOffsets[ (size_t)Uniforms::MVP ] = uniformOffsets[ (size_t)Uniforms::MVP ];
+	mesh->dynamicOffsets[ (size_t)Uniforms::LightState ] = uniformOffsets[ (size_t)Uniforms::LightState ];
+	mesh->dynamicOffsetCount = (uint32_t)Uniforms::Count;
+}
 
-	if ( ubo_lightState != VK_NULL_HANDLE )
-	{
-		void *pData = nullptr;
-		vulkanSystem->VmaMapMemory( ubo_lightState, &pData );
-			std::memcpy( pData, &ambientLight, sizeof( ambientLight ) );
-		vulkanSystem->VmaUnmapMemory( ubo_lightState );
+void Shader_StaticMesh::UpdateUniformDescriptors( const uint32_t imageIndex, Mesh *mesh )
+{
+	UniformAllocator *uniformAllocator = vulkanSystem->uniformAllocator.get();
+	const VkBuffer uniformBuffer = uniformAllocator->GetBuffer( imageIndex );
+
+	// Offsets come from the dynamic offsets at bind time
+	VkDescriptorBufferInfo mvpBufferInfo = {};
+	mvpBufferInfo.buffer = uniformBuffer;
+	mvpBufferInfo.offset = 0;
+	mvpBufferInfo.range = sizeof( glm::mat4 );
+
+	VkDescriptorBufferInfo lightStateBufferInfo = {};
+	lightStateBufferInfo.buffer = uniformBuffer;
+	lightStateBufferInfo.offset = 0;
+	lightStateBufferInfo.range = sizeof( glm::vec4 );
+
+	std::array< VkWriteDescriptorSet, 2 > descriptorWrites = {};
+
+	descriptorWrites[ 0 ].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[ 0 ].dstSet = mesh->descriptorSets[ imageIndex ];
+	descriptorWrites[ 0 ].dstBinding = 0;
+	descriptorWrites[ 0 ].dstArrayElement = 0;
+	descriptorWrites[ 0 ].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrites[ 0 ].descriptorCount = 1;
+	descriptorWrites[ 0 ].pBufferInfo = &mvpBufferInfo;
+
+	descriptorWrites[ 1 ].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[ 1 ].dstSet = mesh->descriptorSets[ imageIndex ];
+	descriptorWrites[ 1 ].dstBinding = 1;
+	descriptorWrites[ 1 ].dstArrayElement = 0;
+	descriptorWrites[ 1 ].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrites[ 1 ].descriptorCount = 1;
+	descriptorWrites[ 1 ].pBufferInfo = &lightStateBufferInfo;
+
+	vkUpdateDescriptorSets( vulkanSystem->device, static_cast< uint32_t >( descriptorWrites.size() ), descriptorWrites.data(), 0, nullptr );
+	mesh->uniformGenerations[ imageIndex ] = uniformAllocator->GetGeneration( imageIndex );
+}
+
+void Shader_StaticMesh::UpdateTextureDescriptors( const uint32_t imageIndex, Mesh *mesh )
+{
+	auto material = mesh->GetMaterial();
+	auto diffuse = material->GetTexture( "diffuse" );
+
+	if ( !diffuse ) {
+		return;
 	}
+
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = diffuse->GetImageView();
+	imageInfo.sampler = material->GetSampler( "diffuse" );
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = mesh->descriptorSets[ imageIndex ];
+	descriptorWrite.dstBinding = 2;
+	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pImageInfo = &imageInfo;
+
+	vkUpdateDescriptorSets( vulkanSystem->device, 1, &descriptorWrite, 0, nullptr );
 }
 
 void Shader_StaticMesh::CreateDescriptorSetLayout()
@@ -142,14 +179,14 @@ void Shader_StaticMesh::CreateDescriptorSetLayout()
 
 	VkDescriptorSetLayoutBinding mvpLayoutBinding = {};
 	mvpLayoutBinding.binding = 0;
-	mvpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	mvpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	mvpLayoutBinding.descriptorCount = 1;
 	mvpLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	mvpLayoutBinding.pImmutableSamplers = nullptr; // Optional
 
 	VkDescriptorSetLayoutBinding lightStateLayoutBinding = {};
 	lightStateLayoutBinding.binding = 1;
-	lightStateLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	lightStateLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	lightStateLayoutBinding.descriptorCount = 1;
 	lightStateLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	lightStateLayoutBinding.pImmutableSamplers = nullptr; // Optional
@@ -176,12 +213,14 @@ void Shader_StaticMesh::CreateDescriptorSetLayout()
 
 void Shader_StaticMesh::CreateGraphicsPipelineLayout()
 {
+	const VkPushConstantRange pushConstantRange = GetDrawConstantRange();
+
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutInfo.setLayoutCount = 1;
 	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = nullptr;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
 	vulkanSystem->CreatePipelineLayout( &pipelineLayoutInfo, nullptr, &pipelineLayout );
 }
@@ -202,9 +241,8 @@ void Shader_StaticMesh::CreateGraphicsPipeline()
 
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
 
-	const VertexLayout vertexLayout = GetVertexLayout();
-	VkVertexInputBindingDescription bindingDescription = vertexLayout.ToInputBindingDescription( 0 );
-	std::vector< VkVertexInputAttributeDescription > attribDescriptions = vertexLayout.ToInputAttributeDescriptions( 0 );
+	constexpr VkVertexInputBindingDescription bindingDescription = Format::InputBindingDescription( 0 );
+	constexpr auto attribDescriptions = Format::InputAttributeDescriptions( 0 );
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -245,7 +283,7 @@ void Shader_StaticMesh::CreateGraphicsPipeline()
 	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
 	//rasterizer.polygonMode = VK_POLYGON_MODE_LINE;
 	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT; // TODO: Revisit this
+	rasterizer.cullMode = GetCullMode();
 	//rasterizer.cullMode = VK_CULL_MODE_NONE;
 	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE; // TODO: Revisit this
 	rasterizer.depthBiasEnable = VK_FALSE;
@@ -8,33 +8,42 @@ class Shader_StaticMesh : public Shader
 public:
 	using Shader::Shader;
 
-	inline VertexLayout GetVertexLayout() const override {
-		return VertexLayout (
-			{
-				Vertex::Component::Position,
-				Vertex::Component::Color,
-				Vertex::Component::UV
-			}
-		);
-	}
+	// UVs stay 32-bit, our tiled level UVs run past +-16 where UVHalf drops below texel precision
+	using Format = VertexFormat<
+		Vertex::Component::Position,
+		Vertex::Component::ColorUnorm8,
+		Vertex::Component::UV
+	>;
+
+	const VertexLayout &GetVertexLayout() const override { return Format::Layout(); }
+	VkCullModeFlags GetCullMode() const override { return VK_CULL_MODE_BACK_BIT; } // TODO: Revisit this
 
 	VkDescriptorPool CreateDescriptorPool() const override;
 	void InitMaterial( Material &material ) override;
 	void InitMesh( Mesh *mesh ) override;
 
 	void Update( const uint32_t imageIndex, const MVP &mvp, Mesh *mesh ) override;
+	void UpdateUniformDescriptors( const uint32_t imageIndex, Mesh *mesh ) override;
+	void UpdateTextureDescriptors( const uint32_t imageIndex, Mesh *mesh ) override;
+
+	bool UsesDrawConstants() const override { return true; }
 
 	void CreateDescriptorSetLayout() override;
 	void CreateGraphicsPipelineLayout() override;
 	void CreateGraphicsPipeline() override;
 
 private:
+	// Binding order, also their place in the mesh's dynamicOffsets
 	enum class Uniforms : size_t
 	{
 		MVP,
 		LightState,
 		Count
 	};
+
+	// This frame's uniform slices, shared by every mesh drawn with the shader
+	uint64_t uniformFrame = 0;
+	std::array< uint32_t, (size_t)Uniforms::Count > uniformOffsets = {};
 };
 
 #endif // SHADER_STATICMESH_HPP
\ No newline at end of file
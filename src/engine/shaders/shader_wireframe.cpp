@@ -23,43 +23,53 @@ void Shader_Wireframe::InitMesh( Mesh *mesh )
 	mesh->descriptorSets.resize( vulkanSystem->numSwapChainImages );
 	vulkanSystem->AllocateDescriptorSets( &allocInfo, mesh->descriptorSets.data() );
 
-	mesh->ubos.resize( (size_t)Uniforms::Count );
-	mesh->ubos[ (size_t)Uniforms::MVP ] = make_unique< UBO >( vulkanSystem, sizeof( MVP ) );
-
-	auto ubo_mvp = mesh->ubos[ (size_t)Uniforms::MVP ].get();
+	mesh->uniformGenerations.assign( vulkanSystem->numSwapChainImages, 0 );
 
 	for ( uint32_t imageIndex = 0; imageIndex < vulkanSystem->numSwapChainImages; ++imageIndex )
-	{
-		VkDescriptorBufferInfo bufferInfo = {};
-		bufferInfo.buffer = ubo_mvp->uniformBuffer[ imageIndex ];
-		bufferInfo.offset = 0;
-		bufferInfo.range = ubo_mvp->BufferSize();
-
-		std::array< VkWriteDescriptorSet, 1 > descriptorWrites = {};
-
-		descriptorWrites[ 0 ].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[ 0 ].dstSet = mesh->descriptorSets[ imageIndex ];
-		descriptorWrites[ 0 ].dstBinding = 0;
-		descriptorWrites[ 0 ].dstArrayElement = 0;
-		descriptorWrites[ 0 ].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrites[ 0 ].descriptorCount = 1;
-		descriptorWrites[ 0 ].pBufferInfo = &bufferInfo;
-
-		vkUpdateDescriptorSets( vulkanSystem->device, static_cast< uint32_t >( descriptorWrites.size() ), descriptorWrites.data(), 0, nullptr );
-	}
+		UpdateUniformDescriptors( imageIndex, mesh );
 }
 
-void Shader_Wireframe::Update( const uint32_t imageIndex, const MVP &mvp, Mesh *mesh )
+void Shader_Wireframe::Update( const uint32_t, const MVP &mvp, Mesh *mesh )
 {
-	auto ubo_mvp = mesh->ubos[ (size_t)Uniforms::MVP ]->uniformBufferAllocation[ imageIndex ];
-
-	if ( ubo_mvp != VK_NULL_HANDLE )
-	{
-		void *pData = nullptr;
-		vulkanSystem->VmaMapMemory( ubo_mvp, &pData );
-			std::memcpy( pData, &mvp, sizeof( mvp ) );
-		vulkanSystem->VmaUnmapMemory( ubo_mvp );
+	UniformAllocator *uniformAllocator = vulkanSystem->uniformAllocator.get();
+
+	// The model matrix is pushed per draw, view and projection are written once a frame
+	if ( uniformFrame != uniformAllocator->GetFrame() ) {
+		const glm::mat4 viewProj = mvp.proj * mvp.view;
+		const UniformAllocator::Slice mvpSlice = uniformAllocator->Allocate( sizeof( viewProj ) );
+
+		// Out of space, RenderSystem grows the buffer and updates everything again
+		if ( !mvpSlice.data )
+			return;
+
+		std::memcpy( mvpSlice.data, &viewProj, sizeof( viewProj ) );
+
+		uniformOffsets[ (size_t)Uniforms::MVP ] = mvpSlice.offset;
+		uniformFrame = uniformAllocator->GetFrame();
 	}
+
+	mesh->dynamicOffsets[ (size_t)Uniforms::MVP ] = uniformOffsets[ (size_t)Uniforms::MVP ];
+	mesh->dynamicOffsetCount = (uint32_t)Uniforms::Count;
+}
+
+void Shader_Wireframe::UpdateUniformDescriptors( const uint32_t imageIndex, Mesh *mesh )
+{
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = vulkanSystem->uniformAllocator->GetBuffer( imageIndex );
+	bufferInfo.offset = 0; // Comes from the dynamic offset at bind time
+	bufferInfo.range = sizeof( glm::mat4 );
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = mesh->descriptorSets[ imageIndex ];
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pBufferInfo = &bufferInfo;
+
+	vkUpdateDescriptorSets( vulkanSystem->device, 1, &descriptorWrite, 0, nullptr );
+	mesh->uniformGenerations[ imageIndex ] = vulkanSystem->uniformAllocator->GetGeneration( imageIndex );
 }
 
 void Shader_Wireframe::CreateDescriptorSetLayout()
@@ -68,7 +78,7 @@ void Shader_Wireframe::CreateDescriptorSetLayout()
 
 	VkDescriptorSetLayoutBinding uboLayoutBinding = {};
 	uboLayoutBinding.binding = 0;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	uboLayoutBinding.descriptorCount = 1;
 	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
@@ -86,12 +96,14 @@ void Shader_Wireframe::CreateDescriptorSetLayout()
 
 void Shader_Wireframe::CreateGraphicsPipelineLayout()
 {
+	const VkPushConstantRange pushConstantRange = GetDrawConstantRange();
+
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutInfo.setLayoutCount = 1;
 	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = nullptr;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
 	vulkanSystem->CreatePipelineLayout( &pipelineLayoutInfo, nullptr, &pipelineLayout );
 }
@@ -112,9 +124,8 @@ void Shader_Wireframe::CreateGraphicsPipeline()
 
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
 
-	const VertexLayout vertexLayout = GetVertexLayout();
-	VkVertexInputBindingDescription bindingDescription = vertexLayout.ToInputBindingDescription( 0 );
-	std::vector< VkVertexInputAttributeDescription > attribDescriptions = vertexLayout.ToInputAttributeDescriptions( 0 );
+	constexpr VkVertexInputBindingDescription bindingDescription = Format::InputBindingDescription( 0 );
+	constexpr auto attribDescriptions = Format::InputAttributeDescriptions( 0 );
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -154,7 +165,7 @@ void Shader_Wireframe::CreateGraphicsPipeline()
 	rasterizer.rasterizerDiscardEnable = VK_FALSE;
 	rasterizer.polygonMode = VK_POLYGON_MODE_LINE;
 	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = VK_CULL_MODE_FRONT_BIT; // TODO: Revisit this
+	rasterizer.cullMode = GetCullMode();
 	//rasterizer.cullMode = VK_CULL_MODE_NONE;
 	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE; // TODO: Revisit this
 	rasterizer.depthBiasEnable = VK_FALSE;
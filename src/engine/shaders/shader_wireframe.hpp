@@ -8,19 +8,21 @@ class Shader_Wireframe : public Shader
 public:
 	using Shader::Shader;
 
-	inline VertexLayout GetVertexLayout() const override {
-		return VertexLayout (
-			{
-				Vertex::Component::Position,
-				Vertex::Component::Color
-			}
-		);
-	}
+	using Format = VertexFormat<
+		Vertex::Component::Position,
+		Vertex::Component::ColorUnorm8
+	>;
+
+	const VertexLayout &GetVertexLayout() const override { return Format::Layout(); }
+	VkCullModeFlags GetCullMode() const override { return VK_CULL_MODE_FRONT_BIT; } // TODO: Revisit this
 
 	void InitMaterial( Material &material ) override;
 	void InitMesh( Mesh *mesh ) override;
 
 	void Update( const uint32_t imageIndex, const MVP &mvp, Mesh *mesh ) override;
+	void UpdateUniformDescriptors( const uint32_t imageIndex, Mesh *mesh ) override;
+
+	bool UsesDrawConstants() const override { return true; }
 
 	void CreateDescriptorSetLayout() override;
 	void CreateGraphicsPipelineLayout() override;
@@ -32,6 +34,10 @@ private:
 		MVP,
 		Count
 	};
+
+	// This frame's uniform slices, shared by every mesh drawn with the shader
+	uint64_t uniformFrame = 0;
+	std::array< uint32_t, (size_t)Uniforms::Count > uniformOffsets = {};
 };
 
 #endif // SHADER_WIREFRAME_HPP
\ No newline at end of file
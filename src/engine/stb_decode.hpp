@@ -0,0 +1,13 @@
+#ifndef STB_DECODE_HPP
+#define STB_DECODE_HPP
+
+#include <cstddef>
+
+#include "stb_image.h"
+
+// Decodes an image straight into 'target', which has to be exactly width * height * desiredComponents bytes. stb_image
+// only returns memory it allocated itself, so 'target' is handed to it as the allocation of that size. When stb ends up
+// returning some other buffer, like after a conversion it can't do in place, that one is copied over instead. Thread safe
+bool decode_into_stb( const stbi_uc *buffer, int len, int desiredComponents, void *target, size_t targetSize );
+
+#endif // STB_DECODE_HPP
@@ -1,4 +1,82 @@
+#include "stb_decode.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// Set by decode_into_stb for the duration of a decode on this thread
+static thread_local unsigned char *decodeTarget = nullptr;
+static thread_local size_t decodeTargetSize = 0;
+static thread_local bool decodeTargetTaken = false;
+
+static void *malloc_stb( size_t size )
+{
+	if ( decodeTarget && !decodeTargetTaken && size == decodeTargetSize ) {
+		decodeTargetTaken = true;
+		return decodeTarget;
+	}
+
+	return std::malloc( size );
+}
+
+static void *realloc_stb( void *p, size_t size )
+{
+	// The target can't grow, move what's been written so far out to the heap
+	if ( p && p == decodeTarget )
+	{
+		void *moved = std::malloc( size );
+
+		if ( moved )
+			std::memcpy( moved, p, std::min( size, decodeTargetSize ) );
+
+		return moved;
+	}
+
+	return std::realloc( p, size );
+}
+
+static void free_stb( void *p )
+{
+	if ( p != decodeTarget )
+		std::free( p );
+}
+
+#define STBI_MALLOC( size ) malloc_stb( size )
+#define STBI_REALLOC( p, size ) realloc_stb( p, size )
+#define STBI_FREE( p ) free_stb( p )
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
-#include "vfile.hpp"
 
+bool decode_into_stb( const stbi_uc *buffer, int len, int desiredComponents, void *target, size_t targetSize )
+{
+	decodeTarget = static_cast< unsigned char* >( target );
+	decodeTargetSize = targetSize;
+	decodeTargetTaken = false;
+
+	int x = 0;
+	int y = 0;
+	int numComponents = 0;
+
+	stbi_uc *pixels = stbi_load_from_memory( buffer, len, &x, &y, &numComponents, desiredComponents );
+
+	decodeTarget = nullptr;
+	decodeTargetSize = 0;
+
+	if ( pixels == nullptr ) {
+		return false;
+	}
+
+	if ( pixels == target ) {
+		return true;
+	}
+
+	const bool sizeMatches = ( static_cast< size_t >( x ) * static_cast< size_t >( y ) * static_cast< size_t >( desiredComponents ) == targetSize );
+
+	if ( sizeMatches )
+		std::memcpy( target, pixels, targetSize );
+
+	stbi_image_free( pixels );
+
+	return sizeMatches;
+}
@@ -2,6 +2,9 @@
 #include "engine.hpp"
 #include "log.hpp"
 #include "rendersystem.hpp"
+#include "texturestreamer.hpp"
+
+#include <cstring>
 
 Texture::Texture( VulkanSystem *vulkanSystem ) :
 	vulkanSystem( vulkanSystem )
@@ -10,10 +13,14 @@ Texture::Texture( VulkanSystem *vulkanSystem ) :
 
 Texture::~Texture()
 {
+	// Stop streaming first so nothing gets recorded against the image after we've waited
+	if ( streamer )
+		streamer->Remove( this );
+
 	vulkanSystem->WaitIdle();
 
 	if ( textureSampler != VK_NULL_HANDLE ) {
-		vulkanSystem->DestroySampler( textureSampler, nullptr );
+		vulkanSystem->samplerCache->Release( textureSampler );
 		textureSampler = VK_NULL_HANDLE;
 	}
 
@@ -29,71 +36,122 @@ Texture::~Texture()
 	}
 }
 
-void Texture::LoadRGBA( const unsigned char *pPixels, uint32_t width, uint32_t height, bool bGenMipMaps /*= false*/ )
+VkComponentMapping Texture::GetComponentMapping( uint32_t channels )
 {
-	constexpr const uint32_t numChannels = 4;
-
-	if ( bGenMipMaps ) {
-		mipLevels = static_cast< uint32_t >( std::floor( std::log2( std::max( width, height ) ) ) ) + 1;
+	switch ( channels )
+	{
+	case 1:
+		return { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_ONE };
+	case 2:
+		return { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G };
+	default:
+		return { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY };
 	}
+}
 
-	VkDeviceSize imageSize = ( VkDeviceSize )width * ( VkDeviceSize )height * ( VkDeviceSize )numChannels;
+void Texture::LoadPixels( const unsigned char *pPixels, uint32_t width, uint32_t height, uint32_t channels, bool bGenMipMaps /*= false*/ )
+{
+	const UploadManager::Reservation staging = vulkanSystem->uploadManager->ReserveStaging( ( VkDeviceSize )width * ( VkDeviceSize )height * ( VkDeviceSize )channels );
+	std::memcpy( staging.data, pPixels, static_cast< size_t >( staging.size ) );
 
-	VkBuffer stagingBuffer = VK_NULL_HANDLE;
-	VmaAllocation stagingBufferAllocation = VK_NULL_HANDLE;
+	LoadPixels( staging, width, height, channels, bGenMipMaps );
+}
 
-	vulkanSystem->VmaCreateBuffer( imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, stagingBuffer, stagingBufferAllocation );
+void Texture::LoadPixels( const UploadManager::Reservation &staging, uint32_t width, uint32_t height, uint32_t channels, bool bGenMipMaps /*= false*/ )
+{
+	if ( bGenMipMaps ) {
+		mipLevels = static_cast< uint32_t >( std::floor( std::log2( std::max( width, height ) ) ) ) + 1;
+	}
 
-	void *pData = nullptr;
-	vulkanSystem->VmaMapMemory( stagingBufferAllocation, &pData );
-		std::memcpy( pData, pPixels, static_cast< size_t >( imageSize ) );
-	vulkanSystem->VmaUnmapMemory( stagingBufferAllocation );
+	// R8 and R8G8 can be blitted with linear filtering on every device, same as RGBA8
+	textureFormat = ( channels == 1 ) ? VK_FORMAT_R8_UNORM : ( channels == 2 ) ? VK_FORMAT_R8G8_UNORM : VK_FORMAT_R8G8B8A8_UNORM;
+	textureComponents = GetComponentMapping( channels );
 
 	vulkanSystem->VmaCreateImage2D(
 			width,
 			height,
 			mipLevels,
-			VK_FORMAT_R8G8B8A8_UNORM,
+			textureFormat,
 			VK_IMAGE_TILING_OPTIMAL,
 			VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 			VMA_MEMORY_USAGE_GPU_ONLY,
 			textureImage,
 			textureImageAllocation );
 
-	vulkanSystem->TransitionImageLayout( textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels );
-	vulkanSystem->CopyBufferToImage( stagingBuffer, textureImage, width, height );
+	// Layout transitions, the copy and the mip blits are all recorded into the current upload batch
+	vulkanSystem->uploadManager->UploadImage( staging, textureImage, textureFormat, width, height, mipLevels, bGenMipMaps );
 
-	// Generate Mipmaps
-	if ( bGenMipMaps ) {
-		vulkanSystem->GenerateMipMaps( textureImage, VK_FORMAT_R8G8B8A8_UNORM, width, height, mipLevels );
-	}
-	else {
-		vulkanSystem->TransitionImageLayout( textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels );
+	// Create Texture Image View
+	textureImageView = vulkanSystem->CreateImageView2D( textureImage, textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, 0, textureComponents );
+
+	CreateSampler();
+}
+
+void Texture::LoadCooked( const TextureCooker::View &cooked, uint32_t firstResidentMip /*= 0*/ )
+{
+	textureFormat = cooked.format;
+	textureComponents = GetComponentMapping( cooked.channels );
+	mipLevels = static_cast< uint32_t >( cooked.mips.size() );
+	residentMip = std::min( firstResidentMip, mipLevels - 1 );
+
+	// Finer mips that get streamed in later still need their memory now, the image can't grow
+	vulkanSystem->VmaCreateImage2D(
+			cooked.width,
+			cooked.height,
+			mipLevels,
+			cooked.format,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY,
+			textureImage,
+			textureImageAllocation );
+
+	UploadMips( cooked, residentMip, mipLevels - residentMip );
+
+	textureImageView = vulkanSystem->CreateImageView2D( textureImage, cooked.format, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels - residentMip, residentMip, textureComponents );
+
+	CreateSampler();
+}
+
+void Texture::UploadMips( const TextureCooker::View &cooked, uint32_t baseMipLevel, uint32_t levelCount )
+{
+	std::vector< VkBufferImageCopy > regions( levelCount );
+
+	// Mips are stored finest first, the levels we want are one contiguous run of the data
+	const uint64_t dataBegin = cooked.mips[ baseMipLevel ].offset;
+	const TextureCooker::Mip &lastMip = cooked.mips[ baseMipLevel + levelCount - 1 ];
+
+	for ( uint32_t i = 0; i < levelCount; ++i )
+	{
+		const TextureCooker::Mip &mip = cooked.mips[ baseMipLevel + i ];
+
+		VkBufferImageCopy &region = regions[ i ];
+		region.bufferOffset = mip.offset - dataBegin;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = baseMipLevel + i;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { mip.width, mip.height, 1 };
 	}
 
-	vulkanSystem->VmaDestroyBuffer( stagingBuffer, stagingBufferAllocation );
+	vulkanSystem->uploadManager->UploadImageMips( textureImage, cooked.format, cooked.data + dataBegin, lastMip.offset + lastMip.size - dataBegin, baseMipLevel, levelCount, regions );
+}
 
-	// Create Texture Image View
-	textureImageView = vulkanSystem->CreateImageView2D( textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels );
-
-	// Create Texture Sampler
-	VkSamplerCreateInfo samplerInfo = {};
-	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	samplerInfo.magFilter = VK_FILTER_LINEAR;
-	samplerInfo.minFilter = VK_FILTER_LINEAR;
-	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.anisotropyEnable = VK_TRUE;
-	samplerInfo.maxAnisotropy = 16.0f;
-	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-	samplerInfo.unnormalizedCoordinates = VK_FALSE;
-	samplerInfo.compareEnable = VK_FALSE;
-	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-	samplerInfo.mipLodBias = 0.0f;
-	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = static_cast< float >( mipLevels );
-
-	vulkanSystem->CreateSampler( &samplerInfo, nullptr, &textureSampler );
-}
\ No newline at end of file
+VkImageView Texture::SetResidentMip( uint32_t mip )
+{
+	const VkImageView oldView = textureImageView;
+
+	residentMip = mip;
+	textureImageView = vulkanSystem->CreateImageView2D( textureImage, textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels - residentMip, residentMip, textureComponents );
+
+	return oldView;
+}
+
+void Texture::CreateSampler()
+{
+	// Every texture samples the same way, materials that want something else override it per binding
+	textureSampler = vulkanSystem->samplerCache->Acquire( SamplerCache::GetDefaultCreateInfo() );
+}
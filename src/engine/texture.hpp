@@ -4,10 +4,12 @@
 #include "engine/itexture.hpp"
 #include "vulkansystem.hpp"
 #include "memory.hpp"
+#include "texturecooker.hpp"
 #include <vulkan/vulkan.h>
 #include <vk_mem_alloc.h>
 
 class RenderSystem;
+class TextureStreamer;
 
 class Texture : public ITexture
 {
@@ -17,7 +19,27 @@ public:
 
 	static inline Texture *ToTexture( ITexture *texture ) { return static_cast< Texture* >( texture ); }
 
-	void LoadRGBA( const unsigned char *pPixels, uint32_t width, uint32_t height, bool bGenMipMaps = false );
+	// Tightly packed 8 bit pixels with 1, 2 or 4 channels, laid out the way GetComponentMapping expects
+	void LoadPixels( const unsigned char *pPixels, uint32_t width, uint32_t height, uint32_t channels, bool bGenMipMaps = false );
+
+	// Same, with the pixels already written into staging memory from UploadManager::ReserveStaging. Thread safe
+	void LoadPixels( const UploadManager::Reservation &staging, uint32_t width, uint32_t height, uint32_t channels, bool bGenMipMaps = false );
+
+	// Uploads a cooked texture's mips as they are, nothing is generated on the GPU. Only mips from 'firstResidentMip'
+	// down are uploaded and visible through the view, TextureStreamer brings in the finer ones later
+	void LoadCooked( const TextureCooker::View &cooked, uint32_t firstResidentMip = 0 );
+
+	// Records the upload of 'levelCount' mips starting at 'baseMipLevel' into the current upload batch, thread safe
+	void UploadMips( const TextureCooker::View &cooked, uint32_t baseMipLevel, uint32_t levelCount );
+
+	// Recreates the view starting at 'mip', which has to be uploaded already. Returns the old view, frames in flight
+	// may still be using it so it's up to the caller to destroy it later
+	VkImageView SetResidentMip( uint32_t mip );
+	uint32_t GetResidentMip() const { return residentMip; }
+
+	// Gray images are stored in red, with alpha in green when they have it. The view swizzles them back out so
+	// shaders always see RGBA
+	static VkComponentMapping GetComponentMapping( uint32_t channels );
 
 	const VkImageView GetImageView() const { return textureImageView; }
 	const VkSampler GetSampler() const { return textureSampler; }
@@ -26,9 +48,16 @@ public:
 	VmaAllocation textureImageAllocation = VK_NULL_HANDLE;
 	VkImageView textureImageView = VK_NULL_HANDLE;
 	VkSampler textureSampler = VK_NULL_HANDLE;
+	VkFormat textureFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	VkComponentMapping textureComponents = {};
 	uint32_t mipLevels = 1;
+	uint32_t residentMip = 0; // Finest mip the view can see
 
 	VulkanSystem *vulkanSystem = nullptr;
+	TextureStreamer *streamer = nullptr; // Set while finer mips are still being streamed in
+
+private:
+	void CreateSampler();
 };
 
 #endif // TEXTURE_HPP
\ No newline at end of file
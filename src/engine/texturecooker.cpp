@@ -0,0 +1,365 @@
+#include "texturecooker.hpp"
+#include "thread.hpp"
+#include "pixelkernels.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || defined( _M_AMD64 )
+#include <emmintrin.h>
+#define TEXTURECOOKER_SSE2 1
+#endif
+
+namespace
+{
+	struct FileHeader
+	{
+		char magic[ 4 ];
+		uint32_t version;
+		uint64_t sourceHash;
+		uint32_t format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t channels;
+		uint32_t mipCount;
+	};
+
+	struct FileMip
+	{
+		uint32_t width;
+		uint32_t height;
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	constexpr char Magic[ 4 ] = { 'C', 'T', 'E', 'X' };
+
+	// Mip data starts on this boundary, enough for any block format and copy offset rules
+	constexpr uint64_t DataAlignment = 16;
+
+	// Decoding goes through a table per byte value, encoding through a 12 bit table, which is plenty for 8 bit output
+	constexpr int EncodeTableSize = 4096;
+
+	struct ConversionTables
+	{
+		std::array< float, 256 > srgbToLinear;
+		std::array< float, 256 > unormToFloat;
+		std::array< uint8_t, EncodeTableSize > linearToSrgb;
+		std::array< uint8_t, EncodeTableSize > floatToUnorm;
+
+		ConversionTables()
+		{
+			for ( int i = 0; i < 256; ++i )
+			{
+				const float c = i / 255.0f;
+				srgbToLinear[ i ] = ( c <= 0.04045f ) ? c / 12.92f : std::pow( ( c + 0.055f ) / 1.055f, 2.4f );
+				unormToFloat[ i ] = c;
+			}
+
+			for ( int i = 0; i < EncodeTableSize; ++i )
+			{
+				const float l = i / float( EncodeTableSize - 1 );
+				const float s = ( l <= 0.0031308f ) ? l * 12.92f : 1.055f * std::pow( l, 1.0f / 2.4f ) - 0.055f;
+				linearToSrgb[ i ] = static_cast< uint8_t >( std::clamp( s * 255.0f + 0.5f, 0.0f, 255.0f ) );
+				floatToUnorm[ i ] = static_cast< uint8_t >( std::clamp( l * 255.0f + 0.5f, 0.0f, 255.0f ) );
+			}
+		}
+	};
+
+	const ConversionTables &GetTables()
+	{
+		static const ConversionTables tables;
+		return tables;
+	}
+
+	inline uint64_t Rotl( uint64_t x, int r ) { return ( x << r ) | ( x >> ( 64 - r ) ); }
+
+	inline uint64_t Mix( uint64_t h )
+	{
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return h;
+	}
+}
+
+uint64_t TextureCooker::HashBytes( const void *data, size_t size )
+{
+	const unsigned char *bytes = static_cast< const unsigned char* >( data );
+
+	// Four independent lanes so the multiplies overlap, source images are hashed on every load
+	uint64_t lanes[ 4 ] = { 0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull, 0x27d4eb2f165667c5ull };
+	size_t offset = 0;
+
+	for ( ; offset + 32 <= size; offset += 32 )
+	{
+		for ( int lane = 0; lane < 4; ++lane )
+		{
+			uint64_t k = 0;
+			std::memcpy( &k, bytes + offset + lane * 8, sizeof( k ) );
+			lanes[ lane ] = Rotl( lanes[ lane ] ^ ( k * 0x87c37b91114253d5ull ), 31 ) * 0x4cf5ad432745937full;
+		}
+	}
+
+	uint64_t h = size ^ Rotl( lanes[ 0 ], 1 ) ^ Rotl( lanes[ 1 ], 7 ) ^ Rotl( lanes[ 2 ], 12 ) ^ Rotl( lanes[ 3 ], 18 );
+
+	for ( ; offset < size; ++offset )
+		h = ( h ^ bytes[ offset ] ) * 0x100000001b3ull;
+
+	return Mix( h );
+}
+
+void TextureCooker::DownsampleRGBA8( const unsigned char *src, uint32_t srcWidth, uint32_t srcHeight, unsigned char *dst, uint32_t dstWidth, uint32_t dstHeight, bool srgb )
+{
+	const ConversionTables &tables = GetTables();
+	const float *decode = srgb ? tables.srgbToLinear.data() : tables.unormToFloat.data();
+	const uint8_t *encode = srgb ? tables.linearToSrgb.data() : tables.floatToUnorm.data();
+	const float *alphaDecode = tables.unormToFloat.data();
+
+	const size_t srcPitch = size_t( srcWidth ) * 4;
+
+	for ( uint32_t y = 0; y < dstHeight; ++y )
+	{
+		const unsigned char *row0 = src + std::min( y * 2, srcHeight - 1 ) * srcPitch;
+		const unsigned char *row1 = src + std::min( y * 2 + 1, srcHeight - 1 ) * srcPitch;
+		unsigned char *out = dst + size_t( y ) * dstWidth * 4;
+
+		for ( uint32_t x = 0; x < dstWidth; ++x, out += 4 )
+		{
+			const size_t x0 = size_t( std::min( x * 2, srcWidth - 1 ) ) * 4;
+			const size_t x1 = size_t( std::min( x * 2 + 1, srcWidth - 1 ) ) * 4;
+			const unsigned char *p[ 4 ] = { row0 + x0, row0 + x1, row1 + x0, row1 + x1 };
+
+#if TEXTURECOOKER_SSE2
+			__m128 sum = _mm_setzero_ps();
+
+			for ( const unsigned char *texel : p )
+				sum = _mm_add_ps( sum, _mm_set_ps( alphaDecode[ texel[ 3 ] ], decode[ texel[ 2 ] ], decode[ texel[ 1 ] ], decode[ texel[ 0 ] ] ) );
+
+			// Average and scale to the encode table, cvtps rounds to nearest
+			const __m128i index = _mm_cvtps_epi32( _mm_mul_ps( sum, _mm_set1_ps( 0.25f * ( EncodeTableSize - 1 ) ) ) );
+
+			alignas( 16 ) int32_t i[ 4 ];
+			_mm_store_si128( reinterpret_cast< __m128i* >( i ), index );
+#else
+			float sum[ 4 ] = {};
+
+			for ( const unsigned char *texel : p )
+			{
+				sum[ 0 ] += decode[ texel[ 0 ] ];
+				sum[ 1 ] += decode[ texel[ 1 ] ];
+				sum[ 2 ] += decode[ texel[ 2 ] ];
+				sum[ 3 ] += alphaDecode[ texel[ 3 ] ];
+			}
+
+			int32_t i[ 4 ];
+			for ( int c = 0; c < 4; ++c )
+				i[ c ] = static_cast< int32_t >( sum[ c ] * 0.25f * ( EncodeTableSize - 1 ) + 0.5f );
+#endif
+			out[ 0 ] = encode[ i[ 0 ] ];
+			out[ 1 ] = encode[ i[ 1 ] ];
+			out[ 2 ] = encode[ i[ 2 ] ];
+			out[ 3 ] = tables.floatToUnorm[ i[ 3 ] ];
+		}
+	}
+}
+
+uint32_t TextureCooker::Options::GetKey() const
+{
+	return ( srgb ? 1u : 0u ) | ( normalMap ? 2u : 0u ) | ( compress ? 4u : 0u ) | ( static_cast< uint32_t >( quality ) << 3 );
+}
+
+void TextureCooker::Cook( const unsigned char *pixels, uint32_t width, uint32_t height, uint32_t channels, const Options &options, uint64_t sourceHash, std::vector< char > &file )
+{
+	// Same mip count the GPU path used, down to 1x1
+	uint32_t mipCount = 1;
+	while ( mipCount < MaxMipLevels && ( ( width >> mipCount ) > 0 || ( height >> mipCount ) > 0 ) )
+		++mipCount;
+
+	// The RGBA8 chain first, every level comes from the one above it like the blit chain did, but filtered in linear space
+	std::vector< Mip > rgbaMips( mipCount );
+	size_t rgbaSize = 0;
+
+	for ( uint32_t level = 0; level < mipCount; ++level )
+	{
+		Mip &mip = rgbaMips[ level ];
+		mip.width = std::max( width >> level, 1u );
+		mip.height = std::max( height >> level, 1u );
+		mip.offset = rgbaSize;
+		mip.size = uint64_t( mip.width ) * mip.height * 4;
+
+		rgbaSize += static_cast< size_t >( mip.size );
+	}
+
+	std::vector< unsigned char > rgba( rgbaSize );
+	PixelKernels::ExpandToRGBA( pixels, rgba.data(), size_t( width ) * height, channels );
+
+	const bool srgb = options.srgb && !options.normalMap;
+
+	for ( uint32_t level = 1; level < mipCount; ++level )
+	{
+		const Mip &srcMip = rgbaMips[ level - 1 ];
+		const Mip &dstMip = rgbaMips[ level ];
+		DownsampleRGBA8( rgba.data() + srcMip.offset, srcMip.width, srcMip.height, rgba.data() + dstMip.offset, dstMip.width, dstMip.height, srgb );
+	}
+
+	// Gray images were expanded to RGBA8 for filtering, only their first channel and alpha are stored
+	const uint32_t storedChannels = ( channels <= 2 && !options.normalMap ) ? std::max( channels, 1u ) : 4;
+
+	VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+	BcEncoder::Format bcFormat = BcEncoder::Format::BC1;
+
+	if ( storedChannels == 1 )
+	{
+		bcFormat = BcEncoder::Format::BC4;
+		format = options.compress ? BcEncoder::GetVkFormat( bcFormat ) : VK_FORMAT_R8_UNORM;
+	}
+	else if ( storedChannels == 2 )
+	{
+		// BC5 encodes red and green, so alpha moves over to green
+		const uint8_t alphaToGreen[ 4 ] = { 0, 3, 2, 3 };
+		PixelKernels::SwizzleRGBA( rgba.data(), rgba.size() / 4, alphaToGreen );
+
+		bcFormat = BcEncoder::Format::BC5;
+		format = options.compress ? BcEncoder::GetVkFormat( bcFormat ) : VK_FORMAT_R8G8_UNORM;
+	}
+	else if ( options.compress )
+	{
+		const bool hasAlpha = !PixelKernels::IsOpaque( rgba.data(), size_t( width ) * height );
+
+		if ( options.normalMap )
+			bcFormat = BcEncoder::Format::BC5;
+		else if ( hasAlpha )
+			bcFormat = ( options.quality == BcEncoder::Quality::Fast ) ? BcEncoder::Format::BC3 : BcEncoder::Format::BC7;
+		else
+			bcFormat = BcEncoder::Format::BC1;
+
+		format = BcEncoder::GetVkFormat( bcFormat );
+	}
+
+	std::vector< FileMip > mips( mipCount );
+	uint64_t dataSize = 0;
+
+	for ( uint32_t level = 0; level < mipCount; ++level )
+	{
+		FileMip &mip = mips[ level ];
+		mip.width = rgbaMips[ level ].width;
+		mip.height = rgbaMips[ level ].height;
+		mip.offset = dataSize;
+		mip.size = options.compress ? BcEncoder::GetImageSize( bcFormat, mip.width, mip.height ) : uint64_t( mip.width ) * mip.height * storedChannels;
+
+		dataSize += ( mip.size + DataAlignment - 1 ) / DataAlignment * DataAlignment;
+	}
+
+	const uint64_t headerSize = sizeof( FileHeader ) + sizeof( FileMip ) * mipCount;
+	const uint64_t dataStart = ( headerSize + DataAlignment - 1 ) / DataAlignment * DataAlignment;
+
+	file.assign( static_cast< size_t >( dataStart + dataSize ), 0 );
+
+	FileHeader header = {};
+	std::memcpy( header.magic, Magic, sizeof( Magic ) );
+	header.version = Version;
+	header.sourceHash = sourceHash;
+	header.format = format;
+	header.width = width;
+	header.height = height;
+	header.channels = storedChannels;
+	header.mipCount = mipCount;
+
+	std::memcpy( file.data(), &header, sizeof( header ) );
+	std::memcpy( file.data() + sizeof( header ), mips.data(), sizeof( FileMip ) * mipCount );
+
+	unsigned char *data = reinterpret_cast< unsigned char* >( file.data() + dataStart );
+
+	if ( !options.compress )
+	{
+		for ( uint32_t level = 0; level < mipCount; ++level )
+		{
+			const unsigned char *src = rgba.data() + rgbaMips[ level ].offset;
+			unsigned char *dst = data + mips[ level ].offset;
+
+			if ( storedChannels == 4 ) {
+				std::memcpy( dst, src, static_cast< size_t >( mips[ level ].size ) );
+				continue;
+			}
+
+			PixelKernels::PackRGBA( src, dst, size_t( mips[ level ].width ) * mips[ level ].height, storedChannels );
+		}
+
+		return;
+	}
+
+	// One job per block row across the whole chain, so the small mips don't each pay for spinning up threads
+	std::vector< std::pair< uint32_t, uint32_t > > rows;
+
+	for ( uint32_t level = 0; level < mipCount; ++level )
+	{
+		for ( uint32_t row = 0; row < ( mips[ level ].height + 3 ) / 4; ++row )
+			rows.emplace_back( level, row );
+	}
+
+	const size_t threadCount = options.threadCount ? options.threadCount : std::max< size_t >( std::thread::hardware_concurrency(), 1 );
+
+	Thread::ParallelFor( rows.size(), threadCount, [ & ]( size_t i )
+	{
+		const uint32_t level = rows[ i ].first;
+		const uint32_t row = rows[ i ].second;
+		const FileMip &mip = mips[ level ];
+		const size_t rowSize = size_t( ( mip.width + 3 ) / 4 ) * BcEncoder::GetBlockSize( bcFormat );
+
+		BcEncoder::EncodeBlockRow( rgba.data() + rgbaMips[ level ].offset, mip.width, mip.height, row, bcFormat, options.quality, data + mip.offset + row * rowSize );
+	} );
+}
+
+bool TextureCooker::Parse( const char *data, size_t size, uint64_t sourceHash, View &view )
+{
+	if ( size < sizeof( FileHeader ) ) {
+		return false;
+	}
+
+	FileHeader header = {};
+	std::memcpy( &header, data, sizeof( header ) );
+
+	if ( std::memcmp( header.magic, Magic, sizeof( Magic ) ) != 0 || header.version != Version || header.sourceHash != sourceHash ) {
+		return false;
+	}
+
+	if ( header.mipCount == 0 || header.mipCount > MaxMipLevels ) {
+		return false;
+	}
+
+	const uint64_t headerSize = sizeof( FileHeader ) + sizeof( FileMip ) * header.mipCount;
+	const uint64_t dataStart = ( headerSize + DataAlignment - 1 ) / DataAlignment * DataAlignment;
+
+	if ( size < dataStart ) {
+		return false;
+	}
+
+	view.format = static_cast< VkFormat >( header.format );
+	view.width = header.width;
+	view.height = header.height;
+	view.channels = header.channels;
+	view.data = reinterpret_cast< const unsigned char* >( data + dataStart );
+	view.dataSize = size - dataStart;
+	view.mips.resize( header.mipCount );
+
+	for ( uint32_t level = 0; level < header.mipCount; ++level )
+	{
+		FileMip fileMip = {};
+		std::memcpy( &fileMip, data + sizeof( FileHeader ) + sizeof( FileMip ) * level, sizeof( fileMip ) );
+
+		// A truncated write leaves mips pointing past the end
+		if ( fileMip.offset + fileMip.size > view.dataSize || fileMip.offset % DataAlignment != 0 ) {
+			return false;
+		}
+
+		view.mips[ level ] = Mip { fileMip.width, fileMip.height, fileMip.offset, fileMip.size };
+	}
+
+	return true;
+}
@@ -0,0 +1,67 @@
+#ifndef TEXTURECOOKER_HPP
+#define TEXTURECOOKER_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "bcencoder.hpp"
+
+// Cooked textures hold decoded texels with their whole mip chain already built, so loading one is a single
+// map of the file and a buffer to image copy per mip. Files are named after a hash of the source image
+namespace TextureCooker
+{
+	// Bump whenever the layout or the way mips are built changes, stale files are then recooked
+	constexpr uint32_t Version = 3;
+	constexpr uint32_t MaxMipLevels = 16;
+
+	struct Options
+	{
+		bool srgb = true; // Color data, mips are averaged in linear space
+		bool normalMap = false; // Cooked as BC5 when compressing, only red and green survive
+		bool compress = false;
+		BcEncoder::Quality quality = BcEncoder::Quality::Normal;
+		size_t threadCount = 0; // Encoder threads, 0 for one per core. Doesn't change the output
+
+		// Goes into the cache file name, so files cooked with other options are never picked up
+		uint32_t GetKey() const;
+	};
+
+	struct Mip
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint64_t offset = 0; // From the first mip's data
+		uint64_t size = 0;
+	};
+
+	// Points into a cooked file, only valid as long as its memory is
+	struct View
+	{
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t channels = 4; // 1 is gray in red, 2 is gray in red and alpha in green, see Texture::GetComponentMapping
+		std::vector< Mip > mips;
+		const unsigned char *data = nullptr;
+		uint64_t dataSize = 0;
+	};
+
+	// Hash of the source file, the cache key
+	uint64_t HashBytes( const void *data, size_t size );
+
+	// Downsamples an RGBA8 image by two in each dimension with a box filter, averaging in linear space when
+	// srgb is set. Odd edges are clamped, so any size down to 1x1 works
+	void DownsampleRGBA8( const unsigned char *src, uint32_t srcWidth, uint32_t srcHeight, unsigned char *dst, uint32_t dstWidth, uint32_t dstHeight, bool srgb );
+
+	// Builds the full mip chain of an 8 bit image with 1 to 4 channels, block compresses it if asked to and writes the
+	// cooked file into 'file'. Opaque color becomes BC1, color with alpha BC7 or BC3 at Fast quality, normal maps BC5.
+	// Gray sources keep only what they need: R8 or BC4 for gray, R8G8 or BC5 for gray with alpha
+	void Cook( const unsigned char *pixels, uint32_t width, uint32_t height, uint32_t channels, const Options &options, uint64_t sourceHash, std::vector< char > &file );
+
+	// Validates a cooked file against the source hash and fills in 'view', false if it's stale or broken
+	bool Parse( const char *data, size_t size, uint64_t sourceHash, View &view );
+}
+
+#endif // TEXTURECOOKER_HPP
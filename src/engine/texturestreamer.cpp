@@ -0,0 +1,190 @@
+#include "texturestreamer.hpp"
+#include "texture.hpp"
+#include "vulkansystem.hpp"
+#include "uploadmanager.hpp"
+#include "engine.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+
+// A view retired this frame can still be bound in every frame in flight, and in the other swap images'
+// descriptor sets until they're drawn next
+static constexpr uint64_t RetireFrames = MAX_FRAMES_IN_FLIGHT + 1;
+
+TextureStreamer::TextureStreamer( Engine *engine, VulkanSystem *vulkanSystem ) :
+	engine( engine ),
+	vulkanSystem( vulkanSystem )
+{
+	worker = std::thread( &TextureStreamer::WorkerThread, this );
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	mutex.lock();
+	stopping = true;
+	mutex.unlock();
+
+	wake.notify_all();
+	worker.join();
+
+	vulkanSystem->WaitIdle();
+
+	for ( auto &view : retiredViews )
+		vkDestroyImageView( vulkanSystem->device, view.first, nullptr );
+
+	retiredViews.clear();
+	entries.clear();
+}
+
+uint32_t TextureStreamer::GetFirstResidentMip( const TextureCooker::View &view )
+{
+	for ( uint32_t level = 0; level < view.mips.size(); ++level )
+	{
+		if ( view.mips[ level ].width <= ResidentTailSize && view.mips[ level ].height <= ResidentTailSize )
+			return level;
+	}
+
+	return view.mips.empty() ? 0 : static_cast< uint32_t >( view.mips.size() - 1 );
+}
+
+void TextureStreamer::Add( Texture *texture, unique_ptr< Source > source )
+{
+	auto entry = make_unique< Entry >();
+	entry->texture = texture;
+	entry->source = std::move( source );
+
+	texture->streamer = this;
+
+	std::lock_guard< std::mutex > lock( mutex );
+	entries[ texture ] = std::move( entry );
+}
+
+void TextureStreamer::Remove( Texture *texture )
+{
+	std::unique_lock< std::mutex > lock( mutex );
+
+	auto it = entries.find( texture );
+
+	if ( it == entries.end() ) {
+		return;
+	}
+
+	Entry *entry = it->second.get();
+
+	// The worker reads the source while it copies, let it finish
+	idle.wait( lock, [ this, entry ]() { return uploading != entry; } );
+
+	requests.erase( std::remove( requests.begin(), requests.end(), entry ), requests.end() );
+	submitted.erase( std::remove( submitted.begin(), submitted.end(), entry ), submitted.end() );
+
+	entries.erase( it );
+}
+
+void TextureStreamer::NotifyVisible( Texture *texture, float screenArea )
+{
+	if ( auto it = entries.find( texture ); it != entries.end() )
+		it->second->screenArea = std::max( it->second->screenArea, screenArea );
+}
+
+void TextureStreamer::Update()
+{
+	++frame;
+
+	while ( !retiredViews.empty() && retiredViews.front().second + RetireFrames <= frame )
+	{
+		vkDestroyImageView( vulkanSystem->device, retiredViews.front().first, nullptr );
+		retiredViews.pop_front();
+	}
+
+	std::unique_lock< std::mutex > lock( mutex );
+
+	bool swapped = false;
+
+	for ( auto it = submitted.begin(); it != submitted.end(); )
+	{
+		Entry *entry = *it;
+
+		if ( !vulkanSystem->uploadManager->IsComplete( entry->uploadSerial ) ) {
+			++it;
+			continue;
+		}
+
+		it = submitted.erase( it );
+
+		retiredViews.emplace_back( entry->texture->SetResidentMip( entry->loadingMip ), frame );
+		entry->streaming = false;
+		swapped = true;
+
+		// Fully resident, the cooked file isn't needed anymore
+		if ( entry->loadingMip == 0 )
+			entries.erase( entry->texture );
+	}
+
+	if ( swapped )
+		++generation;
+
+	const size_t pending = requests.size() + submitted.size() + ( uploading ? 1 : 0 );
+
+	if ( pending < MaxPendingUploads )
+	{
+		std::vector< Entry* > candidates;
+
+		for ( auto &it : entries )
+		{
+			if ( !it.second->streaming && it.second->screenArea > 0.0f )
+				candidates.push_back( it.second.get() );
+		}
+
+		const size_t count = std::min( candidates.size(), MaxPendingUploads - pending );
+
+		std::partial_sort( candidates.begin(), candidates.begin() + count, candidates.end(), []( const Entry *a, const Entry *b ) { return a->screenArea > b->screenArea; } );
+
+		for ( size_t i = 0; i < count; ++i )
+		{
+			Entry *entry = candidates[ i ];
+			entry->streaming = true;
+			entry->loadingMip = entry->texture->GetResidentMip() - 1;
+			requests.push_back( entry );
+		}
+	}
+
+	for ( auto &it : entries )
+		it.second->screenArea = 0.0f;
+
+	const bool queued = !requests.empty();
+	lock.unlock();
+
+	if ( queued )
+		wake.notify_one();
+}
+
+void TextureStreamer::WorkerThread()
+{
+	std::unique_lock< std::mutex > lock( mutex );
+
+	while ( true )
+	{
+		wake.wait( lock, [ this ]() { return stopping || !requests.empty(); } );
+
+		if ( stopping )
+			break;
+
+		Entry *entry = requests.front();
+		requests.pop_front();
+		uploading = entry;
+
+		lock.unlock();
+
+		// Copying into the staging ring is the slow part, the GPU side is a single copy per level
+		entry->texture->UploadMips( entry->source->view, entry->loadingMip, 1 );
+		const uint64_t serial = vulkanSystem->uploadManager->Flush();
+
+		lock.lock();
+
+		entry->uploadSerial = serial;
+		submitted.push_back( entry );
+		uploading = nullptr;
+
+		idle.notify_all();
+	}
+}
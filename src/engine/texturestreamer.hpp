@@ -0,0 +1,102 @@
+#ifndef TEXTURESTREAMER_HPP
+#define TEXTURESTREAMER_HPP
+
+#include "memory.hpp"
+#include "mappedfile.hpp"
+#include "texturecooker.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+class Engine;
+class VulkanSystem;
+class Texture;
+
+// Cooked textures are loaded with only their small mips resident, this fills in the finer ones one level at a time
+// on a worker thread, textures that take up the most of the screen first. The image is allocated with its whole
+// chain up front and the texture's view starts at its finest resident mip, so sampling never touches a level that
+// hasn't arrived yet. Views are swapped on the main thread once a level's upload has finished on the GPU
+class TextureStreamer
+{
+public:
+	// Mips this size and smaller along both sides are uploaded when the texture is created
+	static constexpr uint32_t ResidentTailSize = 64;
+
+	// Levels being uploaded at once, keeps the staging ring free for everything else
+	static constexpr size_t MaxPendingUploads = 2;
+
+	// Keeps the cooked file around until every mip has been streamed in
+	struct Source
+	{
+		// The view points into one of these, a mapped cache hit or a freshly cooked file
+		MappedFile cachedFile;
+		std::vector< char > cooked;
+		TextureCooker::View view;
+	};
+
+	TextureStreamer( Engine *engine, VulkanSystem *vulkanSystem );
+	~TextureStreamer();
+
+	// Finest mip that goes in with the first upload, 0 if the whole chain is small enough to load at once
+	static uint32_t GetFirstResidentMip( const TextureCooker::View &view );
+
+	// Everything below is main thread only
+
+	// Starts streaming a texture that was loaded from GetFirstResidentMip down
+	void Add( Texture *texture, unique_ptr< Source > source );
+
+	// Called by the texture's destructor, waits for the worker if it's uploading to it right now
+	void Remove( Texture *texture );
+
+	// Raises a texture's priority for this frame, 'screenArea' is roughly how many pixels it covers
+	void NotifyVisible( Texture *texture, float screenArea );
+
+	// Once per frame, swaps in mips that finished uploading and queues the next ones
+	void Update();
+
+	// Bumped whenever a texture's view changes, descriptor sets written before then may point at an old view
+	uint64_t GetGeneration() const { return generation; }
+
+private:
+	struct Entry
+	{
+		Texture *texture = nullptr;
+		unique_ptr< Source > source;
+		float screenArea = 0.0f;
+
+		bool streaming = false; // Queued, uploading or waiting on the GPU
+		uint32_t loadingMip = 0;
+		uint64_t uploadSerial = 0;
+	};
+
+	void WorkerThread();
+
+	Engine *engine = nullptr;
+	VulkanSystem *vulkanSystem = nullptr;
+
+	std::unordered_map< Texture*, unique_ptr< Entry > > entries;
+
+	// Guarded by mutex, shared with the worker
+	std::deque< Entry* > requests;
+	std::vector< Entry* > submitted;
+	Entry *uploading = nullptr;
+	bool stopping = false;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::thread worker;
+
+	// Old views live on until no frame in flight can still be sampling through them
+	std::deque< std::pair< VkImageView, uint64_t > > retiredViews;
+	uint64_t frame = 0;
+	uint64_t generation = 0;
+};
+
+#endif // TEXTURESTREAMER_HPP
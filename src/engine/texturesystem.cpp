@@ -2,10 +2,69 @@
 #include "texture.hpp"
 #include "log.hpp"
 #include "stb_image.h"
-#include "stb_filesystem.hpp"
-#include "vfile.hpp"
+#include "stb_decode.hpp"
 #include "engine.hpp"
 #include "resourcepool.hpp"
+#include "mappedfile.hpp"
+#include "texturecooker.hpp"
+#include "clock.hpp"
+#include "thread.hpp"
+#include "pixelkernels.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+
+static const char *FormatName( VkFormat format )
+{
+	switch ( format )
+	{
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		return "BC1";
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+		return "BC3";
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+		return "BC4";
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+		return "BC5";
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+		return "BC7";
+	case VK_FORMAT_R8_UNORM:
+		return "R8";
+	case VK_FORMAT_R8G8_UNORM:
+		return "RG8";
+	default:
+		return "RGBA8";
+	}
+}
+
+// Writes to a temporary file first so a crash or another thread cooking the same image never leaves a torn file behind
+static bool WriteCookedTexture( const std::filesystem::path &path, const std::vector< char > &contents )
+{
+	std::error_code ec;
+	std::filesystem::create_directories( path.parent_path(), ec );
+
+	std::filesystem::path tempPath = path;
+	tempPath += fmt::format( ".{:x}.tmp", std::hash< std::thread::id >()( std::this_thread::get_id() ) );
+
+	{
+		std::ofstream file( tempPath, std::ios_base::binary | std::ios_base::trunc );
+
+		if ( !file.write( contents.data(), static_cast< std::streamsize >( contents.size() ) ) )
+			return false;
+	}
+
+	std::filesystem::rename( tempPath, path, ec );
+
+	if ( ec ) {
+		std::filesystem::remove( tempPath, ec );
+		return false;
+	}
+
+	return true;
+}
 
 void TextureSystem::configure( Engine *engine )
 {
@@ -13,10 +72,43 @@ void TextureSystem::configure( Engine *engine )
 
 	fileSystem = engine->GetFileSystem();
 	vulkanSystem = engine->GetVulkanSystem();
+
+	CommandLineSystem *commandLineSystem = engine->GetCommandLineSystem();
+
+	cookTextures = !commandLineSystem->HasOption( "--nocookedtextures" );
+
+	// Block compression needs the device to support sampling BC formats, otherwise cooked textures stay RGBA8
+	cookOptions.compress = !commandLineSystem->HasOption( "--nobc" ) && vulkanSystem->SupportsBlockCompression();
+
+	if ( commandLineSystem->HasArgument( "-texturequality" ) )
+	{
+		const std::string quality = commandLineSystem->GetArgumentInput( "-texturequality" )[ 0 ];
+
+		if ( quality == "fast" )
+			cookOptions.quality = BcEncoder::Quality::Fast;
+		else if ( quality == "normal" )
+			cookOptions.quality = BcEncoder::Quality::Normal;
+		else if ( quality == "high" )
+			cookOptions.quality = BcEncoder::Quality::High;
+		else
+			Log::PrintlnWarn( "[TextureSystem]Unknown texture quality {}, expected fast, normal or high", quality );
+	}
+
+	if ( cookTextures )
+		Log::Println( "[TextureSystem]Cooking textures {}", cookOptions.compress ? "with block compression" : "as RGBA8" );
+
+	if ( commandLineSystem->HasOption( "--pixelkernelbenchmark" ) )
+		PixelKernels::RunBenchmark( 4096 * 4096 );
+
+	// Only cooked textures have their mips stored, without them there's nothing to stream
+	if ( cookTextures && !commandLineSystem->HasOption( "--notexturestreaming" ) )
+		streamer = make_unique< TextureStreamer >( engine, vulkanSystem );
 }
 
 void TextureSystem::unconfigure( Engine *engine )
 {
+	streamer = nullptr;
+
 	fileSystem = nullptr;
 	vulkanSystem = nullptr;
 
@@ -33,39 +125,209 @@ void TextureSystem::LoadDefaultTextures()
 
 ITexture *TextureSystem::LoadTexture( const std::filesystem::path &relpath, const std::string &pathid, IResourcePool *resourcePoolPtr )
 {
+	return LoadTexture( relpath, pathid, resourcePoolPtr, TextureUsage::Color );
+}
+
+ITexture *TextureSystem::LoadTexture( const std::filesystem::path &relpath, const std::string &pathid, IResourcePool *resourcePoolPtr, TextureUsage usage )
+{
+	return LoadTextures( { TextureRequest { relpath, usage } }, pathid, resourcePoolPtr )[ 0 ];
+}
+
+std::vector< ITexture* > TextureSystem::LoadTextures( const std::vector< TextureRequest > &requests, const std::string &pathid, IResourcePool *resourcePoolPtr )
+{
+	std::vector< ITexture* > textures( requests.size(), errorTexture );
 	ResourcePool *resourcePool = ResourcePool::ToResourcePool( resourcePoolPtr );
-	
+
 	if ( !resourcePool )
 	{
 		Log::PrintlnWarn( "[TextureSystem]Resource pool is NULL" );
-		return errorTexture;
+		return textures;
 	}
 
-	if ( ITexture *texture = FindTexture_Internal( relpath, resourcePoolPtr ); texture )
-		return texture;
+	// Each path is loaded once, whether it's already in the pool or asked for more than once in this batch
+	std::unordered_map< std::string, size_t > firstRequest;
+	std::vector< size_t > pending;
 
-	VFile file( relpath, pathid, fileSystem );
+	for ( size_t i = 0; i < requests.size(); ++i )
+	{
+		if ( ITexture *texture = FindTexture_Internal( requests[ i ].relpath, resourcePoolPtr ); texture ) {
+			textures[ i ] = texture;
+			continue;
+		}
 
-	if ( !file.is_open() )
-		return errorTexture;
+		if ( firstRequest.try_emplace( requests[ i ].relpath.generic_string(), i ).second )
+			pending.push_back( i );
+	}
+
+	if ( pending.empty() ) {
+		return textures;
+	}
+
+	Clock loadClock;
+	loadClock.Start();
+
+	// Decoding and cooking are spread out over every core
+	const size_t threadCount = std::max< size_t >( std::thread::hardware_concurrency(), 1 );
+	std::vector< PreparedTexture > prepared( pending.size() );
+
+	Thread::ParallelFor( pending.size(), threadCount, [ & ]( size_t i )
+	{
+		const TextureRequest &request = requests[ pending[ i ] ];
+
+		// Textures already run in parallel, don't have every one of them spin up an encoder thread per core too
+		const size_t encodeThreads = std::max< size_t >( threadCount / pending.size(), 1 );
+
+		PrepareTexture( request.relpath, pathid, request.usage, encodeThreads, prepared[ i ] );
+
+		// Decoded pixels are holding ring space, get their copy recorded before the ring fills up with the rest
+		if ( !cookTextures )
+			textures[ pending[ i ] ] = CreateTexture( request.relpath, prepared[ i ], resourcePool );
+	} );
+
+	// Every copy lands in the same upload batches, nothing waits on the GPU here
+	if ( cookTextures )
+	{
+		for ( size_t i = 0; i < pending.size(); ++i )
+			textures[ pending[ i ] ] = CreateTexture( requests[ pending[ i ] ].relpath, prepared[ i ], resourcePool );
+	}
+
+	vulkanSystem->uploadManager->Flush();
+
+	for ( size_t i = 0; i < requests.size(); ++i )
+	{
+		if ( auto it = firstRequest.find( requests[ i ].relpath.generic_string() ); it != firstRequest.end() && it->second != i )
+			textures[ i ] = textures[ it->second ];
+	}
+
+	if ( pending.size() > 1 )
+		Log::Println( "[TextureSystem]Loaded {} textures in {:.2f} ms on {} threads", pending.size(), loadClock.Duration< float, std::chrono::milliseconds >(), std::min( threadCount, pending.size() ) );
+
+	return textures;
+}
+
+bool TextureSystem::PrepareTexture( const std::filesystem::path &relpath, const std::string &pathid, TextureUsage usage, size_t encodeThreads, PreparedTexture &prepared )
+{
+	MappedFile source;
+
+	if ( !fileSystem->MapFile( relpath, pathid, source ) )
+		return false;
+
+	if ( !cookTextures )
+	{
+		int x = 0;
+		int y = 0;
+		int numComponents = 0;
+
+		if ( !stbi_info_from_memory( reinterpret_cast< const stbi_uc* >( source.data() ), static_cast< int >( source.size() ), &x, &y, &numComponents ) ) {
+			Log::PrintlnWarn( "Failed to load texture {}", relpath.generic_string() );
+			return false;
+		}
+
+		// Gray and gray with alpha images stay one and two channels, RGB gets padded out since there's no 24 bit format to sample
+		const int desiredComponents = ( numComponents <= 2 && usage != TextureUsage::Normal ) ? numComponents : STBI_rgb_alpha;
+
+		const size_t texelCount = static_cast< size_t >( x ) * static_cast< size_t >( y );
+
+		// The header tells us the decoded size up front, so the pixels can go right where the GPU copies them from
+		prepared.staging = vulkanSystem->uploadManager->ReserveStaging( static_cast< VkDeviceSize >( texelCount ) * static_cast< VkDeviceSize >( desiredComponents ) );
+
+		// Decoded as they're stored and expanded in place afterwards, stb_image's own conversion is one texel at a time
+		const bool decoded = decode_into_stb( reinterpret_cast< const stbi_uc* >( source.data() ), static_cast< int >( source.size() ), numComponents, prepared.staging.data, texelCount * numComponents );
+
+		if ( decoded && desiredComponents != numComponents )
+			PixelKernels::ExpandToRGBA( static_cast< uint8_t* >( prepared.staging.data ), static_cast< uint8_t* >( prepared.staging.data ), texelCount, static_cast< uint32_t >( numComponents ) );
+
+		if ( !decoded ) {
+			vulkanSystem->uploadManager->CancelStaging( prepared.staging );
+			prepared.staging = {};
+
+			// Don't use stbi_failure_reason because it's sadly not thread-safe
+			Log::PrintlnWarn( "Failed to load texture {}", relpath.generic_string() );
+			return false;
+		}
+
+		prepared.width = static_cast< uint32_t >( x );
+		prepared.height = static_cast< uint32_t >( y );
+		prepared.channels = static_cast< uint32_t >( desiredComponents );
+		prepared.valid = true;
+
+		return true;
+	}
+
+	TextureCooker::Options options = cookOptions;
+	options.normalMap = ( usage == TextureUsage::Normal );
+	options.srgb = !options.normalMap;
+	options.threadCount = encodeThreads;
+
+	const uint64_t sourceHash = TextureCooker::HashBytes( source.data(), source.size() );
+	const std::filesystem::path cachePath = fileSystem->GetGameDir() / "cache" / "textures" / fmt::format( "{:016x}_{:x}.ctex", sourceHash, options.GetKey() );
+
+	prepared.cooked = make_unique< TextureStreamer::Source >();
+	TextureStreamer::Source &cooked = *prepared.cooked;
+
+	if ( cooked.cachedFile.Map( cachePath ) && TextureCooker::Parse( cooked.cachedFile.data(), cooked.cachedFile.size(), sourceHash, cooked.view ) ) {
+		prepared.valid = true;
+		return true;
+	}
+
+	cooked.cachedFile.Close();
+
+	Clock cookClock;
+	cookClock.Start();
 
 	int x = 0;
 	int y = 0;
 	int numComponents = 0;
 
-	stbi_uc *pixels = stbi_load_from_callbacks( &callbacks_stb, &file, &x, &y, &numComponents, STBI_rgb_alpha );
+	// Kept at the source's channel count, the cooker expands to RGBA itself
+	stbi_uc *pixels = stbi_load_from_memory( reinterpret_cast< const stbi_uc* >( source.data() ), static_cast< int >( source.size() ), &x, &y, &numComponents, 0 );
 
 	if ( pixels == nullptr ) {
-		// Don't use stbi_failure_reason because it's sadly not thread-safe
 		Log::PrintlnWarn( "Failed to load texture {}", relpath.generic_string() );
+		return false;
+	}
+
+	TextureCooker::Cook( pixels, static_cast< uint32_t >( x ), static_cast< uint32_t >( y ), static_cast< uint32_t >( numComponents ), options, sourceHash, cooked.cooked );
+	stbi_image_free( pixels );
+
+	if ( !WriteCookedTexture( cachePath, cooked.cooked ) )
+		Log::PrintlnWarn( "[TextureSystem]Failed to write {}", cachePath.generic_string() );
+
+	if ( !TextureCooker::Parse( cooked.cooked.data(), cooked.cooked.size(), sourceHash, cooked.view ) ) {
+		Log::PrintlnWarn( "[TextureSystem]Failed to cook {}", relpath.generic_string() );
+		return false;
+	}
+
+	Log::Println( "[TextureSystem]Cooked {} ({} mips, {} KB, {}) in {:.2f} ms", relpath.generic_string(), cooked.view.mips.size(), cooked.view.dataSize >> 10, FormatName( cooked.view.format ), cookClock.Duration< float, std::chrono::milliseconds >() );
+
+	prepared.valid = true;
+	return true;
+}
+
+ITexture *TextureSystem::CreateTexture( const std::filesystem::path &relpath, PreparedTexture &prepared, ResourcePool *resourcePool )
+{
+	if ( !prepared.valid ) {
 		return errorTexture;
 	}
 
 	auto resource = ResourcePool::createResource< Texture >( ResourceInfo{ relpath.generic_string() }, vulkanSystem );
 	Texture *texture = resource->resource.get();
-	texture->LoadRGBA( pixels, x, y, true );
 
-	stbi_image_free( pixels );
+	if ( prepared.staging.data )
+	{
+		texture->LoadPixels( prepared.staging, prepared.width, prepared.height, prepared.channels, true );
+		prepared.staging = {};
+	}
+	else
+	{
+		// Only the small mips go up now, the streamer fills in the rest once the texture is on screen
+		const uint32_t firstResidentMip = streamer ? TextureStreamer::GetFirstResidentMip( prepared.cooked->view ) : 0;
+
+		texture->LoadCooked( prepared.cooked->view, firstResidentMip );
+
+		if ( firstResidentMip > 0 )
+			streamer->Add( texture, std::move( prepared.cooked ) );
+	}
 
 	texturesMutex.lock();
 	resourcePool->textures.push_back( resource );
@@ -10,8 +10,24 @@
 #include "filesystem.hpp"
 #include "memory.hpp"
 #include "vulkansystem.hpp"
+#include "texturecooker.hpp"
+#include "texturestreamer.hpp"
 
 class Texture;
+class ResourcePool;
+
+// What a texture holds, decides how it's filtered and which block format it's cooked to
+enum class TextureUsage
+{
+	Color,
+	Normal
+};
+
+struct TextureRequest
+{
+	std::filesystem::path relpath;
+	TextureUsage usage = TextureUsage::Color;
+};
 
 class TextureSystem : public ITextureSystem, public EngineSystem
 {
@@ -23,21 +39,55 @@ public:
 	void LoadDefaultTextures();
 
 	ITexture *LoadTexture( const std::filesystem::path &relpath, const std::string &pathid, IResourcePool *resourcePoolPtr ) override;
+	ITexture *LoadTexture( const std::filesystem::path &relpath, const std::string &pathid, IResourcePool *resourcePoolPtr, TextureUsage usage );
+
+	// Decodes every texture that isn't loaded yet in parallel and records their uploads into the same batches.
+	// Returns one texture per request, the error texture for any that failed
+	std::vector< ITexture* > LoadTextures( const std::vector< TextureRequest > &requests, const std::string &pathid, IResourcePool *resourcePoolPtr );
+
 	ITexture *FindTexture( const std::filesystem::path &relpath, IResourcePool *resourcePoolPtr ) const override;
 
 private:
 	ITexture *FindTexture_Internal( const std::filesystem::path &relpath, IResourcePool *resourcePoolPtr ) const;
 
+	// CPU side of a texture load, filled in on a worker thread
+	struct PreparedTexture
+	{
+		bool valid = false;
+
+		// Cooked file, handed over to the streamer when the texture's finer mips are streamed in
+		unique_ptr< TextureStreamer::Source > cooked;
+
+		// When cooking is turned off the source is decoded straight into staging memory
+		UploadManager::Reservation staging;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t channels = 4;
+	};
+
+	// Thread safe, reads the cooked copy of the source when there's an up to date one and cooks it otherwise
+	bool PrepareTexture( const std::filesystem::path &relpath, const std::string &pathid, TextureUsage usage, size_t encodeThreads, PreparedTexture &prepared );
+
+	// Creates the image and records its upload into the current upload batch. Thread safe for uncooked textures,
+	// cooked ones are handed to the streamer which is main thread only
+	ITexture *CreateTexture( const std::filesystem::path &relpath, PreparedTexture &prepared, ResourcePool *resourcePool );
+
 public:
 
 	Texture *GetErrorTexture() const { return errorTexture; }
 
+	// NULL when streaming is turned off
+	TextureStreamer *GetStreamer() const { return streamer.get(); }
+
 private:
 
 	FileSystem *fileSystem = nullptr;
 	VulkanSystem *vulkanSystem = nullptr;
 
 	Texture *errorTexture = nullptr;
+	bool cookTextures = true;
+	TextureCooker::Options cookOptions;
+	unique_ptr< TextureStreamer > streamer;
 	mutable std::mutex texturesMutex;
 };
 
@@ -1,3 +1,150 @@
 #include "thread.hpp"
 
-const std::thread::id Thread::MAIN_THREAD = std::this_thread::get_id();
\ No newline at end of file
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+const std::thread::id Thread::MAIN_THREAD = std::this_thread::get_id();
+
+namespace
+{
+	struct Job
+	{
+		const std::function< void( size_t ) > *func = nullptr;
+		size_t count = 0;
+		size_t helpers = 0; // Workers still to pick the job up, it leaves the queue at 0
+
+		std::atomic< size_t > next = 0;
+		std::atomic< size_t > done = 0;
+
+		std::mutex mutex;
+		std::condition_variable finished;
+
+		// func is only touched for claimed indices, the caller doesn't return before all of them are done
+		void Work()
+		{
+			for ( size_t i = next++; i < count; i = next++ )
+			{
+				( *func )( i );
+
+				if ( ++done == count ) {
+					std::lock_guard< std::mutex > lock( mutex );
+					finished.notify_all();
+				}
+			}
+		}
+	};
+
+	// Started on first use and kept until exit, so ParallelFor doesn't create threads per call
+	class WorkerPool
+	{
+	public:
+		explicit WorkerPool( size_t workerCount )
+		{
+			workers.reserve( workerCount );
+
+			for ( size_t i = 0; i < workerCount; ++i )
+				workers.emplace_back( [ this ]() { Run(); } );
+		}
+
+		~WorkerPool()
+		{
+			{
+				std::lock_guard< std::mutex > lock( mutex );
+				stopping = true;
+			}
+
+			wake.notify_all();
+
+			for ( auto &worker : workers )
+				worker.join();
+		}
+
+		size_t GetWorkerCount() const { return workers.size(); }
+
+		void Submit( const std::shared_ptr< Job > &job )
+		{
+			const size_t helpers = job->helpers;
+
+			{
+				std::lock_guard< std::mutex > lock( mutex );
+				jobs.push_back( job );
+			}
+
+			for ( size_t i = 0; i < helpers; ++i )
+				wake.notify_one();
+		}
+
+	private:
+		void Run()
+		{
+			for ( ;; )
+			{
+				std::shared_ptr< Job > job;
+
+				{
+					std::unique_lock< std::mutex > lock( mutex );
+					wake.wait( lock, [ this ]() { return stopping || !jobs.empty(); } );
+
+					if ( stopping )
+						return;
+
+					job = jobs.front();
+
+					if ( --job->helpers == 0 )
+						jobs.pop_front();
+				}
+
+				job->Work();
+			}
+		}
+
+		std::vector< std::thread > workers;
+		std::deque< std::shared_ptr< Job > > jobs;
+
+		std::mutex mutex;
+		std::condition_variable wake;
+		bool stopping = false;
+	};
+
+	WorkerPool &GetWorkerPool()
+	{
+		static WorkerPool pool( std::max< size_t >( std::thread::hardware_concurrency(), 2 ) - 1 );
+		return pool;
+	}
+}
+
+size_t Thread::GetMaxThreads()
+{
+	return GetWorkerPool().GetWorkerCount() + 1;
+}
+
+void Thread::ParallelFor( size_t count, size_t threadCount, const std::function< void( size_t ) > &func )
+{
+	threadCount = std::min( { threadCount, count, GetMaxThreads() } );
+
+	if ( threadCount <= 1 )
+	{
+		for ( size_t i = 0; i < count; ++i )
+			func( i );
+
+		return;
+	}
+
+	auto job = std::make_shared< Job >();
+	job->func = &func;
+	job->count = count;
+	job->helpers = threadCount - 1;
+
+	GetWorkerPool().Submit( job );
+
+	// Also safe when called from a worker, the caller takes whatever indices nobody else got to
+	job->Work();
+
+	std::unique_lock< std::mutex > lock( job->mutex );
+	job->finished.wait( lock, [ &job ]() { return job->done == job->count; } );
+}
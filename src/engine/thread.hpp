@@ -1,6 +1,7 @@
 #ifndef THREAD_HPP
 #define THREAD_HPP
 
+#include <functional>
 #include <thread>
 
 class Thread
@@ -9,6 +10,13 @@ class Thread
 
 public:
 	static std::thread::id GetMainThreadId() { return MAIN_THREAD; }
+
+	// Calling thread plus the shared worker pool
+	static size_t GetMaxThreads();
+
+	// Runs func( 0 .. count - 1 ) on up to threadCount threads, the calling thread included. The others come from a
+	// worker pool that's started once, not per call
+	static void ParallelFor( size_t count, size_t threadCount, const std::function< void( size_t ) > &func );
 };
 
 #endif // THREAD_HPP
\ No newline at end of file
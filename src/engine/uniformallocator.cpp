@@ -0,0 +1,142 @@
+#include "uniformallocator.hpp"
+#include "vulkansystem.hpp"
+#include "engine.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+
+static inline VkDeviceSize AlignUp( VkDeviceSize value, VkDeviceSize alignment )
+{
+	return ( value + alignment - 1 ) / alignment * alignment;
+}
+
+UniformAllocator::UniformAllocator( Engine *engine, VulkanSystem *vulkanSystem ) :
+	engine( engine ),
+	vulkanSystem( vulkanSystem )
+{
+	VkPhysicalDeviceProperties properties = {};
+	vkGetPhysicalDeviceProperties( vulkanSystem->physicalDevice, &properties );
+
+	alignment = std::max< VkDeviceSize >( properties.limits.minUniformBufferOffsetAlignment, 16 );
+}
+
+UniformAllocator::~UniformAllocator()
+{
+	for ( auto &frameBuffer : frameBuffers )
+		DestroyBuffer( frameBuffer );
+
+	frameBuffers.clear();
+}
+
+void UniformAllocator::BeginFrame( uint32_t imageIndex )
+{
+	std::lock_guard< std::mutex > lock( mutex );
+
+	FrameBuffer &frameBuffer = GetFrameBuffer( imageIndex );
+
+	++frame;
+	frameImage = imageIndex;
+	frameData = frameBuffer.data;
+	frameSize = frameBuffer.size;
+	head = 0;
+}
+
+UniformAllocator::Slice UniformAllocator::Allocate( VkDeviceSize size )
+{
+	const VkDeviceSize offset = head.fetch_add( AlignUp( size, alignment ) );
+
+	// Keeps counting past the end, Grow sizes the new buffer by it
+	if ( offset + size > frameSize )
+		return {};
+
+	return { frameData + offset, static_cast< uint32_t >( offset ) };
+}
+
+void UniformAllocator::Flush()
+{
+	std::lock_guard< std::mutex > lock( mutex );
+
+	const VkDeviceSize used = std::min( head.load(), frameSize );
+
+	if ( used > 0 )
+		vmaFlushAllocation( vulkanSystem->allocator, frameBuffers[ frameImage ].allocation, 0, used );
+}
+
+void UniformAllocator::Grow()
+{
+	std::lock_guard< std::mutex > lock( mutex );
+
+	FrameBuffer &frameBuffer = frameBuffers[ frameImage ];
+	const VkDeviceSize size = std::max( AlignUp( head.load(), DefaultSize ), frameBuffer.size * 2 );
+
+	Log::Println( "[Vulkan]Uniform buffer for image {} grew to {} KB", frameImage, size >> 10 );
+
+	// Nothing on the GPU uses this image's buffer anymore, the same goes for BeginFrame
+	DestroyBuffer( frameBuffer );
+	CreateBuffer( frameBuffer, size );
+
+	++frame;
+	frameData = frameBuffer.data;
+	frameSize = frameBuffer.size;
+	head = 0;
+}
+
+VkBuffer UniformAllocator::GetBuffer( uint32_t imageIndex )
+{
+	std::lock_guard< std::mutex > lock( mutex );
+	return GetFrameBuffer( imageIndex ).buffer;
+}
+
+uint64_t UniformAllocator::GetGeneration( uint32_t imageIndex ) const
+{
+	std::lock_guard< std::mutex > lock( mutex );
+	return ( imageIndex < frameBuffers.size() ) ? frameBuffers[ imageIndex ].generation : 0;
+}
+
+void UniformAllocator::CreateBuffer( FrameBuffer &frameBuffer, VkDeviceSize size )
+{
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo allocCreateInfo = {};
+	allocCreateInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	allocCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	VmaAllocationInfo allocInfo = {};
+
+	if ( vmaCreateBuffer( vulkanSystem->allocator, &bufferInfo, &allocCreateInfo, &frameBuffer.buffer, &frameBuffer.allocation, &allocInfo ) != VK_SUCCESS ) {
+		engine->Error( "[Vulkan]Failed to create uniform buffer" );
+	}
+
+	frameBuffer.data = static_cast< unsigned char* >( allocInfo.pMappedData );
+	frameBuffer.size = size;
+	frameBuffer.generation = nextGeneration++;
+}
+
+void UniformAllocator::DestroyBuffer( FrameBuffer &frameBuffer )
+{
+	if ( frameBuffer.buffer != VK_NULL_HANDLE )
+		vmaDestroyBuffer( vulkanSystem->allocator, frameBuffer.buffer, frameBuffer.allocation );
+
+	frameBuffer.buffer = VK_NULL_HANDLE;
+	frameBuffer.allocation = VK_NULL_HANDLE;
+	frameBuffer.data = nullptr;
+	frameBuffer.size = 0;
+}
+
+UniformAllocator::FrameBuffer &UniformAllocator::GetFrameBuffer( uint32_t imageIndex )
+{
+	// Swap chains can come back with more images after a resize
+	if ( imageIndex >= frameBuffers.size() )
+		frameBuffers.resize( imageIndex + 1 );
+
+	FrameBuffer &frameBuffer = frameBuffers[ imageIndex ];
+
+	if ( frameBuffer.buffer == VK_NULL_HANDLE )
+		CreateBuffer( frameBuffer, DefaultSize );
+
+	return frameBuffer;
+}
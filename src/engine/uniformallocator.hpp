@@ -0,0 +1,86 @@
+#ifndef UNIFORMALLOCATOR_HPP
+#define UNIFORMALLOCATOR_HPP
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+class Engine;
+class VulkanSystem;
+
+// Uniform memory that lives for a frame. Every swap chain image has one persistently mapped buffer, draws bump
+// allocate aligned slices of it and bind them with dynamic offsets, so meshes don't own uniform buffers and nothing
+// gets mapped per draw. Descriptor sets point at the image's buffer, it's only replaced when a frame outgrows it
+class UniformAllocator
+{
+public:
+	static constexpr VkDeviceSize DefaultSize = 1ull << 20;
+
+	struct Slice
+	{
+		void *data = nullptr; // Null when the frame's buffer is full
+		uint32_t offset = 0; // Dynamic offset to bind the slice with
+	};
+
+	UniformAllocator( Engine *engine, VulkanSystem *vulkanSystem );
+	~UniformAllocator();
+
+	// Starts allocating from this image's buffer, everything allocated from it before is handed back. The image's
+	// last frame has to be done on the GPU
+	void BeginFrame( uint32_t imageIndex );
+
+	// Thread safe
+	Slice Allocate( VkDeviceSize size );
+
+	// Makes this frame's writes visible to the device, a no-op on coherent memory
+	void Flush();
+
+	// True when an Allocate this frame didn't fit, Grow and start the frame over then
+	bool Overflowed() const { return head.load() > frameSize; }
+
+	// Replaces the current image's buffer with one that fits everything this frame asked for
+	void Grow();
+
+	// Creates the buffer the first time an image's is asked for
+	VkBuffer GetBuffer( uint32_t imageIndex );
+
+	// Bumped by BeginFrame and Grow, slices allocated under an older frame are gone
+	uint64_t GetFrame() const { return frame; }
+
+	// Bumped when the image's buffer is replaced, descriptor sets written with the old one need rewriting
+	uint64_t GetGeneration( uint32_t imageIndex ) const;
+
+private:
+	struct FrameBuffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		unsigned char *data = nullptr;
+		VkDeviceSize size = 0;
+		uint64_t generation = 0;
+	};
+
+	void CreateBuffer( FrameBuffer &frameBuffer, VkDeviceSize size );
+	void DestroyBuffer( FrameBuffer &frameBuffer );
+	FrameBuffer &GetFrameBuffer( uint32_t imageIndex );
+
+	Engine *engine = nullptr;
+	VulkanSystem *vulkanSystem = nullptr;
+
+	VkDeviceSize alignment = 256; // minUniformBufferOffsetAlignment
+	std::vector< FrameBuffer > frameBuffers; // Per swap chain image
+	uint64_t nextGeneration = 1;
+
+	uint64_t frame = 0;
+	uint32_t frameImage = 0;
+	unsigned char *frameData = nullptr;
+	VkDeviceSize frameSize = 0;
+	std::atomic< VkDeviceSize > head{ 0 };
+
+	mutable std::mutex mutex; // Guards frameBuffers, Allocate doesn't need it
+};
+
+#endif // UNIFORMALLOCATOR_HPP
@@ -0,0 +1,761 @@
+#include "uploadmanager.hpp"
+#include "vulkansystem.hpp"
+#include "engine.hpp"
+#include "clock.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+// Everything that can touch uploaded data once the graphics queue owns it
+static constexpr VkPipelineStageFlags ConsumerStages = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+static VkDeviceSize AlignUp( VkDeviceSize value, VkDeviceSize alignment )
+{
+	return ( value + alignment - 1 ) / alignment * alignment;
+}
+
+static VkCommandPool CreateUploadCommandPool( Engine *engine, VkDevice device, uint32_t queueFamily )
+{
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamily;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	if ( vkCreateCommandPool( device, &poolInfo, nullptr, &commandPool ) != VK_SUCCESS ) {
+		engine->Error( "[Vulkan]Failed to create upload command pool" );
+	}
+
+	return commandPool;
+}
+
+static VkCommandBuffer AllocateUploadCommandBuffer( Engine *engine, VkDevice device, VkCommandPool commandPool )
+{
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = commandPool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	if ( vkAllocateCommandBuffers( device, &allocInfo, &commandBuffer ) != VK_SUCCESS ) {
+		engine->Error( "[Vulkan]Failed to allocate upload command buffer" );
+	}
+
+	return commandBuffer;
+}
+
+UploadManager::UploadManager( Engine *engine, VulkanSystem *vulkanSystem, VkDeviceSize ringSize /*= DefaultRingSize*/ ) :
+	engine( engine ),
+	vulkanSystem( vulkanSystem ),
+	ringSize( ringSize )
+{
+	VkPhysicalDeviceProperties properties = {};
+	vkGetPhysicalDeviceProperties( vulkanSystem->physicalDevice, &properties );
+
+	// Image copies need offsets that are a multiple of the texel size, 16 covers every format we create
+	optimalCopyAlignment = std::max< VkDeviceSize >( 16, properties.limits.optimalBufferCopyOffsetAlignment );
+
+	graphicsFamily = vulkanSystem->queueFamilyIndices.graphicsFamily.value();
+	dedicatedTransfer = vulkanSystem->HasDedicatedTransferQueue();
+	queueFamily = dedicatedTransfer ? vulkanSystem->queueFamilyIndices.transferFamily.value() : graphicsFamily;
+	queue = dedicatedTransfer ? vulkanSystem->transferQueue : vulkanSystem->graphicsQueue;
+
+	commandPool = CreateUploadCommandPool( engine, vulkanSystem->device, queueFamily );
+
+	if ( dedicatedTransfer )
+		acquireCommandPool = CreateUploadCommandPool( engine, vulkanSystem->device, graphicsFamily );
+
+	for ( Batch &batch : batches )
+	{
+		batch.commandBuffer = AllocateUploadCommandBuffer( engine, vulkanSystem->device, commandPool );
+
+		if ( dedicatedTransfer )
+		{
+			batch.acquireCommandBuffer = AllocateUploadCommandBuffer( engine, vulkanSystem->device, acquireCommandPool );
+
+			VkSemaphoreCreateInfo semaphoreInfo = {};
+			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+			if ( vkCreateSemaphore( vulkanSystem->device, &semaphoreInfo, nullptr, &batch.transferComplete ) != VK_SUCCESS ) {
+				engine->Error( "[Vulkan]Failed to create upload semaphore" );
+			}
+		}
+
+		VkFenceCreateInfo fenceInfo = {};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		if ( vkCreateFence( vulkanSystem->device, &fenceInfo, nullptr, &batch.fence ) != VK_SUCCESS ) {
+			engine->Error( "[Vulkan]Failed to create upload fence" );
+		}
+
+		freeBatches.push_back( &batch );
+	}
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = ringSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo allocCreateInfo = {};
+	allocCreateInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+	allocCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	VmaAllocationInfo allocInfo = {};
+
+	if ( vmaCreateBuffer( vulkanSystem->allocator, &bufferInfo, &allocCreateInfo, &ringBuffer, &ringAllocation, &allocInfo ) != VK_SUCCESS ) {
+		engine->Error( "[Vulkan]Failed to create staging ring" );
+	}
+
+	ringData = static_cast< unsigned char* >( allocInfo.pMappedData );
+
+	Log::Println( "[Vulkan]Staging ring: {} MB, {} batches, {} queue", ringSize >> 20, MaxBatches, dedicatedTransfer ? "transfer" : "graphics" );
+}
+
+UploadManager::~UploadManager()
+{
+	Finish();
+
+	for ( Batch &batch : batches )
+	{
+		if ( batch.fence != VK_NULL_HANDLE ) {
+			vkDestroyFence( vulkanSystem->device, batch.fence, nullptr );
+			batch.fence = VK_NULL_HANDLE;
+		}
+
+		if ( batch.transferComplete != VK_NULL_HANDLE ) {
+			vkDestroySemaphore( vulkanSystem->device, batch.transferComplete, nullptr );
+			batch.transferComplete = VK_NULL_HANDLE;
+		}
+	}
+
+	if ( acquireCommandPool != VK_NULL_HANDLE ) {
+		vkDestroyCommandPool( vulkanSystem->device, acquireCommandPool, nullptr );
+		acquireCommandPool = VK_NULL_HANDLE;
+	}
+
+	// Frees the command buffers along with it
+	if ( commandPool != VK_NULL_HANDLE ) {
+		vkDestroyCommandPool( vulkanSystem->device, commandPool, nullptr );
+		commandPool = VK_NULL_HANDLE;
+	}
+
+	if ( ringBuffer != VK_NULL_HANDLE ) {
+		vmaDestroyBuffer( vulkanSystem->allocator, ringBuffer, ringAllocation );
+		ringBuffer = VK_NULL_HANDLE;
+		ringAllocation = VK_NULL_HANDLE;
+		ringData = nullptr;
+	}
+}
+
+void UploadManager::UploadBuffer( VkBuffer dstBuffer, const void *data, VkDeviceSize size, VkDeviceSize dstOffset /*= 0*/ )
+{
+	if ( size == 0 ) {
+		return;
+	}
+
+	std::lock_guard< std::recursive_mutex > lock( mutex );
+
+	Batch *batch = nullptr;
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	void *mapped = nullptr;
+	const VkDeviceSize srcOffset = AllocateStaging( size, optimalCopyAlignment, batch, stagingBuffer, mapped );
+
+	std::memcpy( mapped, data, static_cast< size_t >( size ) );
+
+	VkBufferCopy copyRegion = {};
+	copyRegion.srcOffset = srcOffset;
+	copyRegion.dstOffset = dstOffset;
+	copyRegion.size = size;
+	vkCmdCopyBuffer( batch->commandBuffer, stagingBuffer, dstBuffer, 1, &copyRegion );
+
+	if ( dedicatedTransfer )
+		ReleaseBuffer( *batch, dstBuffer, dstOffset, size );
+
+	++batch->copies;
+	++stats.uploads;
+	stats.bytes += size;
+
+	// Big batches go out early so the GPU can start on them while we keep filling the ring
+	if ( batch->ringBytes >= ringSize / MaxBatches )
+		Submit( *batch );
+}
+
+UploadManager::Reservation UploadManager::ReserveStaging( VkDeviceSize size )
+{
+	std::lock_guard< std::recursive_mutex > lock( mutex );
+
+	RetireCompleted( false );
+
+	Reservation staging;
+	staging.size = size;
+
+	if ( size > ringSize / 2 )
+	{
+		CreateDedicatedStaging( size, staging.buffer, staging.dedicatedAllocation, staging.data );
+		return staging;
+	}
+
+	staging.offset = AllocateRing( size, optimalCopyAlignment, staging.sequence );
+	staging.buffer = ringBuffer;
+	staging.data = ringData + staging.offset;
+
+	reservations.emplace( staging.sequence, staging.offset );
+
+	return staging;
+}
+
+void UploadManager::CancelStaging( const Reservation &staging )
+{
+	std::lock_guard< std::recursive_mutex > lock( mutex );
+
+	if ( staging.dedicatedAllocation != VK_NULL_HANDLE ) {
+		vmaDestroyBuffer( vulkanSystem->allocator, staging.buffer, staging.dedicatedAllocation );
+		return;
+	}
+
+	reservations.erase( staging.sequence );
+	reservationReleased.notify_all();
+}
+
+void UploadManager::UploadImage( VkImage image, VkFormat format, const void *data, VkDeviceSize size, uint32_t width, uint32_t height, uint32_t mipLevels, bool generateMipMaps )
+{
+	// The copy into staging doesn't need the lock, other threads can record while it runs
+	const Reservation staging = ReserveStaging( size );
+	std::memcpy( staging.data, data, static_cast< size_t >( size ) );
+
+	UploadImage( staging, image, format, width, height, mipLevels, generateMipMaps );
+}
+
+void UploadManager::UploadImage( const Reservation &staging, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, bool generateMipMaps )
+{
+	std::lock_guard< std::recursive_mutex > lock( mutex );
+
+	Batch *batch = &ClaimReservation( staging );
+
+	vulkanSystem->CmdTransitionImageLayout( batch->commandBuffer, image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels );
+	vulkanSystem->CmdCopyBufferToImage( batch->commandBuffer, staging.buffer, staging.offset, image, width, height );
+
+	if ( dedicatedTransfer )
+	{
+		// Mips are blitted on the graphics queue after it takes the image over
+		if ( generateMipMaps ) {
+			ReleaseImage( *batch, image, 0, mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT );
+			batch->mipJobs.push_back( MipJob { image, format, static_cast< int32_t >( width ), static_cast< int32_t >( height ), mipLevels } );
+		}
+		else {
+			ReleaseImage( *batch, image, 0, mipLevels, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT );
+		}
+	}
+	else if ( generateMipMaps )
+		vulkanSystem->CmdGenerateMipMaps( batch->commandBuffer, image, format, static_cast< int32_t >( width ), static_cast< int32_t >( height ), mipLevels );
+	else
+		vulkanSystem->CmdTransitionImageLayout( batch->commandBuffer, image, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels );
+
+	++batch->copies;
+	++stats.uploads;
+	stats.bytes += staging.size;
+
+	if ( batch->ringBytes >= ringSize / MaxBatches )
+		Submit( *batch );
+}
+
+void UploadManager::UploadImageMips( VkImage image, VkFormat format, const void *data, VkDeviceSize size, uint32_t baseMipLevel, uint32_t levelCount, const std::vector< VkBufferImageCopy > &regions )
+{
+	const Reservation staging = ReserveStaging( size );
+	std::memcpy( staging.data, data, static_cast< size_t >( size ) );
+
+	UploadImageMips( staging, image, format, baseMipLevel, levelCount, regions );
+}
+
+void UploadManager::UploadImageMips( const Reservation &staging, VkImage image, VkFormat format, uint32_t baseMipLevel, uint32_t levelCount, const std::vector< VkBufferImageCopy > &regions )
+{
+	std::lock_guard< std::recursive_mutex > lock( mutex );
+
+	Batch *batch = &ClaimReservation( staging );
+
+	std::vector< VkBufferImageCopy > stagedRegions( regions );
+	for ( VkBufferImageCopy &region : stagedRegions )
+		region.bufferOffset += staging.offset;
+
+	vulkanSystem->CmdTransitionImageLayout( batch->commandBuffer, image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levelCount, baseMipLevel );
+	vkCmdCopyBufferToImage( batch->commandBuffer, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast< uint32_t >( stagedRegions.size() ), stagedRegions.data() );
+
+	// Nothing left to blit, so this works on a transfer queue too
+	if ( dedicatedTransfer )
+		ReleaseImage( *batch, image, baseMipLevel, levelCount, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT );
+	else
+		vulkanSystem->CmdTransitionImageLayout( batch->commandBuffer, image, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, levelCount, baseMipLevel );
+
+	++batch->copies;
+	++stats.uploads;
+	stats.bytes += staging.size;
+
+	if ( batch->ringBytes >= ringSize / MaxBatches )
+		Submit( *batch );
+}
+
+uint64_t UploadManager::Flush()
+{
+	std::lock_guard< std::recursive_mutex > lock( mutex );
+
+	if ( recordingBatch && recordingBatch->copies > 0 )
+		Submit( *recordingBatch );
+
+	RetireCompleted( false );
+
+	return stats.submits;
+}
+
+bool UploadManager::IsComplete( uint64_t serial )
+{
+	std::lock_guard< std::recursive_mutex > lock( mutex );
+
+	RetireCompleted( false );
+
+	return retiredSubmits >= serial;
+}
+
+void UploadManager::Finish()
+{
+	std::lock_guard< std::recursive_mutex > lock( mutex );
+
+	Flush();
+
+	while ( !inFlight.empty() )
+		RetireCompleted( true );
+}
+
+UploadManager::Batch &UploadManager::GetRecordingBatch()
+{
+	if ( recordingBatch ) {
+		return *recordingBatch;
+	}
+
+	while ( freeBatches.empty() )
+		RetireCompleted( true );
+
+	recordingBatch = freeBatches.back();
+	freeBatches.pop_back();
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer( recordingBatch->commandBuffer, &beginInfo );
+
+	return *recordingBatch;
+}
+
+VkDeviceSize UploadManager::AllocateStaging( VkDeviceSize size, VkDeviceSize alignment, Batch *&batch, VkBuffer &stagingBuffer, void *&mapped )
+{
+	RetireCompleted( false );
+
+	// Anything that would hog more than half the ring gets a buffer of its own rather than stalling everything else
+	if ( size > ringSize / 2 )
+	{
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		CreateDedicatedStaging( size, stagingBuffer, allocation, mapped );
+
+		batch = &GetRecordingBatch();
+		batch->dedicatedStaging.push_back( { stagingBuffer, allocation } );
+
+		return 0;
+	}
+
+	uint64_t sequence = 0;
+	const VkDeviceSize offset = AllocateRing( size, alignment, sequence );
+
+	batch = &GetRecordingBatch();
+
+	if ( batch->ringBytes == 0 ) {
+		batch->ringBegin = offset;
+		batch->ringSequence = sequence;
+	}
+
+	batch->ringBytes += size;
+	stagingBuffer = ringBuffer;
+	mapped = ringData + offset;
+
+	return offset;
+}
+
+void UploadManager::CreateDedicatedStaging( VkDeviceSize size, VkBuffer &stagingBuffer, VmaAllocation &allocation, void *&mapped )
+{
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo allocCreateInfo = {};
+	allocCreateInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+	allocCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	VmaAllocationInfo allocInfo = {};
+
+	if ( vmaCreateBuffer( vulkanSystem->allocator, &bufferInfo, &allocCreateInfo, &stagingBuffer, &allocation, &allocInfo ) != VK_SUCCESS ) {
+		engine->Error( "[Vulkan]Failed to create staging buffer" );
+	}
+
+	mapped = allocInfo.pMappedData;
+	++stats.dedicatedStagingBuffers;
+}
+
+VkDeviceSize UploadManager::AllocateRing( VkDeviceSize size, VkDeviceSize alignment, uint64_t &sequence )
+{
+	VkDeviceSize offset = 0;
+
+	while ( !TryAllocateRing( size, alignment, offset ) )
+	{
+		// The batch being recorded is what's filling the ring, it has to go out before its space can come back
+		if ( inFlight.empty() && recordingBatch && recordingBatch->copies > 0 )
+			Submit( *recordingBatch );
+
+		// Nothing on the GPU to wait for, the rest of the ring is reserved by threads still writing to it
+		if ( inFlight.empty() && !reservations.empty() )
+			reservationReleased.wait( mutex );
+		else
+			RetireCompleted( true );
+
+		++stats.stalls;
+	}
+
+	sequence = ++ringAllocations;
+
+	return offset;
+}
+
+bool UploadManager::TryAllocateRing( VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset )
+{
+	// The oldest allocation still owned by a batch in flight, the one being recorded or a reservation. A reservation
+	// can end up in a batch submitted after ones holding newer allocations, so go by allocation order, not submit order
+	bool oldest = false;
+	uint64_t oldestSequence = 0;
+	VkDeviceSize tail = ringSize;
+
+	auto consider = [ & ]( uint64_t sequence, VkDeviceSize begin )
+	{
+		if ( !oldest || sequence < oldestSequence ) {
+			oldest = true;
+			oldestSequence = sequence;
+			tail = begin;
+		}
+	};
+
+	for ( const Batch *batch : inFlight )
+	{
+		if ( batch->ringBytes > 0 )
+			consider( batch->ringSequence, batch->ringBegin );
+	}
+
+	if ( recordingBatch && recordingBatch->ringBytes > 0 )
+		consider( recordingBatch->ringSequence, recordingBatch->ringBegin );
+
+	if ( !reservations.empty() )
+		consider( reservations.begin()->first, reservations.begin()->second );
+
+	if ( !oldest ) {
+		ringHead = 0;
+	}
+	const VkDeviceSize start = AlignUp( ringHead, alignment );
+
+	if ( !oldest || ringHead >= tail )
+	{
+		// Free space runs from the head to the end of the ring, then wraps around to the tail
+		if ( start + size <= ringSize ) {
+			offset = start;
+			ringHead = start + size;
+			return true;
+		}
+
+		if ( oldest && size < tail ) {
+			offset = 0;
+			ringHead = size;
+			return true;
+		}
+
+		return false;
+	}
+
+	// Head has wrapped behind the tail, stop short of it so a full ring never looks empty
+	if ( start + size < tail ) {
+		offset = start;
+		ringHead = start + size;
+		return true;
+	}
+
+	return false;
+}
+
+UploadManager::Batch &UploadManager::ClaimReservation( const Reservation &staging )
+{
+	Batch &batch = GetRecordingBatch();
+
+	if ( staging.dedicatedAllocation != VK_NULL_HANDLE ) {
+		batch.dedicatedStaging.push_back( { staging.buffer, staging.dedicatedAllocation } );
+		return batch;
+	}
+
+	// Newer allocations may already be in this batch, it owns the ring from whichever is oldest
+	if ( batch.ringBytes == 0 || staging.sequence < batch.ringSequence ) {
+		batch.ringBegin = staging.offset;
+		batch.ringSequence = staging.sequence;
+	}
+
+	batch.ringBytes += staging.size;
+
+	reservations.erase( staging.sequence );
+	reservationReleased.notify_all();
+
+	return batch;
+}
+
+void UploadManager::ReleaseBuffer( Batch &batch, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size )
+{
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = 0;
+	barrier.srcQueueFamilyIndex = queueFamily;
+	barrier.dstQueueFamilyIndex = graphicsFamily;
+	barrier.buffer = buffer;
+	barrier.offset = offset;
+	barrier.size = size;
+
+	vkCmdPipelineBarrier(
+		batch.commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+		0, nullptr,
+		1, &barrier,
+		0, nullptr
+	);
+
+	// The acquire half has to match the release apart from the access masks
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	batch.bufferAcquires.push_back( barrier );
+
+	++stats.ownershipTransfers;
+}
+
+void UploadManager::ReleaseImage( Batch &batch, VkImage image, uint32_t baseMipLevel, uint32_t mipLevels, VkImageLayout newLayout, VkAccessFlags dstAccessMask )
+{
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = 0;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = queueFamily;
+	barrier.dstQueueFamilyIndex = graphicsFamily;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = baseMipLevel;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(
+		batch.commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier
+	);
+
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = dstAccessMask;
+	batch.imageAcquires.push_back( barrier );
+
+	++stats.ownershipTransfers;
+}
+
+void UploadManager::Submit( Batch &batch )
+{
+	if ( dedicatedTransfer )
+	{
+		vkEndCommandBuffer( batch.commandBuffer );
+
+		VkSubmitInfo transferSubmit = {};
+		transferSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		transferSubmit.commandBufferCount = 1;
+		transferSubmit.pCommandBuffers = &batch.commandBuffer;
+		transferSubmit.signalSemaphoreCount = 1;
+		transferSubmit.pSignalSemaphores = &batch.transferComplete;
+
+		// Nothing else submits to the transfer queue, our own lock is enough
+		if ( vkQueueSubmit( queue, 1, &transferSubmit, VK_NULL_HANDLE ) != VK_SUCCESS ) {
+			engine->Error( "[Vulkan]Failed to submit upload batch" );
+		}
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		vkBeginCommandBuffer( batch.acquireCommandBuffer, &beginInfo );
+
+		vkCmdPipelineBarrier(
+			batch.acquireCommandBuffer,
+			ConsumerStages, ConsumerStages, 0,
+			0, nullptr,
+			static_cast< uint32_t >( batch.bufferAcquires.size() ), batch.bufferAcquires.data(),
+			static_cast< uint32_t >( batch.imageAcquires.size() ), batch.imageAcquires.data()
+		);
+
+		for ( const MipJob &job : batch.mipJobs )
+			vulkanSystem->CmdGenerateMipMaps( batch.acquireCommandBuffer, job.image, job.format, job.width, job.height, job.mipLevels );
+
+		vkEndCommandBuffer( batch.acquireCommandBuffer );
+
+		const VkPipelineStageFlags waitStage = ConsumerStages;
+
+		VkSubmitInfo acquireSubmit = {};
+		acquireSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		acquireSubmit.waitSemaphoreCount = 1;
+		acquireSubmit.pWaitSemaphores = &batch.transferComplete;
+		acquireSubmit.pWaitDstStageMask = &waitStage;
+		acquireSubmit.commandBufferCount = 1;
+		acquireSubmit.pCommandBuffers = &batch.acquireCommandBuffer;
+
+		// The fence sits on the graphics half, which can't finish before the transfer half it waits on
+		std::lock_guard< std::mutex > queueLock( vulkanSystem->graphicsQueueMutex );
+
+		if ( vkQueueSubmit( vulkanSystem->graphicsQueue, 1, &acquireSubmit, batch.fence ) != VK_SUCCESS ) {
+			engine->Error( "[Vulkan]Failed to submit upload batch" );
+		}
+	}
+	else
+	{
+		// Make every copy in the batch visible to whatever reads it in later submissions on this queue
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(
+			batch.commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, ConsumerStages, 0,
+			1, &barrier,
+			0, nullptr,
+			0, nullptr
+		);
+
+		vkEndCommandBuffer( batch.commandBuffer );
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+		std::lock_guard< std::mutex > queueLock( vulkanSystem->graphicsQueueMutex );
+
+		if ( vkQueueSubmit( vulkanSystem->graphicsQueue, 1, &submitInfo, batch.fence ) != VK_SUCCESS ) {
+			engine->Error( "[Vulkan]Failed to submit upload batch" );
+		}
+	}
+
+	inFlight.push_back( &batch );
+	++stats.submits;
+
+	if ( recordingBatch == &batch )
+		recordingBatch = nullptr;
+}
+
+void UploadManager::RetireCompleted( bool waitForOldest )
+{
+	while ( !inFlight.empty() )
+	{
+		Batch *batch = inFlight.front();
+
+		if ( waitForOldest ) {
+			vkWaitForFences( vulkanSystem->device, 1, &batch->fence, VK_TRUE, std::numeric_limits< uint64_t >::max() );
+			waitForOldest = false;
+		}
+		else if ( vkGetFenceStatus( vulkanSystem->device, batch->fence ) != VK_SUCCESS ) {
+			break;
+		}
+
+		inFlight.pop_front();
+		ResetBatch( *batch );
+		freeBatches.push_back( batch );
+		++retiredSubmits;
+	}
+}
+
+void UploadManager::ResetBatch( Batch &batch )
+{
+	for ( auto &staging : batch.dedicatedStaging )
+		vmaDestroyBuffer( vulkanSystem->allocator, staging.first, staging.second );
+
+	batch.dedicatedStaging.clear();
+
+	batch.bufferAcquires.clear();
+	batch.imageAcquires.clear();
+	batch.mipJobs.clear();
+
+	vkResetFences( vulkanSystem->device, 1, &batch.fence );
+	vkResetCommandBuffer( batch.commandBuffer, 0 );
+
+	if ( batch.acquireCommandBuffer != VK_NULL_HANDLE )
+		vkResetCommandBuffer( batch.acquireCommandBuffer, 0 );
+
+	batch.ringBegin = 0;
+	batch.ringSequence = 0;
+	batch.ringBytes = 0;
+	batch.copies = 0;
+}
+
+void UploadManager::RunBenchmark( size_t uploadCount, VkDeviceSize uploadSize )
+{
+	constexpr VkDeviceSize dstSlots = 64;
+
+	std::vector< unsigned char > payload( static_cast< size_t >( uploadSize ), 0xAB );
+
+	VkBuffer dstBuffer = VK_NULL_HANDLE;
+	VmaAllocation dstAllocation = VK_NULL_HANDLE;
+	vulkanSystem->VmaCreateBuffer( uploadSize * dstSlots, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, dstBuffer, dstAllocation );
+
+	Finish();
+
+	// What every mesh and texture used to do, a fresh staging buffer and a queue idle per copy
+	Clock clock;
+	clock.Start();
+
+	for ( size_t i = 0; i < uploadCount; ++i )
+	{
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		VmaAllocation stagingBufferAllocation = VK_NULL_HANDLE;
+
+		vulkanSystem->VmaCreateBuffer( uploadSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, stagingBuffer, stagingBufferAllocation );
+
+		void *pData = nullptr;
+		vulkanSystem->VmaMapMemory( stagingBufferAllocation, &pData );
+			std::memcpy( pData, payload.data(), payload.size() );
+		vulkanSystem->VmaUnmapMemory( stagingBufferAllocation );
+
+		vulkanSystem->CopyBuffer( stagingBuffer, dstBuffer, uploadSize );
+		vulkanSystem->VmaDestroyBuffer( stagingBuffer, stagingBufferAllocation );
+	}
+
+	const double singleTimeSeconds = clock.Duration< double >();
+
+	const Stats before = stats;
+	clock.Start();
+
+	for ( size_t i = 0; i < uploadCount; ++i )
+		UploadBuffer( dstBuffer, payload.data(), uploadSize, ( i % dstSlots ) * uploadSize );
+
+	Finish();
+
+	const double batchedSeconds = clock.Duration< double >();
+
+	vulkanSystem->VmaDestroyBuffer( dstBuffer, dstAllocation );
+
+	Log::Println( "[Vulkan]Upload benchmark: {} uploads of {} KB", uploadCount, uploadSize >> 10 );
+	Log::Println( "\tstaging buffer per copy: {:.0f} uploads/s", uploadCount / singleTimeSeconds );
+	Log::Println( "\tstaging ring: {:.0f} uploads/s, {} submits, {} stalls", uploadCount / batchedSeconds, stats.submits - before.submits, stats.stalls - before.stalls );
+}
@@ -0,0 +1,175 @@
+#ifndef UPLOADMANAGER_HPP
+#define UPLOADMANAGER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+class Engine;
+class VulkanSystem;
+
+// Streams buffer and image data to the GPU through one persistently mapped staging ring.
+// Copies are recorded into a batch that is submitted as a single command buffer with a fence,
+// ring space is handed back once that fence signals instead of idling the queue after every copy.
+// When the device has a dedicated transfer family the copies run there and each batch hands the
+// resources over to the graphics family with a semaphore and release/acquire barriers
+class UploadManager
+{
+public:
+	static constexpr VkDeviceSize DefaultRingSize = 64ull << 20;
+	static constexpr size_t MaxBatches = 4;
+
+	struct Stats
+	{
+		size_t uploads = 0;
+		size_t submits = 0;
+		size_t stalls = 0; // Times we had to block on a fence to free up ring space
+		size_t dedicatedStagingBuffers = 0;
+		size_t ownershipTransfers = 0;
+		VkDeviceSize bytes = 0;
+	};
+
+	// Staging space from ReserveStaging. The thread that reserved it fills 'data' without holding any lock, then hands it
+	// back through one of the upload calls or CancelStaging. Don't reserve or upload anything else in between, waiting
+	// for ring space while holding a reservation can wait on itself
+	struct Reservation
+	{
+		void *data = nullptr;
+		VkDeviceSize size = 0;
+
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		uint64_t sequence = 0; // Ring allocation order
+		VmaAllocation dedicatedAllocation = VK_NULL_HANDLE;
+	};
+
+	UploadManager( Engine *engine, VulkanSystem *vulkanSystem, VkDeviceSize ringSize = DefaultRingSize );
+	~UploadManager();
+
+	// Hands out 'size' bytes of mapped staging memory to write an upload straight into, so the data doesn't have to
+	// be built somewhere else first and copied over. Thread safe, blocks while the ring is full
+	Reservation ReserveStaging( VkDeviceSize size );
+
+	// Gives back a reservation that won't be uploaded
+	void CancelStaging( const Reservation &staging );
+
+	// Copies 'size' bytes of 'data' into 'dstBuffer' at 'dstOffset', the buffer needs VK_BUFFER_USAGE_TRANSFER_DST_BIT
+	void UploadBuffer( VkBuffer dstBuffer, const void *data, VkDeviceSize size, VkDeviceSize dstOffset = 0 );
+
+	// Copies tightly packed pixels into mip 0 of an image in UNDEFINED layout, then either blits the rest of the
+	// mip chain or transitions it straight to SHADER_READ_ONLY_OPTIMAL
+	void UploadImage( VkImage image, VkFormat format, const void *data, VkDeviceSize size, uint32_t width, uint32_t height, uint32_t mipLevels, bool generateMipMaps );
+	void UploadImage( const Reservation &staging, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, bool generateMipMaps );
+
+	// Copies prebuilt mips into levels [baseMipLevel, baseMipLevel + levelCount) of an image with one copy region per mip
+	// and leaves them in SHADER_READ_ONLY_OPTIMAL, other levels are left alone. Those levels must not have been used yet.
+	// Region buffer offsets are relative to 'data'
+	void UploadImageMips( VkImage image, VkFormat format, const void *data, VkDeviceSize size, uint32_t baseMipLevel, uint32_t levelCount, const std::vector< VkBufferImageCopy > &regions );
+	void UploadImageMips( const Reservation &staging, VkImage image, VkFormat format, uint32_t baseMipLevel, uint32_t levelCount, const std::vector< VkBufferImageCopy > &regions );
+
+	// Submits whatever has been recorded so far, does not wait. Returns the serial of the last submitted batch,
+	// everything recorded before the call is complete once IsComplete returns true for it
+	uint64_t Flush();
+
+	// Polls, true once every batch up to and including 'serial' has finished on the GPU
+	bool IsComplete( uint64_t serial );
+
+	// Submits and waits for every batch in flight, after this all uploads are visible to the GPU
+	void Finish();
+
+	// Measures batched uploads against the old staging buffer per copy path and logs uploads per second
+	void RunBenchmark( size_t uploadCount, VkDeviceSize uploadSize );
+
+	const Stats &GetStats() const { return stats; }
+
+private:
+	struct MipJob
+	{
+		VkImage image = VK_NULL_HANDLE;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		int32_t width = 0;
+		int32_t height = 0;
+		uint32_t mipLevels = 1;
+	};
+
+	struct Batch
+	{
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+
+		// Only used with a dedicated transfer queue, the graphics side acquires what the copies released
+		// and does the mip blits, since transfer queues can't blit
+		VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+		VkSemaphore transferComplete = VK_NULL_HANDLE;
+		std::vector< VkBufferMemoryBarrier > bufferAcquires;
+		std::vector< VkImageMemoryBarrier > imageAcquires;
+		std::vector< MipJob > mipJobs;
+
+		VkDeviceSize ringBegin = 0; // Offset of the batch's oldest ring allocation
+		uint64_t ringSequence = 0;
+		VkDeviceSize ringBytes = 0;
+		size_t copies = 0;
+
+		// Uploads bigger than the ring get their own staging buffer that lives until the batch retires
+		std::vector< std::pair< VkBuffer, VmaAllocation > > dedicatedStaging;
+	};
+
+	// Returns the current batch, beginning its command buffer if needed
+	Batch &GetRecordingBatch();
+
+	// Reserves ring space for a copy, flushing and waiting on older batches when the ring is full
+	VkDeviceSize AllocateStaging( VkDeviceSize size, VkDeviceSize alignment, Batch *&batch, VkBuffer &stagingBuffer, void *&mapped );
+	void CreateDedicatedStaging( VkDeviceSize size, VkBuffer &stagingBuffer, VmaAllocation &allocation, void *&mapped );
+
+	// Callers hold the lock exactly once, waiting on a reservation unlocks it
+	VkDeviceSize AllocateRing( VkDeviceSize size, VkDeviceSize alignment, uint64_t &sequence );
+	bool TryAllocateRing( VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset );
+
+	// Moves a reservation's staging space over to the recording batch, it's freed when that batch retires
+	Batch &ClaimReservation( const Reservation &staging );
+
+	void ReleaseBuffer( Batch &batch, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size );
+	void ReleaseImage( Batch &batch, VkImage image, uint32_t baseMipLevel, uint32_t mipLevels, VkImageLayout newLayout, VkAccessFlags dstAccessMask );
+
+	void Submit( Batch &batch );
+	void RetireCompleted( bool waitForOldest );
+	void ResetBatch( Batch &batch );
+
+	Engine *engine = nullptr;
+	VulkanSystem *vulkanSystem = nullptr;
+
+	VkQueue queue = VK_NULL_HANDLE;
+	uint32_t queueFamily = 0;
+	uint32_t graphicsFamily = 0;
+	bool dedicatedTransfer = false;
+
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkCommandPool acquireCommandPool = VK_NULL_HANDLE;
+	VkBuffer ringBuffer = VK_NULL_HANDLE;
+	VmaAllocation ringAllocation = VK_NULL_HANDLE;
+	unsigned char *ringData = nullptr;
+	VkDeviceSize ringSize = 0;
+	VkDeviceSize ringHead = 0;
+	VkDeviceSize optimalCopyAlignment = 4;
+
+	Batch batches[ MaxBatches ];
+	Batch *recordingBatch = nullptr;
+	std::deque< Batch* > inFlight;
+	std::vector< Batch* > freeBatches;
+	uint64_t retiredSubmits = 0; // Batches retire in submit order, so this is the serial of the newest finished one
+
+	// Reserved ring space that no batch owns yet, by allocation order. The ring can't be reused past the oldest one
+	std::map< uint64_t, VkDeviceSize > reservations;
+	std::condition_variable_any reservationReleased;
+	uint64_t ringAllocations = 0;
+
+	Stats stats;
+	std::recursive_mutex mutex;
+};
+
+#endif // UPLOADMANAGER_HPP
@@ -1,26 +1,25 @@
 #include "vertex.hpp"
 #include "log.hpp"
 
-VertexLayout::VertexLayout( const std::multiset< Vertex::Component > &vertexComponents ) :
-	vertexComponents( vertexComponents )
+VertexLayout::VertexLayout( const std::multiset< Vertex::Component > &vertexComponents, PackFunction packFunction ) :
+	vertexComponents( vertexComponents ),
+	packFunction( packFunction )
 {
 	for ( const auto &comp : vertexComponents )
+	{
+		offsets[ (size_t)comp ].push_back( stride );
 		stride += (uint32_t)Vertex::GetComponentSize( comp );
+	}
 }
 
 size_t VertexLayout::GetOffset( Vertex::Component vertexComponent, size_t componentIndex ) const
 {
-	if ( componentIndex >= vertexComponents.count( vertexComponent ) )
-		return InvalidOffset();
-
-	auto compIt = vertexComponents.find( vertexComponent );
-	std::advance( compIt, componentIndex );
+	const auto &componentOffsets = offsets[ (size_t)vertexComponent ];
 
-	size_t offset = 0;
-	for ( auto it = vertexComponents.cbegin(); it != compIt; ++it )
-		offset += Vertex::GetComponentSize( *it );
+	if ( componentIndex >= componentOffsets.size() )
+		return InvalidOffset();
 
-	return offset;
+	return componentOffsets[ componentIndex ];
 }
 
 VkVertexInputBindingDescription VertexLayout::ToInputBindingDescription( uint32_t binding ) const
@@ -36,70 +35,25 @@ VkVertexInputBindingDescription VertexLayout::ToInputBindingDescription( uint32_
 std::vector< VkVertexInputAttributeDescription > VertexLayout::ToInputAttributeDescriptions( uint32_t binding ) const
 {
 	std::vector< VkVertexInputAttributeDescription > descriptions;
-	descriptions.resize( vertexComponents.size() );
+	descriptions.reserve( vertexComponents.size() );
 
-	auto computeOffset = []( const std::multiset< Vertex::Component > &vertexComponents, size_t index ) -> uint32_t
-	{
-		uint32_t offset = 0;
+	uint32_t offset = 0;
 
-		if ( index < vertexComponents.size() )
-		{
-			for ( size_t i = 0; i < index; ++i )
-			{
-				auto compIt = vertexComponents.cbegin();
-				std::advance( compIt, i );
-
-				offset += (uint32_t)Vertex::GetComponentSize( *compIt );
-			}
-		}
-
-		return offset;
-	};
-
-	for ( size_t i = 0; i < descriptions.size(); ++i )
+	for ( const auto &comp : vertexComponents )
 	{
-		auto &desc = descriptions[ i ];
+		VkVertexInputAttributeDescription desc = {};
 		desc.binding = binding;
-		desc.location = (uint32_t)i;
-		desc.offset = computeOffset( vertexComponents, i );
-
-		auto compIt = vertexComponents.cbegin();
-		std::advance( compIt, i );
+		desc.location = (uint32_t)descriptions.size();
+		desc.format = Vertex::GetComponentFormat( comp );
+		desc.offset = offset;
 
-		switch ( (*compIt) )
-		{
-			case Vertex::Component::Position:
-			case Vertex::Component::Normal:
-			case Vertex::Component::Tangent:
-			case Vertex::Component::BiTangent:
-				desc.format = VK_FORMAT_R32G32B32_SFLOAT;
-				break;
-			case Vertex::Component::Color:
-				desc.format = VK_FORMAT_R32G32B32A32_SFLOAT;
-				break;
-			case Vertex::Component::UV:
-				desc.format = VK_FORMAT_R32G32_SFLOAT;
-				break;
-		}
+		descriptions.push_back( desc );
+		offset += (uint32_t)Vertex::GetComponentSize( comp );
 	}
 
 	return descriptions;
 }
 
-size_t Vertex::GetComponentSize( Vertex::Component component )
-{
-	static size_t vertexComponentSizes[ (size_t)Vertex::Component::Count ] = {
-		sizeof( glm::vec3 ), // Position
-		sizeof( glm::vec3 ), // Normal
-		sizeof( glm::vec4 ), // Color
-		sizeof( glm::vec2 ), // UV
-		sizeof( glm::vec3 ), // Tangent
-		sizeof( glm::vec3 )  // BiTangent
-	};
-
-	return vertexComponentSizes[ (size_t)component ];
-}
-
 VertexArray::VertexArray( const VertexLayout &vertexLayout ) :
 	vertexLayout( vertexLayout )
 {
@@ -119,6 +73,37 @@ void VertexArray::Resize( size_t newVertexCount )
 	vertexCount = newVertexCount;
 }
 
+void VertexArray::Pack( const VertexAttributes *attributes, size_t count )
+{
+	Resize( count );
+
+	if ( auto packFunction = vertexLayout.GetPackFunction(); packFunction )
+	{
+		packFunction( attributes, count, vertexBuffer.data() );
+		return;
+	}
+
+	for ( size_t v = 0; v < count; ++v )
+	{
+		SetPosition( v, attributes[ v ].position, 0 );
+		SetNormal( v, attributes[ v ].normal, 0 );
+		SetColor( v, attributes[ v ].color, 0 );
+		SetUV( v, attributes[ v ].uv, 0 );
+		SetTangent( v, attributes[ v ].tangent, 0 );
+		SetBiTangent( v, attributes[ v ].bitangent, 0 );
+
+		const uint64_t normal = Vertex::PackNormalSnorm16( attributes[ v ].normal );
+		const uint32_t color = Vertex::PackColorUnorm8( attributes[ v ].color );
+		const uint32_t uv = Vertex::PackUVHalf( attributes[ v ].uv );
+		const uint32_t tangent = Vertex::PackTangentSnorm8( attributes[ v ].normal, attributes[ v ].tangent, attributes[ v ].bitangent );
+
+		Set( v, vertexLayout.GetOffset( Vertex::Component::NormalSnorm16, 0 ), (std::byte*)&normal, sizeof( normal ) );
+		Set( v, vertexLayout.GetOffset( Vertex::Component::ColorUnorm8, 0 ), (std::byte*)&color, sizeof( color ) );
+		Set( v, vertexLayout.GetOffset( Vertex::Component::UVHalf, 0 ), (std::byte*)&uv, sizeof( uv ) );
+		Set( v, vertexLayout.GetOffset( Vertex::Component::TangentSnorm8, 0 ), (std::byte*)&tangent, sizeof( tangent ) );
+	}
+}
+
 void VertexArray::SetPosition( size_t vertexIndex, const glm::vec3 &position, size_t positionIndex )
 {
 	Set( vertexIndex, vertexLayout.GetOffset( Vertex::Component::Position, positionIndex ), (std::byte*)&position, sizeof( position ) );
@@ -2,33 +2,114 @@
 #define VERTEX_HPP
 
 #include "glm/glm.hpp"
+#include "glm/gtc/packing.hpp"
 #include <vulkan/vulkan.h>
 
+#include <array>
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
 #include <limits>
 #include <vector>
 #include <set>
 
 struct Vertex
 {
+	// Packed variants sit next to their float counterparts so attribute locations keep the same order
 	enum class Component : uint32_t
 	{
 		Position,
 		Normal,
+		NormalSnorm16,	// xyz snorm16, w unused
 		Color,
+		ColorUnorm8,
 		UV,
+		UVHalf,
 		Tangent,
+		TangentSnorm8,	// xyz snorm8, w is the bitangent sign, bitangent = cross( normal, tangent.xyz ) * tangent.w
 		BiTangent,
 		Count
 	};
 
-	static size_t GetComponentSize( Vertex::Component component );
+	static constexpr size_t GetComponentSize( Vertex::Component component )
+	{
+		switch ( component )
+		{
+			case Component::Position:
+			case Component::Normal:
+			case Component::Tangent:
+			case Component::BiTangent:
+				return sizeof( glm::vec3 );
+			case Component::Color:
+				return sizeof( glm::vec4 );
+			case Component::UV:
+				return sizeof( glm::vec2 );
+			case Component::NormalSnorm16:
+				return sizeof( uint64_t );
+			case Component::ColorUnorm8:
+			case Component::UVHalf:
+			case Component::TangentSnorm8:
+				return sizeof( uint32_t );
+			default:
+				return 0;
+		}
+	}
+
+	static constexpr VkFormat GetComponentFormat( Vertex::Component component )
+	{
+		switch ( component )
+		{
+			case Component::Position:
+			case Component::Normal:
+			case Component::Tangent:
+			case Component::BiTangent:
+				return VK_FORMAT_R32G32B32_SFLOAT;
+			case Component::Color:
+				return VK_FORMAT_R32G32B32A32_SFLOAT;
+			case Component::UV:
+				return VK_FORMAT_R32G32_SFLOAT;
+			case Component::NormalSnorm16:
+				return VK_FORMAT_R16G16B16A16_SNORM;
+			case Component::ColorUnorm8:
+				return VK_FORMAT_R8G8B8A8_UNORM;
+			case Component::UVHalf:
+				return VK_FORMAT_R16G16_SFLOAT;
+			case Component::TangentSnorm8:
+				return VK_FORMAT_R8G8B8A8_SNORM;
+			default:
+				return VK_FORMAT_UNDEFINED;
+		}
+	}
+
+	// Quantizers for the packed components, component order in memory matches the Vulkan formats above
+	static inline uint64_t PackNormalSnorm16( const glm::vec3 &normal ) { return glm::packSnorm4x16( glm::vec4( normal, 0.0f ) ); }
+	static inline uint32_t PackColorUnorm8( const glm::vec4 &color ) { return glm::packUnorm4x8( color ); }
+	static inline uint32_t PackUVHalf( const glm::vec2 &uv ) { return glm::packHalf2x16( uv ); }
+
+	static inline uint32_t PackTangentSnorm8( const glm::vec3 &normal, const glm::vec3 &tangent, const glm::vec3 &bitangent )
+	{
+		const float sign = ( glm::dot( glm::cross( normal, tangent ), bitangent ) < 0.0f ) ? -1.0f : 1.0f;
+		return glm::packSnorm4x8( glm::vec4( tangent, sign ) );
+	}
+};
+
+// Every attribute an importer can provide for a single vertex, packed down to a layout by VertexArray::Pack
+struct VertexAttributes
+{
+	glm::vec3 position = { 0.0f, 0.0f, 0.0f };
+	glm::vec3 normal = { 0.0f, 0.0f, 0.0f };
+	glm::vec4 color = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glm::vec2 uv = { 0.0f, 0.0f };
+	glm::vec3 tangent = { 0.0f, 0.0f, 0.0f };
+	glm::vec3 bitangent = { 0.0f, 0.0f, 0.0f };
 };
 
 struct VertexLayout
 {
-	VertexLayout( const std::multiset< Vertex::Component > &vertexComponents );
+	// Packs count vertices into dst, provided by layouts created from a VertexFormat
+	using PackFunction = void (*)( const VertexAttributes *attributes, size_t count, std::byte *dst );
+
+	VertexLayout( const std::multiset< Vertex::Component > &vertexComponents, PackFunction packFunction = nullptr );
 
 	constexpr static inline size_t InvalidOffset() { return std::numeric_limits< size_t >::max(); }
 
@@ -41,14 +122,137 @@ struct VertexLayout
 	VkVertexInputBindingDescription ToInputBindingDescription( uint32_t binding ) const;
 	std::vector< VkVertexInputAttributeDescription > ToInputAttributeDescriptions( uint32_t binding ) const;
 
+	PackFunction GetPackFunction() const { return packFunction; }
+
 private:
 
 	const std::multiset< Vertex::Component > vertexComponents;
 	uint32_t stride = 0;
+
+	// Offsets of every occurrence of each component, so lookups don't walk the multiset
+	std::array< std::vector< uint32_t >, (size_t)Vertex::Component::Count > offsets;
+
+	PackFunction packFunction = nullptr;
+};
+
+// Compile-time vertex layout, components must be listed in the same order VertexLayout sorts them
+template < Vertex::Component... Components >
+struct VertexFormat
+{
+	static constexpr size_t ComponentCount = sizeof...( Components );
+	static constexpr std::array< Vertex::Component, ComponentCount > ComponentList = { Components... };
+	static constexpr uint32_t Stride = ( 0 + ... + (uint32_t)Vertex::GetComponentSize( Components ) );
+
+	static constexpr std::array< uint32_t, ComponentCount > Offsets = []()
+	{
+		std::array< uint32_t, ComponentCount > offsets = {};
+		uint32_t offset = 0;
+
+		for ( size_t i = 0; i < ComponentCount; ++i )
+		{
+			offsets[ i ] = offset;
+			offset += (uint32_t)Vertex::GetComponentSize( ComponentList[ i ] );
+		}
+
+		return offsets;
+	}();
+
+	static_assert( []()
+	{
+		for ( size_t i = 1; i < ComponentCount; ++i )
+		{
+			if ( ComponentList[ i ] < ComponentList[ i - 1 ] )
+				return false;
+		}
+
+		return true;
+	}(), "VertexFormat components must be sorted to match VertexLayout" );
+
+	// Returns the position of the componentIndex'th occurrence of component, ComponentCount if not present
+	static constexpr size_t Find( Vertex::Component component, size_t componentIndex )
+	{
+		for ( size_t i = 0; i < ComponentCount; ++i )
+		{
+			if ( ComponentList[ i ] == component && componentIndex-- == 0 )
+				return i;
+		}
+
+		return ComponentCount;
+	}
+
+	template < Vertex::Component component, size_t componentIndex = 0 >
+	static constexpr bool Has() { return Find( component, componentIndex ) != ComponentCount; }
+
+	template < Vertex::Component component, size_t componentIndex = 0 >
+	static constexpr uint32_t Offset()
+	{
+		static_assert( Has< component, componentIndex >(), "Component not present in VertexFormat" );
+		return Offsets[ Find( component, componentIndex ) ];
+	}
+
+	static constexpr VkVertexInputBindingDescription InputBindingDescription( uint32_t binding )
+	{
+		return VkVertexInputBindingDescription { binding, Stride, VK_VERTEX_INPUT_RATE_VERTEX };
+	}
+
+	static constexpr std::array< VkVertexInputAttributeDescription, ComponentCount > InputAttributeDescriptions( uint32_t binding )
+	{
+		std::array< VkVertexInputAttributeDescription, ComponentCount > descriptions = {};
+
+		for ( size_t i = 0; i < ComponentCount; ++i )
+			descriptions[ i ] = VkVertexInputAttributeDescription { (uint32_t)i, binding, Vertex::GetComponentFormat( ComponentList[ i ] ), Offsets[ i ] };
+
+		return descriptions;
+	}
+
+	// Stores value at a constant offset into vertex, does nothing if the component isn't part of this format
+	template < Vertex::Component component, size_t componentIndex = 0, typename T >
+	static inline void Write( std::byte *vertex, const T &value )
+	{
+		if constexpr ( Has< component, componentIndex >() )
+		{
+			static_assert( sizeof( T ) == Vertex::GetComponentSize( component ), "Value does not match component size" );
+			std::memcpy( vertex + Offset< component, componentIndex >(), &value, sizeof( T ) );
+		}
+	}
+
+	static void Pack( const VertexAttributes *attributes, size_t count, std::byte *dst )
+	{
+		for ( size_t i = 0; i < count; ++i, dst += Stride )
+		{
+			const VertexAttributes &attrib = attributes[ i ];
+			Write< Vertex::Component::Position >( dst, attrib.position );
+			Write< Vertex::Component::Normal >( dst, attrib.normal );
+			Write< Vertex::Component::Color >( dst, attrib.color );
+			Write< Vertex::Component::UV >( dst, attrib.uv );
+			Write< Vertex::Component::Tangent >( dst, attrib.tangent );
+			Write< Vertex::Component::BiTangent >( dst, attrib.bitangent );
+
+			if constexpr ( Has< Vertex::Component::NormalSnorm16 >() )
+				Write< Vertex::Component::NormalSnorm16 >( dst, Vertex::PackNormalSnorm16( attrib.normal ) );
+
+			if constexpr ( Has< Vertex::Component::ColorUnorm8 >() )
+				Write< Vertex::Component::ColorUnorm8 >( dst, Vertex::PackColorUnorm8( attrib.color ) );
+
+			if constexpr ( Has< Vertex::Component::UVHalf >() )
+				Write< Vertex::Component::UVHalf >( dst, Vertex::PackUVHalf( attrib.uv ) );
+
+			if constexpr ( Has< Vertex::Component::TangentSnorm8 >() )
+				Write< Vertex::Component::TangentSnorm8 >( dst, Vertex::PackTangentSnorm8( attrib.normal, attrib.tangent, attrib.bitangent ) );
+		}
+	}
+
+	// Runtime layout for this format, built once
+	static const VertexLayout &Layout()
+	{
+		static const VertexLayout layout( { Components... }, &Pack );
+		return layout;
+	}
 };
 
 struct VertexArray
 {
+	// The layout isn't copied, it has to outlive the array. Shaders hand out their format's static one
 	VertexArray( const VertexLayout &vertexLayout );
 
 	// Adds new vertex to vertex buffer, returns vertex index of newly created vertex
@@ -57,6 +261,11 @@ struct VertexArray
 	// Resizes vertex buffer, if newVetexCount is less than current count, vertices after newVertexCount will be cleared
 	void Resize( size_t newVertexCount );
 
+	// Replaces contents with count vertices converted to this array's layout
+	void Pack( const VertexAttributes *attributes, size_t count );
+
+	const VertexLayout &GetLayout() const { return vertexLayout; }
+
 	void SetPosition( size_t vertexIndex, const glm::vec3 &position, size_t positionIndex );
 	void SetNormal( size_t vertexIndex, const glm::vec3 &normal, size_t normalIndex );
 	void SetColor( size_t vertexIndex, const glm::vec4 &color, size_t colorIndex );
@@ -74,7 +283,7 @@ private:
 	size_t GetVertexOffset( size_t vertexIndex ) const;
 	bool IsValidVertex( size_t vertexIndex ) const;
 
-	const VertexLayout vertexLayout;
+	const VertexLayout &vertexLayout;
 	std::vector< std::byte > vertexBuffer;
 
 	size_t vertexCount = 0;
@@ -2,6 +2,7 @@
 #include "vulkansystem.hpp"
 #include "log.hpp"
 #include "engine.hpp"
+#include "commandlinesystem.hpp"
 
 #include <map>
 #include <set>
@@ -201,6 +202,9 @@ void VulkanSystem::CreateLogicalDevice()
 	std::vector< VkDeviceQueueCreateInfo > queueCreateInfos;
 	std::set< uint32_t > uniqueQueueFamilies = { queueFamilyIndices.graphicsFamily.value(), queueFamilyIndices.presentFamily.value() };
 
+	if ( queueFamilyIndices.transferFamily.has_value() )
+		uniqueQueueFamilies.insert( queueFamilyIndices.transferFamily.value() );
+
 	const float queuePriority = 1.0f;
 	for ( auto &queueFamily : uniqueQueueFamilies )
 	{
@@ -239,8 +243,19 @@ void VulkanSystem::CreateLogicalDevice()
 		engine->Error( "[Vulkan]Failed to create logical device" );
 	}
 
+	enabledFeatures = deviceFeatures;
+
 	vkGetDeviceQueue( device, queueFamilyIndices.graphicsFamily.value(), 0, &graphicsQueue );
 	vkGetDeviceQueue( device, queueFamilyIndices.presentFamily.value(), 0, &presentQueue );
+
+	if ( queueFamilyIndices.transferFamily.has_value() ) {
+		vkGetDeviceQueue( device, queueFamilyIndices.transferFamily.value(), 0, &transferQueue );
+		Log::Println( "[Vulkan]Using queue family {} for uploads", queueFamilyIndices.transferFamily.value() );
+	}
+	else {
+		transferQueue = graphicsQueue;
+		Log::Println( "[Vulkan]No dedicated transfer queue family, uploads share the graphics queue" );
+	}
 }
 
 void VulkanSystem::CreateVmaAllocator()
@@ -608,6 +623,29 @@ VulkanSystem::QueueFamilyIndices VulkanSystem::FindQueueFamilies( VkPhysicalDevi
 		}
 	}
 
+	if ( !allowTransferQueue ) {
+		return indices;
+	}
+
+	// Prefer a family that can only transfer, those map to the copy engines on discrete GPUs,
+	// otherwise settle for any non graphics family (compute queues can always transfer)
+	for ( size_t index = 0; index < queueFamilies.size(); ++index )
+	{
+		const VkQueueFlags flags = queueFamilies[ index ].queueFlags;
+
+		if ( queueFamilies[ index ].queueCount == 0 || ( flags & VK_QUEUE_GRAPHICS_BIT ) || !( flags & ( VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT ) ) ) {
+			continue;
+		}
+
+		if ( !indices.transferFamily.has_value() || !( flags & VK_QUEUE_COMPUTE_BIT ) ) {
+			indices.transferFamily = static_cast< uint32_t >( index );
+		}
+
+		if ( !( flags & VK_QUEUE_COMPUTE_BIT ) ) {
+			break;
+		}
+	}
+
 	return indices;
 }
 
@@ -685,6 +723,8 @@ void VulkanSystem::configure( Engine *engine )
 {
 	EngineSystem::configure( engine );
 
+	allowTransferQueue = !engine->GetCommandLineSystem()->HasOption( "--notransferqueue" );
+
 	LoadExtensions( engine->GetWindow() );
 #if VK_DEBUG
 	CheckValidationLayerSupport();
@@ -711,6 +751,14 @@ void VulkanSystem::configure( Engine *engine )
 	CreateDepthResources();
 	CreateFramebuffers();
 	CreateSyncObjects();
+
+	uploadManager = make_unique< UploadManager >( engine, this );
+	geometryArena = make_unique< GeometryArena >( engine, this );
+	samplerCache = make_unique< SamplerCache >( engine, this );
+	uniformAllocator = make_unique< UniformAllocator >( engine, this );
+
+	if ( engine->GetCommandLineSystem()->HasOption( "--uploadbenchmark" ) )
+		uploadManager->RunBenchmark( 4096, 64 << 10 );
 }
 
 void VulkanSystem::unconfigure( Engine *engine )
@@ -740,6 +788,11 @@ void VulkanSystem::unconfigure( Engine *engine )
 		}
 	}
 
+	uniformAllocator.reset();
+	samplerCache.reset();
+	geometryArena.reset();
+	uploadManager.reset();
+
 	if ( commandPool != VK_NULL_HANDLE ) {
 		vkDestroyCommandPool( device, commandPool, nullptr );
 		commandPool = VK_NULL_HANDLE;
@@ -757,6 +810,7 @@ void VulkanSystem::unconfigure( Engine *engine )
 		// These are cleaned up when the device is destroyed
 		graphicsQueue = VK_NULL_HANDLE;
 		presentQueue = VK_NULL_HANDLE;
+		transferQueue = VK_NULL_HANDLE;
 	}
 
 #if VK_DEBUG
@@ -787,6 +841,10 @@ void VulkanSystem::unconfigure( Engine *engine )
 void VulkanSystem::WaitIdle()
 {
 	if ( device != VK_NULL_HANDLE ) {
+		// Anything still sitting in an upload batch has to reach the queue before idling means anything
+		if ( uploadManager )
+			uploadManager->Finish();
+
 		vkDeviceWaitIdle( device );
 	}
 }
@@ -934,8 +992,11 @@ void VulkanSystem::EndSingleTimeCommands( VkCommandBuffer &commandBuffer )
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &commandBuffer;
 
-	vkQueueSubmit( graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
-	vkQueueWaitIdle( graphicsQueue );
+	{
+		std::lock_guard< std::mutex > lock( graphicsQueueMutex );
+		vkQueueSubmit( graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
+		vkQueueWaitIdle( graphicsQueue );
+	}
 
 	vkFreeCommandBuffers( device, commandPool, 1, &commandBuffer );
 }
@@ -1001,15 +1062,16 @@ void VulkanSystem::VmaDestroyBuffer( VkBuffer buffer, VmaAllocation allocation )
 	vmaDestroyBuffer( allocator, buffer, allocation );
 }
 
-VkImageView VulkanSystem::CreateImageView2D( VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels )
+VkImageView VulkanSystem::CreateImageView2D( VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, uint32_t baseMipLevel /*= 0*/, VkComponentMapping components /*= {}*/ )
 {
 	VkImageViewCreateInfo viewInfo = {};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	viewInfo.image = image;
 	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
 	viewInfo.format = format;
+	viewInfo.components = components;
 	viewInfo.subresourceRange.aspectMask = aspectFlags;
-	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
 	viewInfo.subresourceRange.levelCount = mipLevels;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
 	viewInfo.subresourceRange.layerCount = 1;
@@ -1048,11 +1110,18 @@ void VulkanSystem::VmaCreateImage2D( uint32_t width, uint32_t height, uint32_t m
 }
 
 void VulkanSystem::CopyBufferToImage( VkBuffer buffer, VkImage image, uint32_t width, uint32_t height )
+{
+	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+		CmdCopyBufferToImage( commandBuffer, buffer, 0, image, width, height );
+	EndSingleTimeCommands( commandBuffer );
+}
+
+void VulkanSystem::CmdCopyBufferToImage( VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height )
 {
 	std::vector< VkBufferImageCopy > bufferCopyRegions;
 
 	VkBufferImageCopy region = {};
-	region.bufferOffset = 0;
+	region.bufferOffset = bufferOffset;
 	region.bufferRowLength = 0;
 	region.bufferImageHeight = 0;
 	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -1063,80 +1132,89 @@ void VulkanSystem::CopyBufferToImage( VkBuffer buffer, VkImage image, uint32_t w
 	region.imageExtent = { width, height, 1 };
 	bufferCopyRegions.push_back( region );
 
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-		vkCmdCopyBufferToImage( commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast< uint32_t >( bufferCopyRegions.size() ), bufferCopyRegions.data() );
-	EndSingleTimeCommands( commandBuffer );
+	vkCmdCopyBufferToImage( commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast< uint32_t >( bufferCopyRegions.size() ), bufferCopyRegions.data() );
 }
 
 void VulkanSystem::TransitionImageLayout( VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels )
 {
 	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-		VkImageMemoryBarrier barrier = {};
-		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		barrier.oldLayout = oldLayout;
-		barrier.newLayout = newLayout;
-		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		barrier.image = image;
+		CmdTransitionImageLayout( commandBuffer, image, format, oldLayout, newLayout, mipLevels );
+	EndSingleTimeCommands( commandBuffer );
+}
+
+void VulkanSystem::CmdTransitionImageLayout( VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels, uint32_t baseMipLevel /*= 0*/ )
+{
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+		
+	if ( newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL ) {
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		auto hasStencilComponent = []( VkFormat format ) { return ( format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT ); };
 			
-		if ( newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL ) {
-			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-			auto hasStencilComponent = []( VkFormat format ) { return ( format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT ); };
-				
-			if ( hasStencilComponent( format ) ) {
-				barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-			}
-		}
-		else {
-			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		if ( hasStencilComponent( format ) ) {
+			barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
 		}
+	}
+	else {
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	}
 
-		barrier.subresourceRange.baseMipLevel = 0;
-		barrier.subresourceRange.levelCount = mipLevels;
-		barrier.subresourceRange.baseArrayLayer = 0;
-		barrier.subresourceRange.layerCount = 1;
-		barrier.srcAccessMask = 0; // TODO
-		barrier.dstAccessMask = 0; // TODO
+	barrier.subresourceRange.baseMipLevel = baseMipLevel;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.srcAccessMask = 0; // TODO
+	barrier.dstAccessMask = 0; // TODO
 
-		VkPipelineStageFlags sourceStage, destinationStage;
+	VkPipelineStageFlags sourceStage, destinationStage;
 
-		if ( oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL ) {
-			barrier.srcAccessMask = 0;
-			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	if ( oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL ) {
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 
-			sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		}
-		else if ( oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL ) {
-			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	}
+	else if ( oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL ) {
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-			sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-			destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		}
-		else if ( oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL ) {
-			barrier.srcAccessMask = 0;
-			barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
+	else if ( oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL ) {
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
-			sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-		}
-		else {
-			engine->Error( "[Vulkan]Unsupported layout transition" );
-		}
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	}
+	else {
+		engine->Error( "[Vulkan]Unsupported layout transition" );
+	}
 
-		vkCmdPipelineBarrier(
-			commandBuffer,
-			sourceStage, destinationStage,
-			0,
-			0, nullptr, 
-			0, nullptr, 
-			1, &barrier );
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		sourceStage, destinationStage,
+		0,
+		0, nullptr, 
+		0, nullptr, 
+		1, &barrier );
+}
 
+void VulkanSystem::GenerateMipMaps( VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels )
+{
+	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+		CmdGenerateMipMaps( commandBuffer, image, imageFormat, texWidth, texHeight, mipLevels );
 	EndSingleTimeCommands( commandBuffer );
 }
 
-void VulkanSystem::GenerateMipMaps( VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels )
+void VulkanSystem::CmdGenerateMipMaps( VkCommandBuffer commandBuffer, VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels )
 {
 	// Check if the image format supports linear blitting
 	VkFormatProperties formatProperties = {};
@@ -1146,8 +1224,6 @@ void VulkanSystem::GenerateMipMaps( VkImage image, VkFormat imageFormat, int32_t
 		engine->Error( "[Vulkan]Failed to find linear blit tiling feature" );
 	}
 
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-
 	VkImageMemoryBarrier barrier = {};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.image = image;
@@ -1234,6 +1310,4 @@ void VulkanSystem::GenerateMipMaps( VkImage image, VkFormat imageFormat, int32_t
 		0, nullptr,
 		1, &barrier
 	);
-
-	EndSingleTimeCommands( commandBuffer );
 }
\ No newline at end of file
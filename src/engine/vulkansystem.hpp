@@ -5,6 +5,7 @@
 #include <vector>
 #include <array>
 #include <optional>
+#include <mutex>
 
 #include <vulkan/vulkan.h>
 #include <vk_mem_alloc.h>
@@ -14,6 +15,10 @@
 
 #include "memory.hpp"
 #include "enginesystem.hpp"
+#include "uploadmanager.hpp"
+#include "geometryarena.hpp"
+#include "samplercache.hpp"
+#include "uniformallocator.hpp"
 
 #define VK_DEBUG 1
 
@@ -46,6 +51,7 @@ class VulkanSystem : public EngineSystem
 	{
 		std::optional< uint32_t > graphicsFamily;
 		std::optional< uint32_t > presentFamily;
+		std::optional< uint32_t > transferFamily; // Only set when the device has a family without graphics we can upload on
 
 		inline bool isComplete() const { return ( graphicsFamily.has_value() && presentFamily.has_value() ); }
 	};
@@ -98,6 +104,10 @@ public:
 
 	void WaitIdle();
 
+	bool HasDedicatedTransferQueue() const { return queueFamilyIndices.transferFamily.has_value(); }
+	bool SupportsBlockCompression() const { return enabledFeatures.textureCompressionBC == VK_TRUE; }
+	bool SupportsSamplerAnisotropy() const { return enabledFeatures.samplerAnisotropy == VK_TRUE; }
+
 	// Tells the VulkanSystem the window has been resized, re-creates the swap chain, returns false if there was an issue
 	void NotifyWindowResized( uint32_t width, uint32_t height );
 
@@ -128,12 +138,17 @@ public:
 	void VmaUnmapMemory( VmaAllocation allocation );
 	void VmaCreateBuffer( VkDeviceSize size, VkBufferUsageFlags bufferUsage, VmaMemoryUsage memoryUsage, VkBuffer &buffer, VmaAllocation &allocation );
 	void VmaDestroyBuffer( VkBuffer buffer, VmaAllocation allocation );
-	VkImageView CreateImageView2D( VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels );
+	VkImageView CreateImageView2D( VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, uint32_t baseMipLevel = 0, VkComponentMapping components = {} );
 	void VmaCreateImage2D( uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags imageUsage, VmaMemoryUsage memoryUsage, VkImage &image, VmaAllocation &allocation );
 	void CopyBufferToImage( VkBuffer buffer, VkImage image, uint32_t width, uint32_t height );
 	void TransitionImageLayout( VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels );
 	void GenerateMipMaps( VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels );
 
+	// Same as above but recorded into an existing command buffer instead of submitted on their own
+	void CmdCopyBufferToImage( VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height );
+	void CmdTransitionImageLayout( VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels, uint32_t baseMipLevel = 0 );
+	void CmdGenerateMipMaps( VkCommandBuffer commandBuffer, VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels );
+
 	std::array< const char*, 1 > deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 	VkInstance instance = VK_NULL_HANDLE;
 	VkDebugUtilsMessengerEXT debugCallback = VK_NULL_HANDLE;
@@ -141,11 +156,19 @@ public:
 	VkSurfaceKHR surface = VK_NULL_HANDLE;
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 	QueueFamilyIndices queueFamilyIndices;
+	VkPhysicalDeviceFeatures enabledFeatures = {};
 	VkDevice device = VK_NULL_HANDLE;
 	VmaAllocator allocator = VK_NULL_HANDLE;
 	VkQueue graphicsQueue = VK_NULL_HANDLE;
 	VkQueue presentQueue = VK_NULL_HANDLE;
+	VkQueue transferQueue = VK_NULL_HANDLE; // Same as graphicsQueue when there's no dedicated transfer family
+	std::mutex graphicsQueueMutex; // Upload batches can be submitted from loader threads while we render
+	bool allowTransferQueue = true;
 	VkCommandPool commandPool = VK_NULL_HANDLE;
+	unique_ptr< UploadManager > uploadManager;
+	unique_ptr< GeometryArena > geometryArena;
+	unique_ptr< SamplerCache > samplerCache;
+	unique_ptr< UniformAllocator > uniformAllocator;
 
 	VkFormat swapChainImageFormat = VK_FORMAT_UNDEFINED;
 	VkExtent2D swapChainExtent = {};